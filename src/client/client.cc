@@ -29,19 +29,55 @@
 
 #include <filesystem>
 #include <iostream>
+#include <iterator>
 #include <string>
 
+#include <cstdint>
+
 namespace
 {
 
 bool beVerbose = false;
 
+/*
+ * Receives the cursor sets which follow a QUERY_RESULTS status, one per frame, and prints the records
+ * of each set as soon as it is decoded
+ */
+template <typename F>
+void receiveQueryResults(zmq::socket_t& socket, F printCursor)
+{
+   std::size_t    resultCount = 0;
+   zmq::message_t resultsMessage;
+
+   do
+   {
+      socket.recv(&resultsMessage);
+
+      ftags::util::BufferExtractor extractor(static_cast<std::byte*>(resultsMessage.data()), resultsMessage.size());
+      const ftags::CursorSet       output = ftags::CursorSet::deserialize(extractor.getExtractor());
+
+      for (auto iter = output.begin(); iter != output.end(); ++iter)
+      {
+         printCursor(output.inflateRecord(*iter));
+      }
+
+      resultCount += output.size();
+   } while (resultsMessage.more());
+
+   if (beVerbose)
+   {
+      std::cout << fmt::format("Received {} results\n", resultCount);
+   }
+}
+
 void dispatchFind(zmq::socket_t&                 socket,
                   const std::string&             projectName,
                   const std::string&             dirName,
                   ftags::query::Query::Type      type,
                   ftags::query::Query::Qualifier qualifier,
-                  const std::string&             symbolName)
+                  const std::string&             symbolName,
+                  uint64_t                       resultOffset,
+                  uint64_t                       resultLimit)
 {
    if (beVerbose)
    {
@@ -56,6 +92,8 @@ void dispatchFind(zmq::socket_t&                 socket,
    command.set_projectname(projectName);
    command.set_directoryname(dirName);
    command.set_symbolname(symbolName);
+   command.set_resultoffset(resultOffset);
+   command.set_resultlimit(resultLimit);
 
    switch (type)
    {
@@ -116,23 +154,16 @@ void dispatchFind(zmq::socket_t&                 socket,
 
    if (status.type() == ftags::Status_Type::Status_Type_QUERY_RESULTS)
    {
-      zmq::message_t resultsMessage;
-      socket.recv(&resultsMessage);
-
-      ftags::util::BufferExtractor extractor(static_cast<std::byte*>(resultsMessage.data()), resultsMessage.size());
-      const ftags::CursorSet       output = ftags::CursorSet::deserialize(extractor.getExtractor());
-      if (beVerbose)
-      {
-         std::cout << fmt::format("Received {} results\n", output.size());
-      }
-
-      for (auto iter = output.begin(); iter != output.end(); ++iter)
-      {
-         const ftags::Cursor cursor = output.inflateRecord(*iter);
-
+      receiveQueryResults(socket, [](const ftags::Cursor& cursor) {
          std::cout << cursor.location.fileName << ':' << cursor.location.line << ':' << cursor.location.column << "  "
                    << cursor.attributes.getRecordFlavor() << ' ' << cursor.attributes.getRecordType() << " >> "
                    << cursor.symbolName << std::endl;
+      });
+
+      if (status.hasmoreresults())
+      {
+         std::cout << fmt::format("More results follow; use --offset {}\n",
+                                  resultOffset + static_cast<uint64_t>(status.resultcount()));
       }
    }
    else if (status.type() == ftags::Status_Type::Status_Type_UNKNOWN_PROJECT)
@@ -184,20 +215,7 @@ void dispatchIdentifySymbol(zmq::socket_t&     socket,
 
    if (status.type() == ftags::Status_Type::Status_Type_QUERY_RESULTS)
    {
-      zmq::message_t resultsMessage;
-      socket.recv(&resultsMessage);
-
-      ftags::util::BufferExtractor extractor(static_cast<std::byte*>(resultsMessage.data()), resultsMessage.size());
-      const ftags::CursorSet       output = ftags::CursorSet::deserialize(extractor.getExtractor());
-      if (beVerbose)
-      {
-         std::cout << fmt::format("Received {} results\n", output.size());
-      }
-
-      for (auto iter = output.begin(); iter != output.end(); ++iter)
-      {
-         const ftags::Cursor cursor = output.inflateRecord(*iter);
-
+      receiveQueryResults(socket, [](const ftags::Cursor& cursor) {
          std::cout << fmt::format("{}:{}:{}  {} {} >> {}\n",
                                   cursor.location.fileName,
                                   cursor.location.line,
@@ -210,7 +228,7 @@ void dispatchIdentifySymbol(zmq::socket_t&     socket,
                                   cursor.definition.line,
                                   cursor.definition.column)
                    << std::endl;
-      }
+      });
    }
    else if (status.type() == ftags::Status_Type::Status_Type_UNKNOWN_PROJECT)
    {
@@ -277,24 +295,59 @@ void dispatchDumpTranslationUnit(zmq::socket_t&     socket,
 
    if (status.type() == ftags::Status_Type::Status_Type_QUERY_RESULTS)
    {
-      zmq::message_t resultsMessage;
-      socket.recv(&resultsMessage);
-
-      ftags::util::BufferExtractor extractor(static_cast<std::byte*>(resultsMessage.data()), resultsMessage.size());
-      const ftags::CursorSet       output = ftags::CursorSet::deserialize(extractor.getExtractor());
-      if (beVerbose)
-      {
-         std::cout << fmt::format("Received {} results\n", output.size());
-      }
-
-      for (auto iter = output.begin(); iter != output.end(); ++iter)
-      {
-         const ftags::Cursor cursor = output.inflateRecord(*iter);
-
+      receiveQueryResults(socket, [](const ftags::Cursor& cursor) {
          std::cout << cursor.location.line << ':' << cursor.location.column << "  "
                    << cursor.attributes.getRecordFlavor() << ' ' << cursor.attributes.getRecordType() << " >> "
                    << cursor.symbolName << std::endl;
-      }
+      });
+   }
+}
+
+/*
+ * Sends the contents of an editor buffer, read from standard input, to be reindexed in place of fileName
+ */
+void dispatchUpdateBuffer(zmq::socket_t&     socket,
+                          const std::string& projectName,
+                          const std::string& dirName,
+                          const std::string& fileName)
+{
+   std::filesystem::path filePath{fileName};
+   if (filePath.is_relative())
+   {
+      filePath = std::filesystem::current_path() / filePath;
+   }
+   const std::string absoluteFilePathAsString = filePath.lexically_normal().string();
+
+   const std::string contents{std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>()};
+
+   if (beVerbose)
+   {
+      std::cout << fmt::format(
+         "Updating {} with {} bytes of unsaved contents\n", absoluteFilePathAsString, contents.size());
+   }
+
+   ftags::Command command{};
+   command.set_source("client");
+   command.set_type(ftags::Command::Type::Command_Type_UPDATE_BUFFER);
+   command.set_projectname(projectName);
+   command.set_directoryname(dirName);
+   command.set_filename(absoluteFilePathAsString);
+   command.set_contents(contents);
+
+   const std::size_t requestSize = command.ByteSizeLong();
+   zmq::message_t    request(requestSize);
+   command.SerializeToArray(request.data(), static_cast<int>(requestSize));
+   socket.send(request);
+
+   zmq::message_t reply;
+   socket.recv(&reply);
+
+   ftags::Status status;
+   status.ParseFromArray(reply.data(), static_cast<int>(reply.size()));
+
+   for (int ii = 0; ii < status.remarks_size(); ii++)
+   {
+      std::cout << status.remarks(ii) << std::endl;
    }
 }
 
@@ -303,9 +356,12 @@ bool showHelp = false;
 bool                     findAll             = false;
 bool                     findFunction        = false;
 bool                     dumpTranslationUnit = false;
+bool                     updateBuffer        = false;
 bool                     doQuit              = false;
 bool                     doPing              = false;
 bool                     queryStats          = false;
+uint64_t                 resultOffset        = 0;
+uint64_t                 resultLimit         = 0;
 std::string              projectName; // NOLINT
 std::string              symbolName;  // NOLINT
 std::string              fileName;    // NOLINT
@@ -321,7 +377,10 @@ auto cli = clara::Help(showHelp) | clara::Opt(doQuit)["-q"]["--quit"]("Shutdown
            clara::Opt(findAll)["-a"]["--all"]("Find all occurrences of symbol") |
            clara::Opt(findFunction)["-f"]["--function"]("Find function") |
            clara::Opt(dumpTranslationUnit)["--dump"]("Dump symbols for translation unit") |
+           clara::Opt(updateBuffer)["--update-buffer"]("Reindex file from contents read from standard input") |
            clara::Opt(symbolName, "symbol")["-s"]["--symbol"]("Symbol name") |
+           clara::Opt(resultLimit, "count")["--limit"]("Show at most this many results") |
+           clara::Opt(resultOffset, "count")["--offset"]("Skip this many results") |
            clara::Opt(fileName, "file")["--file"]("File name") | clara::Arg(queryArray, "query");
 
 } // namespace
@@ -382,6 +441,14 @@ int main(int argc, char* argv[])
       }
       socket.connect(socketLocation);
 
+      if (updateBuffer)
+      {
+         dispatchUpdateBuffer(socket, projectName, dirName, fileName);
+
+         google::protobuf::ShutdownProtobufLibrary();
+         return 0;
+      }
+
       ftags::Command command{};
       command.set_source("client");
       std::string   serializedCommand;
@@ -409,7 +476,8 @@ int main(int argc, char* argv[])
       break;
 
       case ftags::query::Query::Verb::Find:
-         dispatchFind(socket, projectName, dirName, query.type, query.qualifier, query.symbolName);
+         dispatchFind(
+            socket, projectName, dirName, query.type, query.qualifier, query.symbolName, resultOffset, resultLimit);
          break;
 
       case ftags::query::Query::Verb::Identify:
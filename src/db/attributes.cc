@@ -251,5 +251,10 @@ std::string ftags::Attributes::getRecordFlavor() const
       os << " use";
    }
 
+   if (isQualified)
+   {
+      os << " qual";
+   }
+
    return os.str();
 }
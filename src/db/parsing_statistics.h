@@ -0,0 +1,149 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef FTAGS_DB_PARSING_STATISTICS_H_INCLUDED
+#define FTAGS_DB_PARSING_STATISTICS_H_INCLUDED
+
+#include <array>
+#include <chrono>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ftags
+{
+
+/*
+ * Time spent in each phase of indexing and the work done, accumulated over the translation units
+ * parsed into a database.
+ */
+struct ParsingStatistics
+{
+   enum class Phase : uint8_t
+   {
+      Parse,       // building the clang translation unit; includes indexing with the index action
+      Visit,       // walking the cursors; includes the two phases below
+      SymbolTable, // looking up and adding symbol names
+      RecordSpans, // canonicalizing, hashing and deduplicating record spans
+   };
+
+   static constexpr std::size_t k_phaseCount = 4;
+
+   std::array<uint64_t, k_phaseCount> phaseNanoseconds = {};
+
+   uint64_t translationUnits  = 0;
+   uint64_t cursorsVisited    = 0;
+   uint64_t cursorsKept       = 0;
+   uint64_t recordsEmitted    = 0;
+   uint64_t newSpans          = 0;
+   uint64_t deduplicatedSpans = 0;
+
+   // size of the new symbol names and of the records in new spans
+   uint64_t bytesAdded = 0;
+
+   uint64_t& getPhaseNanoseconds(Phase phase) noexcept
+   {
+      return phaseNanoseconds[static_cast<std::size_t>(phase)];
+   }
+
+   uint64_t getPhaseNanoseconds(Phase phase) const noexcept
+   {
+      return phaseNanoseconds[static_cast<std::size_t>(phase)];
+   }
+
+   // the symbol table and record span phases are part of the visit
+   uint64_t getIndexingNanoseconds() const noexcept
+   {
+      return getPhaseNanoseconds(Phase::Parse) + getPhaseNanoseconds(Phase::Visit);
+   }
+
+   ParsingStatistics& operator+=(const ParsingStatistics& other) noexcept
+   {
+      for (std::size_t ii = 0; ii < k_phaseCount; ii++)
+      {
+         phaseNanoseconds[ii] += other.phaseNanoseconds[ii];
+      }
+
+      translationUnits += other.translationUnits;
+      cursorsVisited += other.cursorsVisited;
+      cursorsKept += other.cursorsKept;
+      recordsEmitted += other.recordsEmitted;
+      newSpans += other.newSpans;
+      deduplicatedSpans += other.deduplicatedSpans;
+      bytesAdded += other.bytesAdded;
+
+      return *this;
+   }
+
+   // what was accumulated since an earlier snapshot of the same statistics
+   ParsingStatistics& operator-=(const ParsingStatistics& other) noexcept
+   {
+      for (std::size_t ii = 0; ii < k_phaseCount; ii++)
+      {
+         phaseNanoseconds[ii] -= other.phaseNanoseconds[ii];
+      }
+
+      translationUnits -= other.translationUnits;
+      cursorsVisited -= other.cursorsVisited;
+      cursorsKept -= other.cursorsKept;
+      recordsEmitted -= other.recordsEmitted;
+      newSpans -= other.newSpans;
+      deduplicatedSpans -= other.deduplicatedSpans;
+      bytesAdded -= other.bytesAdded;
+
+      return *this;
+   }
+};
+
+/*
+ * Adds the time elapsed during its lifetime to a phase; does nothing without statistics. When only
+ * one in every weight operations is timed, the elapsed time is scaled by the weight.
+ */
+class ScopedPhaseTimer
+{
+public:
+   ScopedPhaseTimer(ParsingStatistics* statistics, ParsingStatistics::Phase phase, uint32_t weight = 1) noexcept :
+      m_statistics{statistics}, m_phase{phase}, m_weight{weight}
+   {
+      if (m_statistics != nullptr)
+      {
+         m_start = std::chrono::steady_clock::now();
+      }
+   }
+
+   ScopedPhaseTimer(const ScopedPhaseTimer& other) = delete;
+   ScopedPhaseTimer& operator=(const ScopedPhaseTimer& other) = delete;
+
+   ~ScopedPhaseTimer() noexcept
+   {
+      if (m_statistics != nullptr)
+      {
+         const auto elapsed = std::chrono::steady_clock::now() - m_start;
+         m_statistics->getPhaseNanoseconds(m_phase) +=
+            m_weight * static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+      }
+   }
+
+private:
+   ParsingStatistics*                    m_statistics;
+   ParsingStatistics::Phase              m_phase;
+   uint32_t                              m_weight;
+   std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace ftags
+
+#endif // FTAGS_DB_PARSING_STATISTICS_H_INCLUDED
@@ -17,10 +17,15 @@
 #include <project.h>
 #include <statistics.h>
 
+#include <spooky.h>
+
 #include <fmt/format.h>
 
 #include <algorithm>
+#include <iterator>
 #include <numeric>
+#include <random>
+#include <set>
 
 /*
  * ProjectDb
@@ -181,6 +186,179 @@ bool ftags::ProjectDb::isFileIndexed(const std::string& fileName) const
    return isIndexed;
 }
 
+const ftags::ProjectDb::TranslationUnit* ftags::ProjectDb::lookupTranslationUnit(const std::string& fileName) const
+{
+   const auto fileNameKey = m_fileNameTable.getKey(fileName.data());
+   if (fileNameKey == 0)
+   {
+      return nullptr;
+   }
+
+   const auto iter = m_fileIndex.find(fileNameKey);
+   if (iter == m_fileIndex.end())
+   {
+      return nullptr;
+   }
+
+   const auto& [translationUnit, rangeEnd] = m_translationUnits.get(iter->second);
+   return translationUnit;
+}
+
+bool ftags::ProjectDb::isTranslationUnitCurrent(const std::string&              fileName,
+                                                const std::vector<const char*>& arguments,
+                                                FileHashCache&                  fileHashCache) const
+{
+   return isFingerprintCurrent(getTranslationUnitFingerprint(fileName), arguments, fileHashCache);
+}
+
+ftags::ProjectDb::TranslationUnitFingerprint
+ftags::ProjectDb::getTranslationUnitFingerprint(const std::string& fileName) const
+{
+   TranslationUnitFingerprint translationUnitFingerprint;
+
+   const TranslationUnit* translationUnit = lookupTranslationUnit(fileName);
+   if ((translationUnit == nullptr) || translationUnit->isPartial() || (translationUnit->getFingerprint() == 0))
+   {
+      return translationUnitFingerprint;
+   }
+
+   translationUnitFingerprint.fingerprint = translationUnit->getFingerprint();
+   translationUnitFingerprint.dependencies.reserve(translationUnit->getDependencies().size());
+
+   for (const auto dependencyKey : translationUnit->getDependencies())
+   {
+      translationUnitFingerprint.dependencies.emplace_back(m_fileNameTable.getString(dependencyKey));
+   }
+
+   return translationUnitFingerprint;
+}
+
+bool ftags::ProjectDb::isFingerprintCurrent(const TranslationUnitFingerprint& translationUnitFingerprint,
+                                            const std::vector<const char*>&   arguments,
+                                            FileHashCache&                    fileHashCache)
+{
+   if (translationUnitFingerprint.fingerprint == 0)
+   {
+      return false;
+   }
+
+   std::vector<uint64_t> dependencyHashes;
+   dependencyHashes.reserve(translationUnitFingerprint.dependencies.size());
+
+   for (const auto& dependency : translationUnitFingerprint.dependencies)
+   {
+      // most headers are shared by many translation units; read each of them only once
+      auto [cacheIter, isNew] = fileHashCache.try_emplace(dependency, 0);
+      if (isNew)
+      {
+         cacheIter->second = TranslationUnit::hashFile(cacheIter->first);
+      }
+
+      dependencyHashes.push_back(cacheIter->second);
+   }
+
+   return TranslationUnit::computeFingerprint(arguments, dependencyHashes) == translationUnitFingerprint.fingerprint;
+}
+
+uint64_t ftags::ProjectDb::getTranslationUnitParseNanoseconds(const std::string& fileName) const
+{
+   const TranslationUnit* translationUnit = lookupTranslationUnit(fileName);
+   return (translationUnit != nullptr) ? translationUnit->getParseNanoseconds() : 0;
+}
+
+std::string ftags::ProjectDb::makeRootPrefix(std::string_view rootDirectory)
+{
+   if (rootDirectory.empty())
+   {
+      return std::string{};
+   }
+
+   std::error_code             errorCode;
+   const std::filesystem::path rootPath =
+      std::filesystem::weakly_canonical(std::filesystem::path{rootDirectory}, errorCode);
+
+   std::string rootPrefix = errorCode ? std::string{rootDirectory} : rootPath.string();
+   if (rootPrefix.back() != std::filesystem::path::preferred_separator)
+   {
+      rootPrefix.push_back(std::filesystem::path::preferred_separator);
+   }
+
+   return rootPrefix;
+}
+
+uint64_t ftags::ProjectDb::getTranslationUnitIncludeSignature(const std::string& fileName) const
+{
+   const TranslationUnit* translationUnit = lookupTranslationUnit(fileName);
+   if (translationUnit == nullptr)
+   {
+      return 0;
+   }
+
+   uint64_t signature = 0;
+
+   // the system headers are shared by most translation units, so they say little about locality
+   for (const auto dependencyKey : translationUnit->getDependencies())
+   {
+      if (dependencyKey == translationUnit->getFileNameKey())
+      {
+         continue;
+      }
+
+      const std::string_view dependencyName{m_fileNameTable.getString(dependencyKey)};
+      if (dependencyName.compare(0, m_rootPrefix.size(), m_rootPrefix) != 0)
+      {
+         continue;
+      }
+
+      const uint64_t hash = SpookyHash::Hash64(dependencyName.data(), dependencyName.size(), k_includeSignatureSeed);
+      if ((signature == 0) || (hash < signature))
+      {
+         signature = hash;
+      }
+   }
+
+   return signature;
+}
+
+std::vector<std::string>
+ftags::ProjectDb::findDependentTranslationUnits(const std::vector<std::string>& fileNames) const
+{
+   // the dependencies are keyed by the canonical names of the files, as are their records
+   std::unordered_set<ftags::util::StringTable::Key> fileNameKeys;
+   for (const auto& fileName : fileNames)
+   {
+      const auto fileNameKey = m_fileNameTable.getKey(std::filesystem::path{fileName}.lexically_normal().string());
+      if (fileNameKey != 0)
+      {
+         fileNameKeys.insert(fileNameKey);
+      }
+   }
+
+   std::vector<std::string> dependents;
+   if (fileNameKeys.empty())
+   {
+      return dependents;
+   }
+
+   const auto isChanged = [&fileNameKeys](ftags::util::StringTable::Key fileNameKey) {
+      return fileNameKeys.count(fileNameKey) != 0;
+   };
+
+   m_translationUnits.forEach([this, &isChanged, &dependents](TranslationUnitStore::Key /* key */,
+                                                              const TranslationUnit* translationUnit) {
+      const auto& dependencies = translationUnit->getDependencies();
+
+      // the dependencies include the source itself, unless it was never fingerprinted
+      if (isChanged(translationUnit->getFileNameKey()) ||
+          std::any_of(dependencies.cbegin(), dependencies.cend(), isChanged))
+      {
+         dependents.emplace_back(m_fileNameTable.getString(translationUnit->getFileNameKey()));
+      }
+   });
+
+   return dependents;
+}
+
 std::vector<const ftags::Record*> ftags::ProjectDb::getFunctions() const
 {
    std::vector<const ftags::Record*> functions = m_recordSpanManager.filterRecords(
@@ -219,6 +397,110 @@ std::vector<const ftags::Record*> ftags::ProjectDb::findSymbol(const std::string
       symbolName, [symbolType](const Record* record) { return record->attributes.getType() == symbolType; });
 }
 
+bool ftags::ProjectDb::SymbolQuery::selects(const Record* record) const
+{
+   const Attributes& attributes = record->attributes;
+
+   switch (symbolQualifier)
+   {
+   case SymbolQualifier::Any:
+      break;
+
+   case SymbolQualifier::Declaration:
+      // the references to declarations are marked as declarations as well
+      if ((!attributes.isDeclaration) || attributes.isDefinition || attributes.isReference)
+      {
+         return false;
+      }
+      break;
+
+   case SymbolQualifier::Definition:
+      if (!attributes.isDefinition)
+      {
+         return false;
+      }
+      break;
+
+   case SymbolQualifier::Reference:
+      if (!attributes.isReference)
+      {
+         return false;
+      }
+      break;
+
+   case SymbolQualifier::Instantiation:
+      if (!attributes.isConstructed)
+      {
+         return false;
+      }
+      break;
+
+   case SymbolQualifier::Destruction:
+      if (!attributes.isDestructed)
+      {
+         return false;
+      }
+      break;
+   }
+
+   return symbolTypes.empty() ||
+          (std::find(symbolTypes.cbegin(), symbolTypes.cend(), attributes.getType()) != symbolTypes.cend());
+}
+
+std::vector<const ftags::Record*> ftags::ProjectDb::findSymbol(const std::string& symbolName,
+                                                               const SymbolQuery& symbolQuery,
+                                                               bool&              hasMoreResults) const
+{
+   std::vector<const Record*> results;
+
+   hasMoreResults = false;
+
+   const auto skippedResults = [&symbolQuery](const std::vector<const Record*>& records) {
+      return static_cast<std::ptrdiff_t>(std::min(symbolQuery.offset, records.size()));
+   };
+
+   if (symbolQuery.limit == 0)
+   {
+      results = filterRecordsWithSymbol(symbolName, [&symbolQuery](const Record* record) {
+         return symbolQuery.selects(record);
+      });
+
+      results.erase(results.begin(), std::next(results.begin(), skippedResults(results)));
+      return results;
+   }
+
+   // one more than the page tells whether there is another one
+   const std::size_t resultsNeeded = symbolQuery.offset + symbolQuery.limit + 1;
+
+   // the same record can be found in more than one span, and is counted once
+   const auto compareRecords = [](const Record* leftRecord, const Record* rightRecord) {
+      return *leftRecord < *rightRecord;
+   };
+   std::set<const Record*, decltype(compareRecords)> seenRecords(compareRecords);
+
+   m_recordSpanManager.forEachRecordWithSymbolUntil(
+      m_symbolTable.getKey(symbolName.data()),
+      [&symbolQuery, &results, &seenRecords](const Record* record) {
+         if (symbolQuery.selects(record) && seenRecords.insert(record).second)
+         {
+            results.push_back(record);
+         }
+      },
+      [&results, resultsNeeded]() { return results.size() >= resultsNeeded; });
+
+   if (results.size() >= resultsNeeded)
+   {
+      hasMoreResults = true;
+      results.resize(resultsNeeded - 1);
+   }
+
+   results.erase(results.begin(), std::next(results.begin(), skippedResults(results)));
+
+   std::sort(results.begin(), results.end(), compareRecords);
+
+   return results;
+}
+
 std::vector<const ftags::Record*>
 ftags::ProjectDb::identifySymbol(const std::string& fileName, unsigned lineNumber, unsigned columnNumber) const
 {
@@ -320,12 +602,11 @@ ftags::ProjectDb ftags::ProjectDb::deserialize(ftags::util::TypedExtractor& extr
    uint64_t translationUnitCount = 0;
    extractor >> translationUnitCount;
 
-   // FIXME: this assumes a compact container
    for (size_t ii = 0; ii < translationUnitCount; ii++)
    {
       auto alloc                                              = projectDb.m_translationUnits.construct();
       *alloc.iterator                                         = TranslationUnit::deserialize(extractor);
-      projectDb.m_fileIndex[alloc.iterator->getFileNameKey()] = static_cast<TranslationUnitStore::Key>(ii);
+      projectDb.m_fileIndex[alloc.iterator->getFileNameKey()] = alloc.key;
    }
 
    projectDb.assertValid();
@@ -333,7 +614,7 @@ ftags::ProjectDb ftags::ProjectDb::deserialize(ftags::util::TypedExtractor& extr
    return projectDb;
 }
 
-void ftags::ProjectDb::mergeFrom(const ProjectDb& other)
+void ftags::ProjectDb::mergeFrom(const ProjectDb& other, const std::function<void()>& betweenSlices)
 {
    /*
     * merge the symbols
@@ -341,25 +622,470 @@ void ftags::ProjectDb::mergeFrom(const ProjectDb& other)
    KeyMap symbolKeyMapping   = m_symbolTable.mergeStringTable(other.m_symbolTable);
    KeyMap fileNameKeyMapping = m_fileNameTable.mergeStringTable(other.m_fileNameTable);
 
-   other.m_translationUnits.forEach([this, &other, &symbolKeyMapping, &fileNameKeyMapping](
+   /*
+    * the string tables only grow, so the key mappings remain valid while readers are let in
+    */
+   other.m_translationUnits.forEach([this, &other, &symbolKeyMapping, &fileNameKeyMapping, &betweenSlices](
                                        TranslationUnitStore::Key /* key */, const TranslationUnit* translationUnit) {
       assert(translationUnit->getFileNameKey());
       const auto iter = fileNameKeyMapping.lookup(translationUnit->getFileNameKey());
       assert(iter != fileNameKeyMapping.none());
+      const auto fileNameKey = iter->second;
+
+      const auto existing = m_fileIndex.find(fileNameKey);
+      if (existing != m_fileIndex.end())
+      {
+         const auto& [existingTranslationUnit, rangeEnd] = m_translationUnits.get(existing->second);
+         if (translationUnit->isPartial() && (!existingTranslationUnit->isPartial()))
+         {
+            // a declarations-only pass never replaces the complete translation unit
+            return;
+         }
+      }
 
       auto alloc = m_translationUnits.construct();
-      alloc.iterator->setFileNameKey(iter->first);
+      alloc.iterator->setFileNameKey(fileNameKey);
       alloc.iterator->copyRecords(
          *translationUnit, other.m_recordSpanManager, m_recordSpanManager, symbolKeyMapping, fileNameKeyMapping);
 
-      m_fileIndex[iter->first] = alloc.key;
+      /*
+       * release the previous version after the new one took references to the spans they share
+       */
+      if (existing != m_fileIndex.end())
+      {
+         releaseTranslationUnit(existing->second);
+      }
+
+      m_fileIndex[fileNameKey] = alloc.key;
+
+      if (betweenSlices)
+      {
+         betweenSlices();
+      }
    });
+
+   m_parsingStatistics += other.m_parsingStatistics;
 }
 
-void ftags::ProjectDb::updateFrom(const std::string& /* fileName */, const ProjectDb& other)
+void ftags::ProjectDb::updateFrom(const std::string&           /* fileName */,
+                                  const ProjectDb&             other,
+                                  const std::function<void()>& betweenSlices)
 {
-   // TODO(signbit): check if the file name is indexed already and remove its entries
-   mergeFrom(other);
+   mergeFrom(other, betweenSlices);
+}
+
+std::vector<std::byte> ftags::ProjectDb::serializeTranslationUnitDelta(const std::string& fileName,
+                                                                      StreamEncoder&     encoder) const
+{
+   const TranslationUnit* translationUnit = lookupTranslationUnit(fileName);
+   if (translationUnit == nullptr)
+   {
+      return {};
+   }
+
+   using Key = ftags::util::StringTable::Key;
+
+   std::vector<uint64_t> referencedSpans;
+   std::vector<uint64_t> sentSpans;
+   std::vector<Key>      symbolKeys;
+   std::vector<Key>      fileNameKeys;
+
+   collectDeltaContents(*translationUnit, encoder, referencedSpans, sentSpans, symbolKeys, fileNameKeys);
+
+   // with the receiver's keys no strings are sent; otherwise only the ones not sent before on the stream
+   std::vector<Key> newSymbolKeys;
+   std::vector<Key> newFileNameKeys;
+
+   if (encoder.receiverKeysVersion == 0)
+   {
+      std::copy_if(symbolKeys.cbegin(), symbolKeys.cend(), std::back_inserter(newSymbolKeys), [&encoder](Key key) {
+         return encoder.sentSymbolKeys.insert(key).second;
+      });
+      std::copy_if(
+         fileNameKeys.cbegin(), fileNameKeys.cend(), std::back_inserter(newFileNameKeys), [&encoder](Key key) {
+            return encoder.sentFileNameKeys.insert(key).second;
+         });
+   }
+
+   const auto computeStringsSize = [](const std::vector<Key>& keys, const ftags::util::StringTable& table) {
+      return std::accumulate(keys.cbegin(), keys.cend(), sizeof(uint64_t), [&table](std::size_t acc, Key key) {
+         return acc + sizeof(Key) + sizeof(uint64_t) + table.getStringView(key).size();
+      });
+   };
+
+   const auto serializeStrings =
+      [](const std::vector<Key>& keys, const ftags::util::StringTable& table, ftags::util::TypedInsertor& insertor) {
+         const uint64_t count = keys.size();
+         insertor << count;
+
+         for (const Key key : keys)
+         {
+            insertor << key;
+            ftags::util::Serializer<std::string>::serialize(std::string{table.getStringView(key)}, insertor);
+         }
+      };
+
+   std::vector<std::byte> buffer(sizeof(ftags::util::SerializedObjectHeader) +
+                                 computeStringsSize(newSymbolKeys, m_symbolTable) +
+                                 computeStringsSize(newFileNameKeys, m_fileNameTable) +
+                                 translationUnit->computeStreamedSize(m_recordSpanManager, referencedSpans));
+
+   ftags::util::BufferSerializationWriter writer{buffer};
+   ftags::util::TypedInsertor             insertor{writer};
+
+   ftags::util::SerializedObjectHeader header{"ftags::TUDelta"};
+   insertor << header;
+
+   serializeStrings(newSymbolKeys, m_symbolTable, insertor);
+   serializeStrings(newFileNameKeys, m_fileNameTable, insertor);
+
+   translationUnit->serializeStreamed(insertor, m_recordSpanManager, referencedSpans, encoder);
+
+   insertor.assertEmpty();
+
+   encoder.knownRecordSpans.insert(sentSpans.cbegin(), sentSpans.cend());
+
+   return buffer;
+}
+
+void ftags::ProjectDb::collectDeltaContents(const TranslationUnit&                      translationUnit,
+                                            const StreamEncoder&                        encoder,
+                                            std::vector<uint64_t>&                      referencedSpans,
+                                            std::vector<uint64_t>&                      sentSpans,
+                                            std::vector<ftags::util::StringTable::Key>& symbolKeys,
+                                            std::vector<ftags::util::StringTable::Key>& fileNameKeys) const
+{
+   using Key = ftags::util::StringTable::Key;
+
+   std::unordered_set<Key> seenSymbolKeys;
+   std::unordered_set<Key> seenFileNameKeys;
+
+   const auto addFileNameKey = [&seenFileNameKeys, &fileNameKeys](Key key) {
+      if ((key != 0) && seenFileNameKeys.insert(key).second)
+      {
+         fileNameKeys.push_back(key);
+      }
+   };
+
+   addFileNameKey(translationUnit.getFileNameKey());
+
+   for (const Key dependency : translationUnit.getDependencies())
+   {
+      addFileNameKey(dependency);
+   }
+
+   /*
+    * the spans the receiver has are sent as references, without their strings; the ones sent now can
+    * only be referred to by the next deltas, as the receiver indexes them after adding this one
+    */
+   referencedSpans.reserve(translationUnit.getRecordSpans().size());
+
+   for (const RecordSpan::Store::Key recordSpanKey : translationUnit.getRecordSpans())
+   {
+      const RecordSpan& recordSpan  = m_recordSpanManager.getSpan(recordSpanKey);
+      const uint64_t    contentHash = computeContentHash(recordSpan);
+
+      if (encoder.knownRecordSpans.count(contentHash) != 0)
+      {
+         referencedSpans.push_back(contentHash);
+         continue;
+      }
+
+      referencedSpans.push_back(0);
+      sentSpans.push_back(contentHash);
+
+      recordSpan.forEachRecord([&seenSymbolKeys, &symbolKeys, &addFileNameKey](const Record* record) {
+         if ((record->symbolNameKey != 0) && seenSymbolKeys.insert(record->symbolNameKey).second)
+         {
+            symbolKeys.push_back(record->symbolNameKey);
+         }
+
+         addFileNameKey(record->location.fileNameKey);
+         addFileNameKey(record->definition.fileNameKey);
+      });
+   }
+}
+
+void ftags::ProjectDb::addTranslationUnitDelta(ftags::util::TypedExtractor& extractor, StreamDecoder& decoder)
+{
+   ftags::util::SerializedObjectHeader header = {};
+   extractor >> header;
+
+   const auto addStrings = [&extractor](ftags::util::StringTable& table, auto& keyMapping) {
+      uint64_t count = 0;
+      extractor >> count;
+
+      for (uint64_t ii = 0; ii < count; ii++)
+      {
+         ftags::util::StringTable::Key key = 0;
+         extractor >> key;
+
+         const std::string value = ftags::util::Serializer<std::string>::deserialize(extractor);
+         keyMapping[key]         = table.addKey(value);
+      }
+   };
+
+   addStrings(m_symbolTable, decoder.symbolKeys);
+   addStrings(m_fileNameTable, decoder.fileNameKeys);
+
+   TranslationUnit translationUnit = TranslationUnit::deserializeStreamed(extractor, decoder, m_recordSpanManager);
+
+   for (const RecordSpan::Store::Key recordSpanKey : translationUnit.getRecordSpans())
+   {
+      if (m_recordSpanManager.getContentHash(recordSpanKey) == 0)
+      {
+         m_recordSpanManager.setContentHash(recordSpanKey,
+                                            computeContentHash(m_recordSpanManager.getSpan(recordSpanKey)));
+      }
+
+      // the sender refers to the spans it sent once by their content hash from now on
+      if (decoder.pinnedRecordSpans.insert(recordSpanKey).second)
+      {
+         m_recordSpanManager.getSpan(recordSpanKey).addRef();
+      }
+   }
+
+   const auto fileNameKey = translationUnit.getFileNameKey();
+
+   const auto existing = m_fileIndex.find(fileNameKey);
+   if (existing != m_fileIndex.end())
+   {
+      const auto& [existingTranslationUnit, rangeEnd] = m_translationUnits.get(existing->second);
+      if (translationUnit.isPartial() && (!existingTranslationUnit->isPartial()))
+      {
+         // a declarations-only pass never replaces the complete translation unit
+         translationUnit.releaseRecordSpans(m_recordSpanManager);
+         return;
+      }
+   }
+
+   auto alloc      = m_translationUnits.construct();
+   *alloc.iterator = std::move(translationUnit);
+
+   // the new version already took references to the spans it shares with the previous one
+   if (existing != m_fileIndex.end())
+   {
+      releaseTranslationUnit(existing->second);
+   }
+
+   m_fileIndex[fileNameKey] = alloc.key;
+}
+
+std::vector<uint64_t> ftags::ProjectDb::getRecordSpanContentHashes() const
+{
+   std::unordered_set<uint64_t> contentHashes;
+
+   m_translationUnits.forEach(
+      [this, &contentHashes](TranslationUnitStore::Key /* key */, const TranslationUnit* translationUnit) {
+         translationUnit->forEachRecordSpan(
+            [this, &contentHashes](const RecordSpan& recordSpan) {
+               contentHashes.insert(computeContentHash(recordSpan));
+            },
+            m_recordSpanManager);
+      });
+
+   return std::vector<uint64_t>(contentHashes.cbegin(), contentHashes.cend());
+}
+
+std::vector<uint64_t> ftags::ProjectDb::findMissingRecordSpans(const std::vector<uint64_t>& contentHashes,
+                                                               StreamDecoder&               decoder)
+{
+   std::vector<uint64_t> missingRecordSpans;
+
+   for (const uint64_t contentHash : contentHashes)
+   {
+      const auto recordSpanKey = m_recordSpanManager.findSpanByContentHash(contentHash);
+      if (recordSpanKey == 0)
+      {
+         missingRecordSpans.push_back(contentHash);
+      }
+      else if (decoder.pinnedRecordSpans.insert(recordSpanKey).second)
+      {
+         m_recordSpanManager.getSpan(recordSpanKey).addRef();
+      }
+   }
+
+   return missingRecordSpans;
+}
+
+void ftags::ProjectDb::releaseStream(StreamDecoder& decoder)
+{
+   for (const RecordSpan::Store::Key recordSpanKey : decoder.pinnedRecordSpans)
+   {
+      m_recordSpanManager.releaseSpan(recordSpanKey);
+   }
+
+   decoder.pinnedRecordSpans.clear();
+}
+
+void ftags::ProjectDb::findUnresolvedStrings(const std::vector<std::string>& fileNames,
+                                             const StreamEncoder&            encoder,
+                                             const KeyDictionary&            dictionary,
+                                             std::vector<std::string>&       symbolNames,
+                                             std::vector<std::string>&       fileNamesToResolve) const
+{
+   using Key = ftags::util::StringTable::Key;
+
+   std::unordered_set<Key> unresolvedSymbolKeys;
+   std::unordered_set<Key> unresolvedFileNameKeys;
+
+   for (const std::string& fileName : fileNames)
+   {
+      const TranslationUnit* translationUnit = lookupTranslationUnit(fileName);
+      if (translationUnit == nullptr)
+      {
+         continue;
+      }
+
+      std::vector<uint64_t> referencedSpans;
+      std::vector<uint64_t> sentSpans;
+      std::vector<Key>      symbolKeys;
+      std::vector<Key>      fileNameKeys;
+
+      collectDeltaContents(*translationUnit, encoder, referencedSpans, sentSpans, symbolKeys, fileNameKeys);
+
+      for (const Key key : symbolKeys)
+      {
+         const std::string_view symbolName = m_symbolTable.getStringView(key);
+         if ((dictionary.symbolKeys.count(std::string{symbolName}) == 0) && unresolvedSymbolKeys.insert(key).second)
+         {
+            symbolNames.emplace_back(symbolName);
+         }
+      }
+
+      for (const Key key : fileNameKeys)
+      {
+         const std::string_view fileNameToResolve = m_fileNameTable.getStringView(key);
+         if ((dictionary.fileNameKeys.count(std::string{fileNameToResolve}) == 0) &&
+             unresolvedFileNameKeys.insert(key).second)
+         {
+            fileNamesToResolve.emplace_back(fileNameToResolve);
+         }
+      }
+   }
+}
+
+void ftags::ProjectDb::bindReceiverKeys(const KeyDictionary& dictionary, StreamEncoder& encoder) const
+{
+   const auto bindKeys = [](const ftags::util::StringTable& table, const auto& dictionaryKeys, auto& receiverKeys) {
+      table.forEachElement(
+         [&dictionaryKeys, &receiverKeys](std::string_view value, ftags::util::StringTable::Key key) {
+            const auto iter = dictionaryKeys.find(std::string{value});
+            if (iter != dictionaryKeys.end())
+            {
+               receiverKeys[key] = iter->second;
+            }
+         });
+   };
+
+   bindKeys(m_symbolTable, dictionary.symbolKeys, encoder.receiverSymbolKeys);
+   bindKeys(m_fileNameTable, dictionary.fileNameKeys, encoder.receiverFileNameKeys);
+
+   encoder.receiverKeysVersion = dictionary.version;
+}
+
+std::vector<ftags::util::StringTable::Key>
+ftags::ProjectDb::resolveSymbolKeys(const std::vector<std::string>& symbolNames)
+{
+   std::vector<ftags::util::StringTable::Key> keys;
+   keys.reserve(symbolNames.size());
+
+   for (const std::string& symbolName : symbolNames)
+   {
+      keys.push_back(m_symbolTable.addKey(symbolName));
+   }
+
+   return keys;
+}
+
+std::vector<ftags::util::StringTable::Key>
+ftags::ProjectDb::resolveFileNameKeys(const std::vector<std::string>& fileNames)
+{
+   std::vector<ftags::util::StringTable::Key> keys;
+   keys.reserve(fileNames.size());
+
+   for (const std::string& fileName : fileNames)
+   {
+      keys.push_back(m_fileNameTable.addKey(fileName));
+   }
+
+   return keys;
+}
+
+uint64_t ftags::ProjectDb::makeKeyDictionaryVersion()
+{
+   std::random_device randomDevice;
+
+   // zero means the keys were not taken from a dictionary
+   uint64_t version = 0;
+   while (version == 0)
+   {
+      version = (uint64_t{randomDevice()} << 32U) | uint64_t{randomDevice()};
+   }
+
+   return version;
+}
+
+uint64_t ftags::ProjectDb::computeContentHash(const RecordSpan& recordSpan) const
+{
+   SpookyHash hash = {};
+
+   hash.Init(k_contentHashSeed, k_contentHashSeed);
+
+   const auto hashString = [&hash](const ftags::util::StringTable& stringTable, ftags::util::StringTable::Key key) {
+      if (key != 0)
+      {
+         const std::string_view value = stringTable.getStringView(key);
+         hash.Update(value.data(), value.size());
+      }
+
+      // include the terminator, so the boundaries between strings are significant
+      hash.Update("", 1);
+   };
+
+   recordSpan.forEachRecord([this, &hash, &hashString](const Record* record) {
+      hashString(m_symbolTable, record->symbolNameKey);
+      hashString(m_fileNameTable, record->location.fileNameKey);
+      hashString(m_fileNameTable, record->definition.fileNameKey);
+
+      Record keyless        = *record;
+      keyless.symbolNameKey = 0;
+      keyless.setLocationFileKey(0);
+      keyless.setDefinitionFileKey(0);
+
+      hash.Update(&keyless, sizeof(keyless));
+   });
+
+   uint64_t hash1 = 0;
+   uint64_t hash2 = 0;
+   hash.Final(&hash1, &hash2);
+
+   // zero stands for no hash
+   return (hash1 != 0) ? hash1 : 1;
+}
+
+void ftags::ProjectDb::removeTranslationUnit(const std::string& fileName)
+{
+   const auto fileNameKey = m_fileNameTable.getKey(fileName.data());
+   if (fileNameKey == 0)
+   {
+      return;
+   }
+
+   const auto iter = m_fileIndex.find(fileNameKey);
+   if (iter != m_fileIndex.end())
+   {
+      releaseTranslationUnit(iter->second);
+      m_fileIndex.erase(iter);
+   }
+}
+
+void ftags::ProjectDb::releaseTranslationUnit(uint32_t translationUnitKey)
+{
+   auto [translationUnit, rangeEnd] = m_translationUnits.get(translationUnitKey);
+   translationUnit->releaseRecordSpans(m_recordSpanManager);
+
+   m_translationUnits.destroy(translationUnitKey);
 }
 
 constexpr uint32_t k_ExtraLargeSymbolSize      = 1024;
@@ -393,6 +1119,30 @@ std::vector<std::string> ftags::ProjectDb::getStatisticsRemarks(const std::strin
       remarks.emplace_back(fmt::format("  maximum:        {:>8}", symbolSizesSummary.maximum));
       remarks.emplace_back("");
    }
+   else if (statisticsGroup == "parsing")
+   {
+      const ParsingStatistics& statistics = m_parsingStatistics;
+
+      const auto seconds = [&statistics](ParsingStatistics::Phase phase) {
+         return static_cast<double>(statistics.getPhaseNanoseconds(phase)) / 1e9;
+      };
+
+      remarks.emplace_back(fmt::format("Parsed {:n} translation units", statistics.translationUnits));
+      remarks.emplace_back("Time spent, in seconds:");
+      remarks.emplace_back(fmt::format("  parse:          {:>12.3f}", seconds(ParsingStatistics::Phase::Parse)));
+      remarks.emplace_back(fmt::format("  visit:          {:>12.3f}", seconds(ParsingStatistics::Phase::Visit)));
+      remarks.emplace_back(
+         fmt::format("    symbol table: {:>12.3f}", seconds(ParsingStatistics::Phase::SymbolTable)));
+      remarks.emplace_back(
+         fmt::format("    record spans: {:>12.3f}", seconds(ParsingStatistics::Phase::RecordSpans)));
+      remarks.emplace_back(fmt::format(
+         "Visited {:n} cursors and kept {:n}", statistics.cursorsVisited, statistics.cursorsKept));
+      remarks.emplace_back(fmt::format("Emitted {:n} records in {:n} new spans; {:n} spans were deduplicated",
+                                       statistics.recordsEmitted,
+                                       statistics.newSpans,
+                                       statistics.deduplicatedSpans));
+      remarks.emplace_back(fmt::format("Added {:n} bytes of symbols and records", statistics.bytesAdded));
+   }
    else if (statisticsGroup == "debug_symbols")
    {
       std::vector<ftags::util::StringTable::Key> largeSymbols;
@@ -17,25 +17,31 @@
 #ifndef DB_PROJECT_H_INCLUDED
 #define DB_PROJECT_H_INCLUDED
 
+#include <parsing_statistics.h>
 #include <record.h>
 #include <record_span.h>
 #include <record_span_manager.h>
 
+#include <hash_set.h>
+
 #include <serialization.h>
 #include <string_table.h>
 
 #include <algorithm>
 #include <array>
 #include <filesystem>
+#include <functional>
 #include <iosfwd>
 #include <map>
 #include <memory>
 #include <numeric>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include <cstddef>
 #include <cstdint>
 
 namespace ftags
@@ -73,6 +79,125 @@ struct Cursor
    Location definition;
 };
 
+/*
+ * libclang state that outlives a single translation unit; a session is used by one thread at a time.
+ */
+class ParsingSession
+{
+public:
+   enum class Profile : uint8_t
+   {
+      Interactive, // precompiled preamble and completion cache, suitable for reparsing
+      Batch,       // one-shot parsing; no preamble, no completion cache, diagnostics are not retrieved
+   };
+
+   enum class FrontEnd : uint8_t
+   {
+      CursorVisitor, // walk the full AST of every translation unit with clang_visitChildren
+      IndexAction,   // use clang_indexSourceFile and index every header only once per session
+   };
+
+   explicit ParsingSession(Profile profile = Profile::Interactive, FrontEnd frontEnd = FrontEnd::CursorVisitor);
+   ~ParsingSession() noexcept;
+
+   ParsingSession(const ParsingSession& other) = delete;
+   ParsingSession(ParsingSession&& other)      = delete;
+   ParsingSession& operator=(const ParsingSession& other) = delete;
+   ParsingSession& operator=(ParsingSession&& other) = delete;
+
+   Profile getProfile() const noexcept
+   {
+      return m_profile;
+   }
+
+   FrontEnd getFrontEnd() const noexcept
+   {
+      return m_frontEnd;
+   }
+
+   unsigned getParsingOptions() const noexcept;
+
+   /** Declarations-only mode skips function bodies and keeps only declaration and definition records;
+    * the translation units parsed this way are marked as partial. An incomplete parse additionally
+    * skips the end-of-file semantic analysis, such as pending template instantiations.
+    */
+   void setDeclarationsOnly(bool declarationsOnly, bool incomplete = false) noexcept
+   {
+      if (declarationsOnly != m_declarationsOnly)
+      {
+         // the header spans shared so far were collected in the other mode
+         restartIndexAction();
+      }
+
+      m_declarationsOnly = declarationsOnly;
+      m_incomplete       = declarationsOnly && incomplete;
+   }
+
+   bool isDeclarationsOnly() const noexcept
+   {
+      return m_declarationsOnly;
+   }
+
+   // the CXIndex shared by all translation units parsed in this session
+   void* getIndex() const noexcept
+   {
+      return m_index;
+   }
+
+   /*
+    * Index action front end; the headers seen by the session are remembered together with the
+    * record spans they produced, and these spans are only valid in the span manager they were
+    * added to. Switching to a different span manager restarts the session.
+    */
+   void* getIndexAction(const RecordSpanManager& recordSpanManager);
+
+   void restartIndexAction() noexcept;
+
+   const std::vector<RecordSpan::Store::Key>* getIndexedHeaderSpans(ftags::util::StringTable::Key fileNameKey) const;
+
+   void addIndexedHeaderSpan(ftags::util::StringTable::Key fileNameKey, RecordSpan::Store::Key recordSpanKey)
+   {
+      m_indexedHeaders[fileNameKey].push_back(recordSpanKey);
+   }
+
+   /*
+    * Translation units kept alive for reparsing, such as the files open in an editor. Only the most
+    * recently used ones are kept; a translation unit parsed with different arguments is discarded.
+    */
+   void* getRetainedTranslationUnit(const std::string& fileName, const std::vector<const char*>& arguments);
+
+   void retainTranslationUnit(const std::string&              fileName,
+                              const std::vector<const char*>& arguments,
+                              void*                           translationUnit);
+
+   void disposeRetainedTranslationUnit(const std::string& fileName) noexcept;
+
+private:
+   Profile  m_profile;
+   FrontEnd m_frontEnd;
+   void*    m_index;
+
+   bool m_declarationsOnly = false;
+   bool m_incomplete       = false;
+
+   void*                    m_indexAction              = nullptr;
+   const RecordSpanManager* m_indexedRecordSpanManager = nullptr;
+
+   std::unordered_map<ftags::util::StringTable::Key, std::vector<RecordSpan::Store::Key>> m_indexedHeaders;
+
+   struct RetainedTranslationUnit
+   {
+      std::string              fileName;
+      std::vector<std::string> arguments;
+      void*                    translationUnit;
+   };
+
+   static constexpr std::size_t k_maxRetainedTranslationUnits = 8;
+
+   // most recently used last
+   std::vector<RetainedTranslationUnit> m_retainedTranslationUnits;
+};
+
 using KeyMap = ftags::util::FlatMap<ftags::util::StringTable::Key, ftags::util::StringTable::Key>;
 
 class CursorSet
@@ -127,7 +252,10 @@ public:
    /*
     * Construction and maintenance
     */
-   ProjectDb(std::string_view name, std::string_view rootDirectory) : m_name{name}, m_root{rootDirectory}
+   ProjectDb(std::string_view name, std::string_view rootDirectory) :
+      m_name{name},
+      m_root{rootDirectory},
+      m_rootPrefix{makeRootPrefix(rootDirectory)}
    {
    }
 
@@ -137,12 +265,15 @@ public:
    ProjectDb(ProjectDb&& other) noexcept :
       m_name{std::move(other.m_name)},
       m_root{std::move(other.m_root)},
+      m_rootPrefix{std::move(other.m_rootPrefix)},
       m_translationUnits{std::move(other.m_translationUnits)},
       m_symbolTable{std::move(other.m_symbolTable)},
       m_namespaceTable{std::move(other.m_namespaceTable)},
       m_fileNameTable{std::move(other.m_fileNameTable)},
       m_recordSpanManager{std::move(other.m_recordSpanManager)},
-      m_fileIndex{std::move(other.m_fileIndex)}
+      m_fileIndex{std::move(other.m_fileIndex)},
+      m_parsingStatistics{other.m_parsingStatistics},
+      m_keyDictionaryVersion{other.m_keyDictionaryVersion}
    {
    }
 
@@ -152,12 +283,16 @@ public:
 
       m_name              = std::move(other.m_name);
       m_root              = std::move(other.m_root);
+      m_rootPrefix        = std::move(other.m_rootPrefix);
       m_translationUnits  = std::move(other.m_translationUnits);
       m_symbolTable       = std::move(other.m_symbolTable);
       m_namespaceTable    = std::move(other.m_namespaceTable);
       m_fileNameTable     = std::move(other.m_fileNameTable);
       m_recordSpanManager = std::move(other.m_recordSpanManager);
       m_fileIndex         = std::move(other.m_fileIndex);
+      m_parsingStatistics = other.m_parsingStatistics;
+
+      m_keyDictionaryVersion = other.m_keyDictionaryVersion;
 
       return *this;
    }
@@ -197,6 +332,58 @@ public:
 
    bool isFileIndexed(const std::string& fileName) const;
 
+   const ParsingStatistics& getParsingStatistics() const noexcept
+   {
+      return m_parsingStatistics;
+   }
+
+   // accounts for translation units parsed elsewhere, such as in an indexer
+   void addParsingStatistics(const ParsingStatistics& parsingStatistics) noexcept
+   {
+      m_parsingStatistics += parsingStatistics;
+   }
+
+   // content hashes of the files read while checking fingerprints, by file name
+   using FileHashCache = std::unordered_map<std::string, uint64_t>;
+
+   /** Returns true if the translation unit was indexed with the same arguments, from sources which are
+    * unchanged on disk; such a translation unit does not need to be parsed again.
+    */
+   bool isTranslationUnitCurrent(const std::string&              fileName,
+                                 const std::vector<const char*>& arguments,
+                                 FileHashCache&                  fileHashCache) const;
+
+   // what a translation unit was indexed from; the fingerprint is zero if it cannot be checked
+   struct TranslationUnitFingerprint
+   {
+      uint64_t                 fingerprint = 0;
+      std::vector<std::string> dependencies;
+   };
+
+   TranslationUnitFingerprint getTranslationUnitFingerprint(const std::string& fileName) const;
+
+   /** Returns true if the files the translation unit was indexed from are unchanged on disk; reads only
+    * the files, so the database does not need to be locked while they are hashed.
+    */
+   static bool isFingerprintCurrent(const TranslationUnitFingerprint& translationUnitFingerprint,
+                                    const std::vector<const char*>&   arguments,
+                                    FileHashCache&                    fileHashCache);
+
+   // time it took to index the translation unit last time; zero if it was not indexed yet
+   uint64_t getTranslationUnitParseNanoseconds(const std::string& fileName) const;
+
+   /** Returns the smallest hash of the names of the project headers the translation unit included
+    * when it was indexed (a min-hash), or zero if it is not known. The chance that two translation
+    * units have the same signature is the fraction of their project headers which they share.
+    */
+   uint64_t getTranslationUnitIncludeSignature(const std::string& fileName) const;
+
+   /** Returns the names of the translation units which read any of the files when they were last
+    * indexed, including those whose source is one of the files. The names are compared after
+    * removing the "." and ".." components.
+    */
+   std::vector<std::string> findDependentTranslationUnits(const std::vector<std::string>& fileNames) const;
+
    /*
     * Specific queries
     */
@@ -216,6 +403,45 @@ public:
 
    std::vector<const Record*> findSymbol(const std::string& symbolName, ftags::SymbolType symbolType) const;
 
+   enum class SymbolQualifier : uint8_t
+   {
+      Any,
+      Declaration, // declared but not defined there
+      Definition,
+      Reference,
+      Instantiation,
+      Destruction,
+   };
+
+   /*
+    * Selects the records which have any of the symbol types, or any type if there are none, and the
+    * qualifier; it is evaluated while the record spans are scanned, so only the selection is copied.
+    *
+    * With a limit, the results are a page: the scan skips the first offset records selected and stops
+    * once it has the limit, so the pages come in the order of the scan, each page sorted. The pages
+    * are consistent only while the project does not change.
+    */
+   struct SymbolQuery
+   {
+      std::vector<SymbolType> symbolTypes;
+      SymbolQualifier         symbolQualifier = SymbolQualifier::Any;
+
+      std::size_t offset = 0;
+      std::size_t limit  = 0; // no limit
+
+      bool selects(const Record* record) const;
+   };
+
+   // hasMoreResults tells whether there are results past the page
+   std::vector<const Record*>
+   findSymbol(const std::string& symbolName, const SymbolQuery& symbolQuery, bool& hasMoreResults) const;
+
+   std::vector<const Record*> findSymbol(const std::string& symbolName, const SymbolQuery& symbolQuery) const
+   {
+      bool hasMoreResults = false;
+      return findSymbol(symbolName, symbolQuery, hasMoreResults);
+   }
+
    std::vector<const Record*> findWhereUsed(Record* record) const;
 
    std::vector<const Record*> findOverloadDefinitions(Record* record) const;
@@ -244,10 +470,13 @@ public:
 
    /** Merge the tags from other database into this one
     * @param other is the other database
+    * @param betweenSlices is called after each translation unit is merged, while this database is
+    *        consistent, so that the caller can let readers in before the merge goes on
     */
-   void mergeFrom(const ProjectDb& other);
+   void mergeFrom(const ProjectDb& other, const std::function<void()>& betweenSlices = {});
 
-   void updateFrom(const std::string& fileName, const ProjectDb& other);
+   void
+   updateFrom(const std::string& fileName, const ProjectDb& other, const std::function<void()>& betweenSlices = {});
 
    /*
     * Debugging
@@ -295,6 +524,97 @@ public:
 
    static ftags::ProjectDb deserialize(ftags::util::TypedExtractor& extractor);
 
+   /*
+    * Streaming interface: translation units are sent one at a time, each together with the strings it
+    * uses which were not sent before on the same stream (a delta string table). The encoder and the
+    * decoder keep the state of the two ends of a stream; deltas are added in the order they were made.
+    *
+    * The record spans which the receiver is known to have are sent as references to the hash of their
+    * contents. The receiver holds a reference to every span it was offered or sent on the stream, so
+    * they remain available to the later deltas until the stream is released.
+    */
+   struct StreamEncoder
+   {
+      std::unordered_set<ftags::util::StringTable::Key> sentSymbolKeys;
+      std::unordered_set<ftags::util::StringTable::Key> sentFileNameKeys;
+
+      // content hashes of the spans the receiver has
+      std::unordered_set<uint64_t> knownRecordSpans;
+
+      // when bound to a key dictionary, the records are sent with the receiver's keys (see bindReceiverKeys)
+      uint64_t receiverKeysVersion = 0;
+
+      std::unordered_map<ftags::util::StringTable::Key, ftags::util::StringTable::Key> receiverSymbolKeys;
+      std::unordered_map<ftags::util::StringTable::Key, ftags::util::StringTable::Key> receiverFileNameKeys;
+   };
+
+   struct StreamDecoder
+   {
+      // from the keys of the sender to the keys of the receiver
+      std::unordered_map<ftags::util::StringTable::Key, ftags::util::StringTable::Key> symbolKeys;
+      std::unordered_map<ftags::util::StringTable::Key, ftags::util::StringTable::Key> fileNameKeys;
+
+      std::unordered_set<RecordSpan::Store::Key> pinnedRecordSpans;
+
+      // the version of the receiver's key dictionary; deltas made with other keys are rejected
+      uint64_t keyDictionaryVersion = 0;
+   };
+
+   /*
+    * A sender's copy of some of the receiver's symbol and file name keys, kept across streams. The
+    * receiver's string tables only grow, so a key stays valid for as long as the version, which
+    * identifies the tables, is the same; the copy is refreshed with the strings it misses.
+    */
+   struct KeyDictionary
+   {
+      uint64_t version = 0;
+
+      std::unordered_map<std::string, ftags::util::StringTable::Key> symbolKeys;
+      std::unordered_map<std::string, ftags::util::StringTable::Key> fileNameKeys;
+   };
+
+   // returns an empty buffer if the file is not indexed
+   std::vector<std::byte> serializeTranslationUnitDelta(const std::string& fileName, StreamEncoder& encoder) const;
+
+   /** Adds a translation unit made by serializeTranslationUnitDelta, replacing the previous version of it;
+    * throws if the delta uses strings or record spans which were not sent on the stream.
+    */
+   void addTranslationUnitDelta(ftags::util::TypedExtractor& extractor, StreamDecoder& decoder);
+
+   // the content hashes of all the record spans, to offer them to a receiver
+   std::vector<uint64_t> getRecordSpanContentHashes() const;
+
+   /** Returns the offered spans which are not in this database; the others are held by the stream, for
+    * the deltas which refer to them.
+    */
+   std::vector<uint64_t> findMissingRecordSpans(const std::vector<uint64_t>& contentHashes, StreamDecoder& decoder);
+
+   // drops the stream's references to the record spans
+   void releaseStream(StreamDecoder& decoder);
+
+   /** Collects the strings which the deltas of the translation units would send and for which the
+    * dictionary has no key.
+    */
+   void findUnresolvedStrings(const std::vector<std::string>& fileNames,
+                              const StreamEncoder&            encoder,
+                              const KeyDictionary&            dictionary,
+                              std::vector<std::string>&       symbolNames,
+                              std::vector<std::string>&       fileNamesToResolve) const;
+
+   /** Makes the encoder send the records with the receiver's keys from the dictionary, and no strings;
+    * the dictionary must have all the strings the deltas use.
+    */
+   void bindReceiverKeys(const KeyDictionary& dictionary, StreamEncoder& encoder) const;
+
+   uint64_t getKeyDictionaryVersion() const noexcept
+   {
+      return m_keyDictionaryVersion;
+   }
+
+   // the keys of the strings, which are added if needed; for a sender's key dictionary
+   std::vector<ftags::util::StringTable::Key> resolveSymbolKeys(const std::vector<std::string>& symbolNames);
+   std::vector<ftags::util::StringTable::Key> resolveFileNameKeys(const std::vector<std::string>& fileNames);
+
    /** Contains all the symbols in a C++ translation unit.
     */
    class TranslationUnit
@@ -317,13 +637,23 @@ public:
       }
 
       TranslationUnit(const TranslationUnit& other) noexcept :
-         m_fileNameKey{other.m_fileNameKey}, m_recordSpans{other.m_recordSpans}
+         m_fileNameKey{other.m_fileNameKey},
+         m_isPartial{other.m_isPartial},
+         m_fingerprint{other.m_fingerprint},
+         m_parseNanoseconds{other.m_parseNanoseconds},
+         m_dependencies{other.m_dependencies},
+         m_recordSpans{other.m_recordSpans}
       {
          assert(other.m_currentSpan.empty());
       }
 
       TranslationUnit(TranslationUnit&& other) noexcept :
-         m_fileNameKey{other.m_fileNameKey}, m_recordSpans{std::move(other.m_recordSpans)}
+         m_fileNameKey{other.m_fileNameKey},
+         m_isPartial{other.m_isPartial},
+         m_fingerprint{other.m_fingerprint},
+         m_parseNanoseconds{other.m_parseNanoseconds},
+         m_dependencies{std::move(other.m_dependencies)},
+         m_recordSpans{std::move(other.m_recordSpans)}
       {
          assert(other.m_currentSpan.empty());
       }
@@ -332,8 +662,12 @@ public:
       {
          if (this != &other)
          {
-            m_fileNameKey = other.m_fileNameKey;
-            m_recordSpans = other.m_recordSpans;
+            m_fileNameKey      = other.m_fileNameKey;
+            m_isPartial        = other.m_isPartial;
+            m_fingerprint      = other.m_fingerprint;
+            m_parseNanoseconds = other.m_parseNanoseconds;
+            m_dependencies     = other.m_dependencies;
+            m_recordSpans      = other.m_recordSpans;
 
             assert(other.m_currentSpan.empty());
          }
@@ -345,8 +679,12 @@ public:
       {
          if (this != &other)
          {
-            m_fileNameKey = other.m_fileNameKey;
-            m_recordSpans = std::move(other.m_recordSpans);
+            m_fileNameKey      = other.m_fileNameKey;
+            m_isPartial        = other.m_isPartial;
+            m_fingerprint      = other.m_fingerprint;
+            m_parseNanoseconds = other.m_parseNanoseconds;
+            m_dependencies     = std::move(other.m_dependencies);
+            m_recordSpans      = std::move(other.m_recordSpans);
 
             assert(other.m_currentSpan.empty());
          }
@@ -369,6 +707,60 @@ public:
          return m_fileNameKey;
       }
 
+      /** A partial translation unit only contains the declarations and definitions; it is
+       * replaced when the complete translation unit is indexed.
+       */
+      bool isPartial() const noexcept
+      {
+         return m_isPartial;
+      }
+
+      void setPartial(bool isPartial) noexcept
+      {
+         m_isPartial = isPartial;
+      }
+
+      /** Hash of the compilation arguments and of the contents of the main file and of all the files
+       * it includes; zero if the translation unit was not parsed from the files on disk.
+       */
+      uint64_t getFingerprint() const noexcept
+      {
+         return m_fingerprint;
+      }
+
+      // keys of the file names of the main file and of all the files it includes
+      const std::vector<Key>& getDependencies() const noexcept
+      {
+         return m_dependencies;
+      }
+
+      void setFingerprint(uint64_t fingerprint, std::vector<Key>&& dependencies) noexcept
+      {
+         m_fingerprint  = fingerprint;
+         m_dependencies = std::move(dependencies);
+      }
+
+      const std::vector<RecordSpan::Store::Key>& getRecordSpans() const noexcept
+      {
+         return m_recordSpans;
+      }
+
+      // time spent parsing and visiting the translation unit when it was indexed; zero if not known
+      uint64_t getParseNanoseconds() const noexcept
+      {
+         return m_parseNanoseconds;
+      }
+
+      static uint64_t computeFingerprint(const std::vector<const char*>& arguments,
+                                         const std::vector<uint64_t>&    dependencyHashes);
+
+      static uint64_t hashContents(const char* contents, std::size_t size);
+
+      // returns zero if the file cannot be read
+      static uint64_t hashFile(const std::string& fileName);
+
+      void releaseRecordSpans(RecordSpanManager& recordSpanManager);
+
       /*
        * Statistics
        */
@@ -424,17 +816,23 @@ public:
          ftags::util::StringTable& fileNameTable;
          RecordSpanManager&        recordSpanManager;
          const std::string&        filterPath;
+         ParsingSession&           parsingSession;
+         ParsingStatistics&        statistics;
 
          ParsingContext(ftags::util::StringTable& symbolTable_,
                         ftags::util::StringTable& namespaceTable_,
                         ftags::util::StringTable& fileNameTable_,
                         RecordSpanManager&        recordSpanManager_,
-                        const std::string&        filterPath_) :
+                        const std::string&        filterPath_,
+                        ParsingSession&           parsingSession_,
+                        ParsingStatistics&        statistics_) :
             symbolTable{symbolTable_},
             namespaceTable{namespaceTable_},
             fileNameTable{fileNameTable_},
             recordSpanManager{recordSpanManager_},
-            filterPath{filterPath_}
+            filterPath{filterPath_},
+            parsingSession{parsingSession_},
+            statistics{statistics_}
          {
          }
       };
@@ -442,12 +840,26 @@ public:
       static TranslationUnit
       parse(const std::string& fileName, const std::vector<const char*>& arguments, ParsingContext& parsingContext);
 
+      /** Parses the file using the given contents instead of the saved ones; the clang translation unit
+       * is retained by the parsing session, so subsequent calls for the same file only reparse it.
+       */
+      static TranslationUnit reparse(const std::string&              fileName,
+                                     const std::vector<const char*>& arguments,
+                                     std::string_view                contents,
+                                     ParsingContext&                 parsingContext);
+
       void addCursor(const Cursor&                 cursor,
                      ftags::util::StringTable::Key symbolNameKey,
                      ftags::util::StringTable::Key fileNameKey,
                      ftags::util::StringTable::Key referencedFileNameKey,
                      ftags::RecordSpanManager&     recordSpanManager);
 
+      /** Adds references to spans already in the span manager, such as those of a header indexed
+       * by a previous translation unit.
+       */
+      void addRecordSpans(const std::vector<RecordSpan::Store::Key>& recordSpanKeys,
+                          ftags::RecordSpanManager&                  recordSpanManager);
+
       /*
        * Query helper
        */
@@ -526,10 +938,44 @@ public:
 
       static TranslationUnit deserialize(ftags::util::TypedExtractor& extractor);
 
+      /*
+       * Streaming interface; the records of the spans are sent instead of the span keys, except for the
+       * spans with a non-zero content hash in referencedSpans, which are sent as that hash. The keys are
+       * translated to the receiver's when the encoder is bound to a key dictionary.
+       */
+      std::size_t computeStreamedSize(const RecordSpanManager&     recordSpanManager,
+                                      const std::vector<uint64_t>& referencedSpans) const;
+
+      void serializeStreamed(ftags::util::TypedInsertor&  insertor,
+                             const RecordSpanManager&     recordSpanManager,
+                             const std::vector<uint64_t>& referencedSpans,
+                             const StreamEncoder&         encoder) const;
+
+      static TranslationUnit deserializeStreamed(ftags::util::TypedExtractor& extractor,
+                                                 const StreamDecoder&         decoder,
+                                                 RecordSpanManager&           recordSpanManager);
+
    private:
       // key of the file name of the main translation unit
       Key m_fileNameKey = 0;
 
+      bool m_isPartial = false;
+
+      uint64_t m_fingerprint = 0;
+
+      uint64_t m_parseNanoseconds = 0;
+
+      std::vector<Key> m_dependencies;
+
+      /*
+       * version 2 adds a flags word after the file name key; version 3 adds the fingerprint and dependencies;
+       * version 4 adds the parse time after the fingerprint
+       */
+      static constexpr uint64_t k_serializationVersion = 4;
+      static constexpr uint64_t k_partialFlag          = 1;
+
+      static constexpr std::array<uint64_t, 2> k_fingerprintSeed = {0x3c6ef372fe94f82b, 0xa54ff53a5f1d36f1};
+
       // persistent data
       std::vector<RecordSpan::Store::Key> m_recordSpans;
 
@@ -539,8 +985,10 @@ public:
 
       struct SymbolAtLocation
       {
-         ftags::util::StringTable::Key symbolKey;
-         Record::Location              location;
+         ftags::util::StringTable::Key symbolKey = 0;
+         Record::Location              location  = {};
+
+         SymbolAtLocation() = default;
 
          SymbolAtLocation(ftags::util::StringTable::Key symbolKey_,
                           ftags::util::StringTable::Key fileKey,
@@ -555,27 +1003,31 @@ public:
             return (symbolKey == other.symbolKey) && (location == other.location);
          }
 
-         bool operator<(const SymbolAtLocation& other) const
+         struct Hash
          {
-            if (symbolKey < other.symbolKey)
-            {
-               return true;
-            }
-            if (symbolKey == other.symbolKey)
+            std::size_t operator()(const SymbolAtLocation& symbolAtLocation) const noexcept
             {
-               if (location < other.location)
-               {
-                  return true;
-               }
+               const uint64_t position = (uint64_t{symbolAtLocation.location.fileNameKey} << 32U) |
+                                         (uint64_t{symbolAtLocation.location.line} << 12U) |
+                                         uint64_t{symbolAtLocation.location.column};
+
+               uint64_t hash = (uint64_t{symbolAtLocation.symbolKey} * 0x9E3779B97F4A7C15ULL) ^ position;
+               hash *= 0xC2B2AE3D27D4EB4FULL;
+               return static_cast<std::size_t>(hash ^ (hash >> 29U));
             }
-            return false;
-         }
+         };
       };
 
-      std::set<SymbolAtLocation> m_currentSpanLocations;
-      void                       flushCurrentSpan(RecordSpanManager& recordSpanManager);
+      // locations of the records in the current span; reused across spans
+      ftags::util::HashSet<SymbolAtLocation, SymbolAtLocation::Hash> m_currentSpanLocations;
+
+      // only set while parsing
+      ParsingStatistics* m_parsingStatistics = nullptr;
+
+      void canonicalizeCurrentSpan();
+      void flushCurrentSpan(RecordSpanManager& recordSpanManager);
 
-      void beginParsingUnit(ftags::util::StringTable::Key fileNameKey);
+      void beginParsingUnit(ftags::util::StringTable::Key fileNameKey, ParsingStatistics* parsingStatistics);
       void finalizeParsingUnit(RecordSpanManager& recordSpanManager);
    };
 
@@ -583,6 +1035,19 @@ public:
                                        const std::vector<const char*>& arguments,
                                        bool                            includeEverything = true);
 
+   const TranslationUnit& parseOneFile(ParsingSession&                 parsingSession,
+                                       const std::string&              fileName,
+                                       const std::vector<const char*>& arguments,
+                                       bool                            includeEverything = true);
+
+   /** Re-indexes one file from unsaved contents, such as an editor buffer, replacing its translation unit.
+    */
+   const TranslationUnit& reparseOneFile(ParsingSession&                 parsingSession,
+                                         const std::string&              fileName,
+                                         const std::vector<const char*>& arguments,
+                                         std::string_view                contents,
+                                         bool                            includeEverything = true);
+
    std::vector<const Record*> getTranslationUnitRecords(const TranslationUnit& translationUnit,
                                                         bool                   isFromMainFile) const
    {
@@ -596,6 +1061,27 @@ private:
 
    void updateIndices();
 
+   // stores a newly parsed translation unit, replacing the previous one for the same file
+   const TranslationUnit& storeTranslationUnit(TranslationUnit&& translationUnit);
+
+   // drops the translation unit's references to its record spans and destroys it
+   void releaseTranslationUnit(uint32_t translationUnitKey);
+
+   // hashes the records with the strings instead of the keys, so other databases get the same hash
+   uint64_t computeContentHash(const RecordSpan& recordSpan) const;
+
+   /** Finds the spans of the translation unit which a delta sends as references, and the strings used
+    * by the translation unit and by the spans it sends in full.
+    */
+   void collectDeltaContents(const TranslationUnit&                      translationUnit,
+                             const StreamEncoder&                        encoder,
+                             std::vector<uint64_t>&                      referencedSpans,
+                             std::vector<uint64_t>&                      sentSpans,
+                             std::vector<ftags::util::StringTable::Key>& symbolKeys,
+                             std::vector<ftags::util::StringTable::Key>& fileNameKeys) const;
+
+   static constexpr uint64_t k_contentHashSeed = 0x9b05688c2b3e6c1f;
+
    template <typename F>
    std::vector<const Record*> filterRecordsWithSymbol(const std::string& symbolName, F selectRecord) const
    {
@@ -640,9 +1126,19 @@ private:
       return results;
    }
 
+   // returns nullptr if the translation unit is not indexed
+   const TranslationUnit* lookupTranslationUnit(const std::string& fileName) const;
+
+   static constexpr uint64_t k_includeSignatureSeed = 0x510e527fade682d1;
+
    std::string m_name;
    std::string m_root;
 
+   // the canonical name of the root directory followed by a separator, as the dependencies are named
+   std::string m_rootPrefix;
+
+   static std::string makeRootPrefix(std::string_view rootDirectory);
+
    static constexpr uint32_t k_translationUnitStoreSegmentSize = 12; // 4096 translation units per segment
 
    using TranslationUnitStore = ftags::util::Store<TranslationUnit, uint32_t, k_translationUnitStoreSegmentSize>;
@@ -657,6 +1153,14 @@ private:
    /** Maps from a file name key to a position in the translation units vector.
     */
    std::map<ftags::util::StringTable::Key, TranslationUnitStore::Key> m_fileIndex;
+
+   // not persistent; accumulated while parsing and merging
+   ParsingStatistics m_parsingStatistics;
+
+   static uint64_t makeKeyDictionaryVersion();
+
+   // not persistent; identifies the string tables to the senders which use their keys
+   uint64_t m_keyDictionaryVersion = makeKeyDictionaryVersion();
 };
 
 void parseProject(const char* parentDirectory, ftags::ProjectDb& projectDb);
@@ -24,6 +24,16 @@
 const ftags::ProjectDb::TranslationUnit& ftags::ProjectDb::parseOneFile(const std::string&              fileName,
                                                                         const std::vector<const char*>& arguments,
                                                                         bool includeEverything)
+{
+   ParsingSession parsingSession{ParsingSession::Profile::Interactive};
+
+   return parseOneFile(parsingSession, fileName, arguments, includeEverything);
+}
+
+const ftags::ProjectDb::TranslationUnit& ftags::ProjectDb::parseOneFile(ParsingSession&                 parsingSession,
+                                                                        const std::string&              fileName,
+                                                                        const std::vector<const char*>& arguments,
+                                                                        bool includeEverything)
 {
    try
    {
@@ -33,8 +43,13 @@ const ftags::ProjectDb::TranslationUnit& ftags::ProjectDb::parseOneFile(const st
          filterPath = m_root;
       }
 
-      TranslationUnit::ParsingContext parsingContext{
-         m_symbolTable, m_namespaceTable, m_fileNameTable, m_recordSpanManager, filterPath};
+      TranslationUnit::ParsingContext parsingContext{m_symbolTable,
+                                                     m_namespaceTable,
+                                                     m_fileNameTable,
+                                                     m_recordSpanManager,
+                                                     filterPath,
+                                                     parsingSession,
+                                                     m_parsingStatistics};
 
       ftags::ProjectDb::TranslationUnit translationUnit =
          ftags::ProjectDb::TranslationUnit::parse(fileName, arguments, parsingContext);
@@ -44,13 +59,7 @@ const ftags::ProjectDb::TranslationUnit& ftags::ProjectDb::parseOneFile(const st
                     fileName,
                     translationUnit.getRecords(true, m_recordSpanManager).size());
 
-      auto       alloc   = m_translationUnits.construct();
-      const auto fileKey = translationUnit.getFileNameKey();
-      *alloc.iterator    = std::move(translationUnit);
-
-      m_fileIndex[fileKey] = alloc.key;
-
-      return *alloc.iterator;
+      return storeTranslationUnit(std::move(translationUnit));
    }
    catch (const std::runtime_error& re)
    {
@@ -58,3 +67,50 @@ const ftags::ProjectDb::TranslationUnit& ftags::ProjectDb::parseOneFile(const st
       throw re;
    }
 }
+
+const ftags::ProjectDb::TranslationUnit& ftags::ProjectDb::reparseOneFile(ParsingSession&                 parsingSession,
+                                                                          const std::string&              fileName,
+                                                                          const std::vector<const char*>& arguments,
+                                                                          std::string_view                contents,
+                                                                          bool includeEverything)
+{
+   std::string filterPath;
+   if (!includeEverything)
+   {
+      filterPath = m_root;
+   }
+
+   TranslationUnit::ParsingContext parsingContext{m_symbolTable,
+                                                  m_namespaceTable,
+                                                  m_fileNameTable,
+                                                  m_recordSpanManager,
+                                                  filterPath,
+                                                  parsingSession,
+                                                  m_parsingStatistics};
+
+   ftags::ProjectDb::TranslationUnit translationUnit =
+      ftags::ProjectDb::TranslationUnit::reparse(fileName, arguments, contents, parsingContext);
+
+   spdlog::debug(
+      "Reloaded {:n} records from unsaved {}", translationUnit.getRecordCount(m_recordSpanManager), fileName);
+
+   return storeTranslationUnit(std::move(translationUnit));
+}
+
+const ftags::ProjectDb::TranslationUnit& ftags::ProjectDb::storeTranslationUnit(TranslationUnit&& translationUnit)
+{
+   const auto fileKey = translationUnit.getFileNameKey();
+
+   const auto existing = m_fileIndex.find(fileKey);
+   if (existing != m_fileIndex.end())
+   {
+      releaseTranslationUnit(existing->second);
+   }
+
+   auto alloc      = m_translationUnits.construct();
+   *alloc.iterator = std::move(translationUnit);
+
+   m_fileIndex[fileKey] = alloc.key;
+
+   return *alloc.iterator;
+}
@@ -152,9 +152,12 @@ struct Attributes // NOLINT
 
    uint32_t isNamespaceRef : 1;
 
+   // a namespace qualifier was folded into this record
+   uint32_t isQualified : 1;
+
    uint32_t level : 8;
 
-   uint32_t freeBits : 20;
+   uint32_t freeBits : 19;
 
    void setType(enum SymbolType type_)
    {
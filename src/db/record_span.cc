@@ -81,6 +81,21 @@ void ftags::RecordSpan::updateIndices(SymbolIndexStore& symbolIndexStore)
    std::sort(recordsInSymbolKeyOrderBegin, recordsInSymbolKeyOrderEnd, OrderRecordsBySymbolKey(m_records));
 }
 
+void ftags::RecordSpan::releaseRecords(Record::Store& recordStore, SymbolIndexStore& symbolIndexStore)
+{
+   if (m_symbolIndexKey != 0)
+   {
+      symbolIndexStore.deallocate(m_symbolIndexKey, m_size);
+      m_symbolIndexKey = 0;
+   }
+
+   recordStore.deallocate(m_key, m_size);
+
+   m_key     = 0;
+   m_size    = 0;
+   m_records = nullptr;
+}
+
 void ftags::RecordSpan::copyRecordsFrom(const RecordSpan& other, SymbolIndexStore& symbolIndexStore)
 {
    assert(m_size == other.m_size);
@@ -195,6 +195,10 @@ public:
 
    void restoreRecordPointer(Record::Store& recordStore);
 
+   /** Returns the records and their symbol index to the stores they were allocated from.
+    */
+   void releaseRecords(Record::Store& recordStore, SymbolIndexStore& symbolIndexStore);
+
    void updateIndices(SymbolIndexStore& symbolIndexStore);
 
    void assertValid() const
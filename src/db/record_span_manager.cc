@@ -52,6 +52,67 @@ ftags::RecordSpanManager::Key ftags::RecordSpanManager::addSpan(const std::vecto
    return newSpanKey;
 }
 
+void ftags::RecordSpanManager::releaseSpan(Key key)
+{
+   RecordSpan& recordSpan = getSpan(key);
+
+   if (recordSpan.release() != 0)
+   {
+      return;
+   }
+
+   const auto eraseMapping = [key](auto& multimap, auto mapKey) {
+      auto [beginRange, endRange] = multimap.equal_range(mapKey);
+      for (auto iter = beginRange; iter != endRange; ++iter)
+      {
+         if (iter->second == key)
+         {
+            multimap.erase(iter);
+            break;
+         }
+      }
+   };
+
+   eraseMapping(m_cache, recordSpan.getHash());
+
+   std::set<ftags::util::StringTable::Key> symbolKeys;
+   recordSpan.forEachRecord([&symbolKeys](const Record* record) { symbolKeys.insert(record->symbolNameKey); });
+   for (const auto symbolKey : symbolKeys)
+   {
+      eraseMapping(m_symbolIndex, symbolKey);
+   }
+
+   eraseMapping(m_fileIndex, recordSpan.getFileKey());
+
+   const auto contentHash = m_contentHashes.find(key);
+   if (contentHash != m_contentHashes.end())
+   {
+      m_contentIndex.erase(contentHash->second);
+      m_contentHashes.erase(contentHash);
+   }
+
+   recordSpan.releaseRecords(m_recordStore, m_symbolIndexStore);
+   m_recordSpanStore.destroy(key);
+}
+
+void ftags::RecordSpanManager::setContentHash(Key key, uint64_t contentHash)
+{
+   m_contentHashes[key]        = contentHash;
+   m_contentIndex[contentHash] = key;
+}
+
+uint64_t ftags::RecordSpanManager::getContentHash(Key key) const
+{
+   const auto iter = m_contentHashes.find(key);
+   return (iter == m_contentHashes.end()) ? 0 : iter->second;
+}
+
+ftags::RecordSpanManager::Key ftags::RecordSpanManager::findSpanByContentHash(uint64_t contentHash) const
+{
+   const auto iter = m_contentIndex.find(contentHash);
+   return (iter == m_contentIndex.end()) ? 0 : iter->second;
+}
+
 void ftags::RecordSpanManager::indexRecordSpan(const ftags::RecordSpan&      recordSpan,
                                                ftags::RecordSpan::Store::Key recordSpanKey)
 {
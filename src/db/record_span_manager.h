@@ -23,6 +23,7 @@
 #include <string_table.h>
 
 #include <map>
+#include <unordered_map>
 
 namespace ftags
 {
@@ -45,20 +46,26 @@ public:
 
    RecordSpanManager(RecordSpanManager&& other) noexcept :
       m_symbolIndex{std::move(other.m_symbolIndex)},
+      m_fileIndex{std::move(other.m_fileIndex)},
       m_recordSpanStore{std::move(other.m_recordSpanStore)},
       m_recordStore{std::move(other.m_recordStore)},
       m_cache{std::move(other.m_cache)},
-      m_symbolIndexStore{std::move(other.m_symbolIndexStore)}
+      m_symbolIndexStore{std::move(other.m_symbolIndexStore)},
+      m_contentIndex{std::move(other.m_contentIndex)},
+      m_contentHashes{std::move(other.m_contentHashes)}
    {
    }
 
    RecordSpanManager& operator=(RecordSpanManager&& other) noexcept
    {
       m_symbolIndex      = std::move(other.m_symbolIndex);
+      m_fileIndex        = std::move(other.m_fileIndex);
       m_recordSpanStore  = std::move(other.m_recordSpanStore);
       m_recordStore      = std::move(other.m_recordStore);
       m_cache            = std::move(other.m_cache);
       m_symbolIndexStore = std::move(other.m_symbolIndexStore);
+      m_contentIndex     = std::move(other.m_contentIndex);
+      m_contentHashes    = std::move(other.m_contentHashes);
 
       return *this;
    }
@@ -69,6 +76,21 @@ public:
 
    Key addSpan(const std::vector<Record>& records);
 
+   /** Drops one reference to the span; the span and its records are removed with the last reference.
+    */
+   void releaseSpan(Key key);
+
+   /** Spans may also be found by a hash of their contents which does not depend on the string keys,
+    * so it can be computed by another database; the hash is supplied by the owner of the string tables.
+    */
+   void setContentHash(Key key, uint64_t contentHash);
+
+   // zero if not set
+   uint64_t getContentHash(Key key) const;
+
+   // zero if there is no such span
+   Key findSpanByContentHash(uint64_t contentHash) const;
+
    const ftags::RecordSpan& getSpan(Key key) const
    {
       if (key == 0U)
@@ -150,6 +172,30 @@ public:
       return results;
    }
 
+   /*
+    * Calls func for the records with the symbol, in the order the spans were added, and stops after
+    * the span where isDone first returns true
+    */
+   template <typename F, typename G>
+   void forEachRecordWithSymbolUntil(ftags::util::StringTable::Key symbolKey, F func, G isDone) const
+   {
+      if (symbolKey)
+      {
+         const auto range = m_symbolIndex.equal_range(symbolKey);
+         for (auto iter = range.first; iter != range.second; ++iter)
+         {
+            const RecordSpan& recordSpan = getSpan(iter->second);
+
+            recordSpan.forEachRecordWithSymbol(symbolKey, func, m_symbolIndexStore);
+
+            if (isDone())
+            {
+               break;
+            }
+         }
+      }
+   }
+
    template <typename F>
    void forEachRecordWithSymbol(ftags::util::StringTable::Key symbolKey, F func) const
    {
@@ -246,6 +292,10 @@ private:
     */
    RecordSpan::SymbolIndexStore m_symbolIndexStore;
 
+   // the content hashes set on spans, in both directions
+   std::unordered_map<uint64_t, RecordSpan::Store::Key> m_contentIndex;
+   std::unordered_map<RecordSpan::Store::Key, uint64_t> m_contentHashes;
+
    void indexRecordSpan(const RecordSpan& recordSpan, RecordSpan::Store::Key key);
 
    std::set<ftags::util::StringTable::Key> getSymbolKeys() const;
@@ -25,21 +25,17 @@
 #include <iostream>
 #endif
 
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <memory>
 #include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace
 {
 
-struct CXIndexDestroyer
-{
-   void operator()(void* obj) const noexcept
-   {
-      clang_disposeIndex(obj);
-   }
-};
-
 struct CXTranslationUnitDestroyer
 {
    void operator()(CXTranslationUnit translationUnit) const noexcept
@@ -307,10 +303,40 @@ class TranslationUnitAccumulator
    ftags::util::StringTable&          m_symbolTable;
    ftags::util::StringTable&          m_fileNameTable;
    ftags::RecordSpanManager&          m_recordSpanManager;
+   ftags::ParsingStatistics&          m_statistics;
    std::string                        m_filterPath;
+   bool                               m_declarationsOnly;
+
+   int m_level = 0;
+
+   static constexpr uint32_t k_symbolTableSamplingInterval = 64;
+
+public:
+   struct FileInfo
+   {
+      ftags::util::StringTable::Key fileNameKey;
+      bool                          isIndexed;
+   };
+
+private:
+   // files seen in this translation unit, keyed by the libclang file identity
+   std::unordered_map<CXFile, FileInfo> m_fileCache;
+   FileInfo                             m_builtInFileInfo = {};
 
-   int                                                            m_level = 0;
-   std::unordered_map<std::string, ftags::util::StringTable::Key> m_fileKeyCache;
+   bool isIndexed(const char* fileName, CXSourceLocation location) const
+   {
+      if (m_filterPath.empty())
+      {
+         return true;
+      }
+
+      if (clang_Location_isInSystemHeader(location) != 0)
+      {
+         return false;
+      }
+
+      return strncmp(fileName, m_filterPath.data(), m_filterPath.size()) == 0;
+   }
 
 public:
    TranslationUnitAccumulator(ftags::ProjectDb::TranslationUnit&                translationUnit,
@@ -319,11 +345,57 @@ public:
       m_symbolTable{parsingContext.symbolTable},
       m_fileNameTable{parsingContext.fileNameTable},
       m_recordSpanManager{parsingContext.recordSpanManager},
-      m_filterPath{parsingContext.filterPath}
+      m_statistics{parsingContext.statistics},
+      m_filterPath{parsingContext.filterPath},
+      m_declarationsOnly{parsingContext.parsingSession.isDeclarationsOnly()}
    {
    }
 
-   void processCursor(CXCursor clangCursor);
+   /*
+    * Returns true if the children of the cursor can contain records to be indexed
+    */
+   bool processCursor(CXCursor clangCursor);
+
+   ftags::util::StringTable::Key resolveFileName(const char* fileName);
+
+   const FileInfo& getFileInfo(CXFile file, CXSourceLocation location)
+   {
+      if (file == nullptr)
+      {
+         // built-in macros and command line definitions
+         if (m_builtInFileInfo.fileNameKey == 0)
+         {
+            m_builtInFileInfo.fileNameKey = m_fileNameTable.addKey("<built-in>");
+            m_builtInFileInfo.isIndexed   = m_filterPath.empty();
+         }
+
+         return m_builtInFileInfo;
+      }
+
+      const auto iter = m_fileCache.find(file);
+      if (iter != m_fileCache.end())
+      {
+         return iter->second;
+      }
+
+      CXStringWrapper fileName{clang_getFileName(file)};
+      const FileInfo  fileInfo{resolveFileName(fileName.c_str()), isIndexed(fileName.c_str(), location)};
+
+      return m_fileCache.emplace(file, fileInfo).first->second;
+   }
+
+   // the key of the file's name as the records from the file use it
+   ftags::util::StringTable::Key getFileNameKey(CXFile file)
+   {
+      const auto iter = m_fileCache.find(file);
+      if (iter != m_fileCache.end())
+      {
+         return iter->second.fileNameKey;
+      }
+
+      CXStringWrapper fileName{clang_getFileName(file)};
+      return resolveFileName(fileName.c_str());
+   }
 
    bool getCursorLocation(CXCursor                       clangCursor,
                           ftags::Cursor::Location&       cursorLocation,
@@ -350,6 +422,33 @@ public:
    }
 };
 
+ftags::util::StringTable::Key TranslationUnitAccumulator::resolveFileName(const char* fileName)
+{
+   ftags::util::StringTable::Key fileNameKey = 0;
+
+   std::filesystem::path filePath{fileName};
+   if (std::filesystem::exists(filePath))
+   {
+      std::filesystem::path canonicalFilePath = std::filesystem::canonical(filePath);
+      fileNameKey                             = m_fileNameTable.addKey(canonicalFilePath.string());
+   }
+   else
+   {
+      std::filesystem::path otherPath = std::filesystem::current_path() / filePath;
+      if (std::filesystem::exists(otherPath))
+      {
+         std::filesystem::path canonicalFilePath = std::filesystem::canonical(otherPath);
+         fileNameKey                             = m_fileNameTable.addKey(canonicalFilePath.string().data());
+      }
+      else
+      {
+         assert(false);
+      }
+   }
+
+   return fileNameKey;
+}
+
 bool TranslationUnitAccumulator::getCursorLocation(CXCursor                       clangCursor,
                                                    ftags::Cursor::Location&       cursorLocation,
                                                    ftags::util::StringTable::Key* fileNameKey
@@ -359,119 +458,62 @@ bool TranslationUnitAccumulator::getCursorLocation(CXCursor
 #endif
 )
 {
-   CXStringWrapper fileNameWrapper;
+   CXFile file = nullptr;
 
    CXSourceLocation location = clang_getCursorLocation(clangCursor);
-   clang_getPresumedLocation(location, fileNameWrapper.get(), &cursorLocation.line, &cursorLocation.column);
+   clang_getExpansionLocation(location, &file, &cursorLocation.line, &cursorLocation.column, nullptr);
 
-   *fileNameKey = 0;
+   *fileNameKey = getFileInfo(file, location).fileNameKey;
 
 #ifdef DUMP_SKIPPED_CURSORS
-   fileName = fileNameWrapper.c_str();
-#else
-   std::string fileName{fileNameWrapper.c_str()};
-#endif
-   const auto iter = m_fileKeyCache.find(fileName);
-
-   if (iter != m_fileKeyCache.end())
-   {
-      *fileNameKey = iter->second;
-   }
-   else
-   {
-      std::filesystem::path filePath{fileName};
-      if (std::filesystem::exists(filePath))
-      {
-         std::filesystem::path canonicalFilePath = std::filesystem::canonical(filePath);
-         *fileNameKey                            = m_fileNameTable.addKey(canonicalFilePath.string());
-         const auto insertIter                   = m_fileKeyCache.emplace(std::move(fileName), *fileNameKey);
-#ifdef NDEBUG
-         (void)insertIter;
-#endif
-         assert(insertIter.second);
-      }
-      else
-      {
-         std::filesystem::path otherPath = std::filesystem::current_path() / filePath;
-         if (std::filesystem::exists(otherPath))
-         {
-            std::filesystem::path canonicalFilePath = std::filesystem::canonical(otherPath);
-            *fileNameKey                            = m_fileNameTable.addKey(canonicalFilePath.string().data());
-            const auto insertIter                   = m_fileKeyCache.emplace(std::move(fileName), *fileNameKey);
-#ifdef NDEBUG
-            (void)insertIter;
+   fileName = m_fileNameTable.getString(*fileNameKey);
 #endif
-            assert(insertIter.second);
-         }
-         else
-         {
-            if (fileName == "<built-in>")
-            {
-               *fileNameKey          = m_fileNameTable.addKey(fileName.data());
-               const auto insertIter = m_fileKeyCache.emplace(std::move(fileName), *fileNameKey);
-#ifdef NDEBUG
-               (void)insertIter;
-#endif
-               assert(insertIter.second);
-            }
-            else
-            {
-               assert(false);
-            }
-         }
-      }
-
-      cursorLocation.fileName = nullptr;
-   }
 
    assert(*fileNameKey);
 
    return (clang_Location_isFromMainFile(location) != 0);
 }
 
-void TranslationUnitAccumulator::processCursor(CXCursor clangCursor)
+bool TranslationUnitAccumulator::processCursor(CXCursor clangCursor)
 {
-   // check if the cursor is defined in a file below filterPath and if not, bail out early
-   if (!m_filterPath.empty())
-   {
-      CXStringWrapper fileName;
-
-      CXSourceLocation location = clang_getCursorLocation(clangCursor);
-      clang_getPresumedLocation(location, fileName.get(), nullptr, nullptr);
-
-      const std::size_t thisPathLength = strlen(fileName.c_str());
+   m_statistics.cursorsVisited++;
 
-      if (thisPathLength < m_filterPath.size())
+   if (m_declarationsOnly)
+   {
+      const CXCursorKind cursorKind = clang_getCursorKind(clangCursor);
+      if ((clang_isExpression(cursorKind) != 0) || (clang_isStatement(cursorKind) != 0))
       {
-         return;
+         // declarations below expressions and statements are local; don't descend
+         return false;
       }
 
-      if (memcmp(fileName.c_str(), m_filterPath.data(), m_filterPath.size()) != 0)
+      if ((clang_isDeclaration(cursorKind) == 0) && (cursorKind != CXCursor_MacroDefinition))
       {
-         return;
+         return true;
       }
    }
 
    ftags::Cursor cursor = {};
+
+   CXFile           file     = nullptr;
+   CXSourceLocation location = clang_getCursorLocation(clangCursor);
+   clang_getExpansionLocation(location, &file, &cursor.location.line, &cursor.location.column, nullptr);
+
+   // skip the cursor and everything below it if it is not in a file we are indexing
+   const FileInfo& fileInfo = getFileInfo(file, location);
+   if (!fileInfo.isIndexed)
+   {
+      return false;
+   }
+
    // get it early to aid debugging
    CXStringWrapper name{clang_getCursorSpelling(clangCursor)};
    cursor.symbolName = name.c_str();
 
    getSymbolType(clangCursor, &cursor.attributes);
 
-#ifdef DUMP_SKIPPED_CURSORS
-   std::string locationFileName;
-#endif
-   ftags::util::StringTable::Key fileNameKey = 0;
-   cursor.attributes.isFromMainFile          = getCursorLocation(clangCursor,
-                                                        cursor.location,
-                                                        &fileNameKey
-#ifdef DUMP_SKIPPED_CURSORS
-                                                        ,
-                                                        locationFileName
-#endif
-
-   );
+   const ftags::util::StringTable::Key fileNameKey = fileInfo.fileNameKey;
+   cursor.attributes.isFromMainFile                = (clang_Location_isFromMainFile(location) != 0);
    assert(fileNameKey != 0);
 
    if (cursor.attributes.getType() == ftags::SymbolType::Undefined)
@@ -483,24 +525,17 @@ void TranslationUnitAccumulator::processCursor(CXCursor clangCursor)
          std::cerr << fmt::format("@@ Unhandled symbol {} with code {} at {}:{}:{}",
                                   cursor.symbolName,
                                   cursorKind,
-                                  locationFileName,
+                                  m_fileNameTable.getString(fileNameKey),
                                   cursor.location.line,
                                   cursor.location.column)
                    << std::endl;
       }
 #endif
 
-      // don't know how to handle this cursor; just ignore it
-      return;
+      // don't know how to handle this cursor; just ignore it, but look at its children
+      return true;
    }
 
-#if 0
-   const CXSourceRange    sourceRange = clang_getCursorExtent(clangCursor);
-   const CXSourceLocation rangeStart  = clang_getRangeStart(sourceRange);
-   const CXSourceLocation rangeEnd    = clang_getRangeEnd(sourceRange);
-   // TODO: combine FunctionCallExpression with the subsequent DeclarationReferenceExpression and optional NamespaceReference
-#endif
-
    if (clang_isCursorDefinition(clangCursor) != 0)
    {
       cursor.attributes.isDefinition = 1;
@@ -525,59 +560,246 @@ void TranslationUnitAccumulator::processCursor(CXCursor clangCursor)
    );
    assert(referencedFileNameKey != 0);
 
-   const ftags::util::StringTable::Key symbolNameKey = m_symbolTable.addKey(cursor.symbolName);
+   const std::size_t             symbolCount   = m_symbolTable.getSize();
+   ftags::util::StringTable::Key symbolNameKey = 0;
+   if ((m_statistics.cursorsKept % k_symbolTableSamplingInterval) == 0)
+   {
+      // reading the clock costs about as much as a lookup; time a sample of the lookups and extrapolate
+      ftags::ScopedPhaseTimer timer{
+         &m_statistics, ftags::ParsingStatistics::Phase::SymbolTable, k_symbolTableSamplingInterval};
+
+      symbolNameKey = m_symbolTable.addKey(cursor.symbolName);
+   }
+   else
+   {
+      symbolNameKey = m_symbolTable.addKey(cursor.symbolName);
+   }
+
+   if (m_symbolTable.getSize() != symbolCount)
+   {
+      m_statistics.bytesAdded += strlen(cursor.symbolName) + 1;
+   }
+
+   m_statistics.cursorsKept++;
 
    assert(m_level >= 0);
    cursor.attributes.level = static_cast<uint32_t>(m_level);
    m_translationUnit.addCursor(cursor, symbolNameKey, fileNameKey, referencedFileNameKey, m_recordSpanManager);
+
+   return true;
 }
 
 CXChildVisitResult visitTranslationUnit(CXCursor cursor, CXCursor /* parent */, CXClientData clientData)
 {
    auto* accumulator = reinterpret_cast<TranslationUnitAccumulator*>(clientData);
 
-   accumulator->processCursor(cursor);
-   accumulator->increaseLevel();
+   if (accumulator->processCursor(cursor))
+   {
+      accumulator->increaseLevel();
+
+      clang_visitChildren(cursor, visitTranslationUnit, clientData);
 
-   clang_visitChildren(cursor, visitTranslationUnit, clientData);
+      accumulator->decreaseLevel();
+   }
 
-   accumulator->decreaseLevel();
    return CXChildVisit_Continue;
 }
 
-} // namespace
+/*
+ * Index action front end
+ */
+struct IndexActionData
+{
+   TranslationUnitAccumulator&        accumulator;
+   ftags::ParsingSession&             parsingSession;
+   ftags::ProjectDb::TranslationUnit& translationUnit;
+   ftags::RecordSpanManager&          recordSpanManager;
+   ftags::util::StringTable::Key      mainFileKey;
 
-ftags::ProjectDb::TranslationUnit ftags::ProjectDb::TranslationUnit::parse(const std::string&              fileName,
-                                                                           const std::vector<const char*>& arguments,
-                                                                           ParsingContext& parsingContext)
+   // for each file seen in this translation unit, whether its records are collected
+   std::unordered_map<CXFile, bool> visitedFiles;
+
+   // headers whose records are collected by this translation unit
+   std::unordered_set<ftags::util::StringTable::Key> indexedHeaders;
+
+   bool shouldIndex(CXCursor clangCursor)
+   {
+      CXFile           file     = nullptr;
+      CXSourceLocation location = clang_getCursorLocation(clangCursor);
+      clang_getExpansionLocation(location, &file, nullptr, nullptr, nullptr);
+      if (file == nullptr)
+      {
+         return true;
+      }
+
+      const auto iter = visitedFiles.find(file);
+      if (iter != visitedFiles.end())
+      {
+         return iter->second;
+      }
+
+      bool                                        index       = true;
+      const TranslationUnitAccumulator::FileInfo& fileInfo    = accumulator.getFileInfo(file, location);
+      const ftags::util::StringTable::Key         fileNameKey = fileInfo.fileNameKey;
+      if (!fileInfo.isIndexed)
+      {
+         index = false;
+      }
+      else if (fileNameKey != mainFileKey)
+      {
+         const std::vector<ftags::RecordSpan::Store::Key>* recordSpans =
+            parsingSession.getIndexedHeaderSpans(fileNameKey);
+         if (recordSpans != nullptr)
+         {
+            // indexed by a previous translation unit in this session; share its spans
+            translationUnit.addRecordSpans(*recordSpans, recordSpanManager);
+            index = false;
+         }
+         else
+         {
+            indexedHeaders.insert(fileNameKey);
+         }
+      }
+
+      visitedFiles.emplace(file, index);
+      return index;
+   }
+};
+
+void indexDeclaration(CXClientData clientData, const CXIdxDeclInfo* declarationInfo)
 {
-   ftags::ProjectDb::TranslationUnit translationUnit;
+   auto* indexActionData = static_cast<IndexActionData*>(clientData);
 
-   TranslationUnitAccumulator accumulator{translationUnit, parsingContext};
+   if ((declarationInfo->isImplicit == 0) && indexActionData->shouldIndex(declarationInfo->cursor))
+   {
+      indexActionData->accumulator.processCursor(declarationInfo->cursor);
+   }
+}
 
-   ftags::util::StringTable::Key fileKey = parsingContext.fileNameTable.addKey(fileName.c_str());
-   translationUnit.beginParsingUnit(fileKey);
+void indexEntityReference(CXClientData clientData, const CXIdxEntityRefInfo* referenceInfo)
+{
+   auto* indexActionData = static_cast<IndexActionData*>(clientData);
 
-   auto clangIndex = std::unique_ptr<void, CXIndexDestroyer>(clang_createIndex(/* excludeDeclarationsFromPCH = */ 0,
-                                                                               /* displayDiagnostics         = */ 0));
+   if ((referenceInfo->kind == CXIdxEntityRef_Direct) && indexActionData->shouldIndex(referenceInfo->cursor))
+   {
+      indexActionData->accumulator.processCursor(referenceInfo->cursor);
+   }
+}
 
-   CXTranslationUnit translationUnitPtr = nullptr;
+/*
+ * Indexes the translation unit with the session's index action; returns the headers which were
+ * indexed by this translation unit, as opposed to those shared from a previous one. The clang
+ * translation unit is only kept if outTranslationUnit is not null.
+ */
+std::unordered_set<ftags::util::StringTable::Key>
+indexSourceFile(const std::string&                                 fileName,
+                const std::vector<const char*>&                    arguments,
+                ftags::ProjectDb::TranslationUnit::ParsingContext& parsingContext,
+                TranslationUnitAccumulator&                        accumulator,
+                ftags::ProjectDb::TranslationUnit&                 translationUnit,
+                ftags::util::StringTable::Key                      mainFileKey,
+                CXTranslationUnit*                                 outTranslationUnit)
+{
+   ftags::ParsingSession& parsingSession = parsingContext.parsingSession;
+
+   IndexActionData indexActionData{
+      accumulator, parsingSession, translationUnit, parsingContext.recordSpanManager, mainFileKey, {}, {}};
+
+   IndexerCallbacks callbacks{};
+   callbacks.indexDeclaration     = indexDeclaration;
+   callbacks.indexEntityReference = indexEntityReference;
 
-   const unsigned parsingOptions = CXTranslationUnit_DetailedPreprocessingRecord | CXTranslationUnit_KeepGoing |
-                                   CXTranslationUnit_CreatePreambleOnFirstParse |
-                                   clang_defaultEditingTranslationUnitOptions();
+   unsigned indexOptions = CXIndexOpt_IndexFunctionLocalSymbols | CXIndexOpt_SkipParsedBodiesInSession;
+   if (parsingSession.getProfile() == ftags::ParsingSession::Profile::Batch)
+   {
+      indexOptions |= CXIndexOpt_SuppressWarnings;
+   }
 
-   const CXErrorCode parseError = clang_parseTranslationUnit2(
-      /* CIdx                  = */ clangIndex.get(),
+   const int indexError = clang_indexSourceFile(
+      /* action                = */ parsingSession.getIndexAction(parsingContext.recordSpanManager),
+      /* client_data           = */ &indexActionData,
+      /* index_callbacks       = */ &callbacks,
+      /* index_callbacks_size  = */ sizeof(callbacks),
+      /* index_options         = */ indexOptions,
       /* source_filename       = */ fileName.c_str(),
       /* command_line_args     = */ arguments.data(),
       /* num_command_line_args = */ static_cast<int>(arguments.size()),
       /* unsaved_files         = */ nullptr,
       /* num_unsaved_files     = */ 0,
-      /* options               = */ parsingOptions,
-      /* out_TU                = */ &translationUnitPtr);
+      /* out_TU                = */ outTranslationUnit,
+      /* TU_options            = */ parsingSession.getParsingOptions());
 
-   if ((parseError == CXError_Success) && (nullptr != translationUnitPtr))
+   if (indexError != 0)
+   {
+      if ((outTranslationUnit != nullptr) && (*outTranslationUnit != nullptr))
+      {
+         clang_disposeTranslationUnit(*outTranslationUnit);
+         *outTranslationUnit = nullptr;
+      }
+
+      // the session may have marked bodies as parsed without us keeping the records
+      parsingSession.restartIndexAction();
+      throw std::runtime_error("Failed to index input");
+   }
+
+   return std::move(indexActionData.indexedHeaders);
+}
+
+void collectInclusion(CXFile includedFile,
+                      CXSourceLocation* /* inclusionStack */,
+                      unsigned /* includeLength */,
+                      CXClientData clientData)
+{
+   static_cast<std::vector<CXFile>*>(clientData)->push_back(includedFile);
+}
+
+/*
+ * Fingerprints the translation unit with its arguments and the contents of the main file and of
+ * all the files it includes, as they were read by the parser.
+ */
+void fingerprintTranslationUnit(CXTranslationUnit                  translationUnitPtr,
+                                const std::vector<const char*>&    arguments,
+                                TranslationUnitAccumulator&        accumulator,
+                                ftags::ProjectDb::TranslationUnit& translationUnit)
+{
+   std::vector<CXFile> includedFiles;
+   clang_getInclusions(translationUnitPtr, collectInclusion, &includedFiles);
+
+   std::unordered_set<CXFile>                 seenFiles;
+   std::vector<ftags::util::StringTable::Key> dependencies;
+   std::vector<uint64_t>                      dependencyHashes;
+
+   for (CXFile includedFile : includedFiles)
+   {
+      if (!seenFiles.insert(includedFile).second)
+      {
+         continue;
+      }
+
+      CXString    fileNameString = clang_getFileName(includedFile);
+      const char* fileName       = clang_getCString(fileNameString);
+
+      std::size_t size     = 0;
+      const char* contents = clang_getFileContents(translationUnitPtr, includedFile, &size);
+
+      dependencies.push_back(accumulator.getFileNameKey(includedFile));
+      dependencyHashes.push_back((contents != nullptr)
+                                    ? ftags::ProjectDb::TranslationUnit::hashContents(contents, size)
+                                    : ftags::ProjectDb::TranslationUnit::hashFile(fileName));
+
+      clang_disposeString(fileNameString);
+   }
+
+   translationUnit.setFingerprint(
+      ftags::ProjectDb::TranslationUnit::computeFingerprint(arguments, dependencyHashes), std::move(dependencies));
+}
+
+void visitClangTranslationUnit(CXTranslationUnit           translationUnitPtr,
+                               const ftags::ParsingSession& parsingSession,
+                               TranslationUnitAccumulator&  accumulator,
+                               ftags::ParsingStatistics&    statistics)
+{
+   if (parsingSession.getProfile() != ftags::ParsingSession::Profile::Batch)
    {
       CXDiagnosticSet diagnosticSet    = clang_getDiagnosticSetFromTU(translationUnitPtr);
       unsigned        diagnosticsCount = clang_getNumDiagnosticsInSet(diagnosticSet);
@@ -600,19 +822,327 @@ ftags::ProjectDb::TranslationUnit ftags::ProjectDb::TranslationUnit::parse(const
       }
 
       clang_disposeDiagnosticSet(diagnosticSet);
+   }
+
+   ftags::ScopedPhaseTimer timer{&statistics, ftags::ParsingStatistics::Phase::Visit};
+
+   CXCursor cursor = clang_getTranslationUnitCursor(translationUnitPtr);
+   clang_visitChildren(cursor, visitTranslationUnit, &accumulator);
+
+   assert(accumulator.isLevel());
+}
+
+} // namespace
+
+ftags::ParsingSession::ParsingSession(Profile profile, FrontEnd frontEnd) :
+   m_profile{profile},
+   m_frontEnd{frontEnd},
+   m_index{clang_createIndex(/* excludeDeclarationsFromPCH = */ 0, /* displayDiagnostics = */ 0)}
+{
+}
+
+ftags::ParsingSession::~ParsingSession() noexcept
+{
+   restartIndexAction();
+
+   for (const auto& retained : m_retainedTranslationUnits)
+   {
+      clang_disposeTranslationUnit(static_cast<CXTranslationUnit>(retained.translationUnit));
+   }
+
+   clang_disposeIndex(m_index);
+}
+
+void* ftags::ParsingSession::getRetainedTranslationUnit(const std::string&              fileName,
+                                                        const std::vector<const char*>& arguments)
+{
+   auto iter = std::find_if(
+      m_retainedTranslationUnits.begin(),
+      m_retainedTranslationUnits.end(),
+      [&fileName](const RetainedTranslationUnit& retained) { return retained.fileName == fileName; });
+
+   if (iter == m_retainedTranslationUnits.end())
+   {
+      return nullptr;
+   }
+
+   if (!std::equal(iter->arguments.begin(),
+                   iter->arguments.end(),
+                   arguments.begin(),
+                   arguments.end(),
+                   [](const std::string& retainedArgument, const char* argument) {
+                      return retainedArgument == argument;
+                   }))
+   {
+      disposeRetainedTranslationUnit(fileName);
+      return nullptr;
+   }
+
+   // most recently used last
+   std::rotate(iter, std::next(iter), m_retainedTranslationUnits.end());
+
+   return m_retainedTranslationUnits.back().translationUnit;
+}
+
+void ftags::ParsingSession::retainTranslationUnit(const std::string&              fileName,
+                                                  const std::vector<const char*>& arguments,
+                                                  void*                           translationUnit)
+{
+   disposeRetainedTranslationUnit(fileName);
+
+   if (m_retainedTranslationUnits.size() == k_maxRetainedTranslationUnits)
+   {
+      disposeRetainedTranslationUnit(m_retainedTranslationUnits.front().fileName);
+   }
+
+   m_retainedTranslationUnits.push_back({fileName, {arguments.begin(), arguments.end()}, translationUnit});
+}
+
+void ftags::ParsingSession::disposeRetainedTranslationUnit(const std::string& fileName) noexcept
+{
+   auto iter = std::find_if(
+      m_retainedTranslationUnits.begin(),
+      m_retainedTranslationUnits.end(),
+      [&fileName](const RetainedTranslationUnit& retained) { return retained.fileName == fileName; });
+
+   if (iter != m_retainedTranslationUnits.end())
+   {
+      clang_disposeTranslationUnit(static_cast<CXTranslationUnit>(iter->translationUnit));
+      m_retainedTranslationUnits.erase(iter);
+   }
+}
+
+void* ftags::ParsingSession::getIndexAction(const RecordSpanManager& recordSpanManager)
+{
+   if (m_indexedRecordSpanManager != &recordSpanManager)
+   {
+      restartIndexAction();
+   }
+
+   if (m_indexAction == nullptr)
+   {
+      m_indexAction              = clang_IndexAction_create(m_index);
+      m_indexedRecordSpanManager = &recordSpanManager;
+   }
+
+   return m_indexAction;
+}
+
+void ftags::ParsingSession::restartIndexAction() noexcept
+{
+   if (m_indexAction != nullptr)
+   {
+      clang_IndexAction_dispose(m_indexAction);
+      m_indexAction = nullptr;
+   }
+
+   m_indexedRecordSpanManager = nullptr;
+   m_indexedHeaders.clear();
+}
+
+const std::vector<ftags::RecordSpan::Store::Key>*
+ftags::ParsingSession::getIndexedHeaderSpans(ftags::util::StringTable::Key fileNameKey) const
+{
+   const auto iter = m_indexedHeaders.find(fileNameKey);
+   if (iter == m_indexedHeaders.end())
+   {
+      return nullptr;
+   }
+
+   return &iter->second;
+}
+
+unsigned ftags::ParsingSession::getParsingOptions() const noexcept
+{
+   unsigned parsingOptions = CXTranslationUnit_DetailedPreprocessingRecord | CXTranslationUnit_KeepGoing;
 
+   /*
+    * In batch mode every translation unit is parsed exactly once, so building a preamble or caching
+    * completion results is pure overhead.
+    */
+   if (m_profile != Profile::Batch)
+   {
+      parsingOptions |= CXTranslationUnit_CreatePreambleOnFirstParse | clang_defaultEditingTranslationUnitOptions();
+   }
+
+   if (m_declarationsOnly)
+   {
+      parsingOptions |= CXTranslationUnit_SkipFunctionBodies;
+   }
+
+   if (m_incomplete)
+   {
+      parsingOptions |= CXTranslationUnit_Incomplete;
+   }
+
+   return parsingOptions;
+}
+
+ftags::ProjectDb::TranslationUnit ftags::ProjectDb::TranslationUnit::parse(const std::string&              fileName,
+                                                                           const std::vector<const char*>& arguments,
+                                                                           ParsingContext& parsingContext)
+{
+   ftags::ProjectDb::TranslationUnit translationUnit;
+
+   TranslationUnitAccumulator accumulator{translationUnit, parsingContext};
+
+   ftags::util::StringTable::Key fileKey = parsingContext.fileNameTable.addKey(fileName.c_str());
+   translationUnit.beginParsingUnit(fileKey, &parsingContext.statistics);
+   parsingContext.statistics.translationUnits++;
+
+   const uint64_t startNanoseconds = parsingContext.statistics.getIndexingNanoseconds();
+
+   ParsingSession& parsingSession = parsingContext.parsingSession;
+
+   translationUnit.setPartial(parsingSession.isDeclarationsOnly());
+
+   // a partial translation unit is always indexed again, so it does not need a fingerprint
+   const bool computeFingerprint = !parsingSession.isDeclarationsOnly();
+
+   if (parsingSession.getFrontEnd() == ParsingSession::FrontEnd::IndexAction)
+   {
+      CXTranslationUnit translationUnitPtr = nullptr;
+
+      std::unordered_set<ftags::util::StringTable::Key> indexedHeaders;
+      {
+         ScopedPhaseTimer parseTimer{&parsingContext.statistics, ParsingStatistics::Phase::Parse};
+
+         indexedHeaders = indexSourceFile(fileName,
+                                          arguments,
+                                          parsingContext,
+                                          accumulator,
+                                          translationUnit,
+                                          fileKey,
+                                          computeFingerprint ? &translationUnitPtr : nullptr);
+      }
+
+      if (translationUnitPtr != nullptr)
+      {
+         auto clangTranslationUnit =
+            std::unique_ptr<CXTranslationUnitImpl, CXTranslationUnitDestroyer>(translationUnitPtr);
+
+         fingerprintTranslationUnit(clangTranslationUnit.get(), arguments, accumulator, translationUnit);
+      }
+
+      translationUnit.finalizeParsingUnit(parsingContext.recordSpanManager);
+      translationUnit.m_parseNanoseconds = parsingContext.statistics.getIndexingNanoseconds() - startNanoseconds;
+
+      // remember the spans of the new headers so the following translation units can share them
+      for (const auto recordSpanKey : translationUnit.m_recordSpans)
+      {
+         const auto spanFileKey = parsingContext.recordSpanManager.getSpan(recordSpanKey).getFileKey();
+         if (indexedHeaders.count(spanFileKey) != 0)
+         {
+            parsingSession.addIndexedHeaderSpan(spanFileKey, recordSpanKey);
+         }
+      }
+
+      return translationUnit;
+   }
+
+   CXTranslationUnit translationUnitPtr = nullptr;
+   CXErrorCode       parseError         = CXError_Success;
+
+   {
+      ScopedPhaseTimer parseTimer{&parsingContext.statistics, ParsingStatistics::Phase::Parse};
+
+      parseError = clang_parseTranslationUnit2(
+         /* CIdx                  = */ parsingSession.getIndex(),
+         /* source_filename       = */ fileName.c_str(),
+         /* command_line_args     = */ arguments.data(),
+         /* num_command_line_args = */ static_cast<int>(arguments.size()),
+         /* unsaved_files         = */ nullptr,
+         /* num_unsaved_files     = */ 0,
+         /* options               = */ parsingSession.getParsingOptions(),
+         /* out_TU                = */ &translationUnitPtr);
+   }
+
+   if ((parseError == CXError_Success) && (nullptr != translationUnitPtr))
+   {
       auto clangTranslationUnit =
          std::unique_ptr<CXTranslationUnitImpl, CXTranslationUnitDestroyer>(translationUnitPtr);
 
-      CXCursor cursor = clang_getTranslationUnitCursor(clangTranslationUnit.get());
-      clang_visitChildren(cursor, visitTranslationUnit, &accumulator);
+      visitClangTranslationUnit(clangTranslationUnit.get(), parsingSession, accumulator, parsingContext.statistics);
+
+      if (computeFingerprint)
+      {
+         fingerprintTranslationUnit(clangTranslationUnit.get(), arguments, accumulator, translationUnit);
+      }
    }
    else
    {
       throw std::runtime_error("Failed to parse input");
    }
 
-   assert(accumulator.isLevel());
+   translationUnit.finalizeParsingUnit(parsingContext.recordSpanManager);
+   translationUnit.m_parseNanoseconds = parsingContext.statistics.getIndexingNanoseconds() - startNanoseconds;
+
+   return translationUnit;
+}
+
+ftags::ProjectDb::TranslationUnit ftags::ProjectDb::TranslationUnit::reparse(const std::string& fileName,
+                                                                             const std::vector<const char*>& arguments,
+                                                                             std::string_view                contents,
+                                                                             ParsingContext& parsingContext)
+{
+   ftags::ProjectDb::TranslationUnit translationUnit;
+
+   TranslationUnitAccumulator accumulator{translationUnit, parsingContext};
+
+   ftags::util::StringTable::Key fileKey = parsingContext.fileNameTable.addKey(fileName.c_str());
+   translationUnit.beginParsingUnit(fileKey, &parsingContext.statistics);
+   parsingContext.statistics.translationUnits++;
+
+   ParsingSession& parsingSession = parsingContext.parsingSession;
+
+   translationUnit.setPartial(parsingSession.isDeclarationsOnly());
+
+   CXUnsavedFile unsavedFile{};
+   unsavedFile.Filename = fileName.c_str();
+   unsavedFile.Contents = contents.data();
+   unsavedFile.Length   = static_cast<unsigned long>(contents.size());
+
+   auto translationUnitPtr =
+      static_cast<CXTranslationUnit>(parsingSession.getRetainedTranslationUnit(fileName, arguments));
+
+   {
+      ScopedPhaseTimer parseTimer{&parsingContext.statistics, ParsingStatistics::Phase::Parse};
+
+      if (translationUnitPtr != nullptr)
+      {
+         const int reparseError = clang_reparseTranslationUnit(
+            translationUnitPtr, 1, &unsavedFile, clang_defaultReparseOptions(translationUnitPtr));
+
+         if (reparseError != 0)
+         {
+            // the translation unit can only be disposed of after a failed reparse
+            parsingSession.disposeRetainedTranslationUnit(fileName);
+            translationUnitPtr = nullptr;
+         }
+      }
+
+      if (translationUnitPtr == nullptr)
+      {
+         const CXErrorCode parseError = clang_parseTranslationUnit2(
+            /* CIdx                  = */ parsingSession.getIndex(),
+            /* source_filename       = */ fileName.c_str(),
+            /* command_line_args     = */ arguments.data(),
+            /* num_command_line_args = */ static_cast<int>(arguments.size()),
+            /* unsaved_files         = */ &unsavedFile,
+            /* num_unsaved_files     = */ 1,
+            /* options               = */ parsingSession.getParsingOptions(),
+            /* out_TU                = */ &translationUnitPtr);
+
+         if ((parseError != CXError_Success) || (nullptr == translationUnitPtr))
+         {
+            throw std::runtime_error("Failed to parse input");
+         }
+
+         parsingSession.retainTranslationUnit(fileName, arguments, translationUnitPtr);
+      }
+   }
+
+   visitClangTranslationUnit(translationUnitPtr, parsingSession, accumulator, parsingContext.statistics);
 
    translationUnit.finalizeParsingUnit(parsingContext.recordSpanManager);
 
@@ -16,20 +16,77 @@
 
 #include <project.h>
 
-void ftags::ProjectDb::TranslationUnit::beginParsingUnit(ftags::util::StringTable::Key fileNameKey)
+#include <spooky.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+#include <cstring>
+
+namespace
+{
+
+/*
+ * Records that can carry the namespace qualifier of their name
+ */
+bool canOwnNamespaceReference(ftags::SymbolType symbolType)
+{
+   switch (symbolType)
+   {
+   case ftags::SymbolType::FunctionCallExpression:
+   case ftags::SymbolType::DeclarationReferenceExpression:
+   case ftags::SymbolType::MemberReferenceExpression:
+   case ftags::SymbolType::TypeReference:
+   case ftags::SymbolType::TemplateReference:
+   case ftags::SymbolType::OverloadedDeclarationReference:
+   case ftags::SymbolType::VariableReference:
+      return true;
+
+   default:
+      return false;
+   }
+}
+
+} // namespace
+
+void ftags::ProjectDb::TranslationUnit::beginParsingUnit(ftags::util::StringTable::Key fileNameKey,
+                                                         ParsingStatistics*            parsingStatistics)
 {
-   m_fileNameKey = fileNameKey;
+   m_fileNameKey       = fileNameKey;
+   m_parsingStatistics = parsingStatistics;
 }
 
 void ftags::ProjectDb::TranslationUnit::finalizeParsingUnit(RecordSpanManager& recordSpanManager)
 {
    flushCurrentSpan(recordSpanManager);
+
+   // the location set is only needed while parsing
+   m_currentSpanLocations = {};
+   m_parsingStatistics    = nullptr;
+}
+
+void ftags::ProjectDb::TranslationUnit::releaseRecordSpans(RecordSpanManager& recordSpanManager)
+{
+   for (const auto recordSpanKey : m_recordSpans)
+   {
+      recordSpanManager.releaseSpan(recordSpanKey);
+   }
+
+   m_recordSpans.clear();
 }
 
 void ftags::ProjectDb::TranslationUnit::copyRecords(const TranslationUnit&   otherTranslationUnit,
                                                     const RecordSpanManager& otherRecordSpanManager,
                                                     RecordSpanManager&       recordSpanManager)
 {
+   m_isPartial        = otherTranslationUnit.m_isPartial;
+   m_fingerprint      = otherTranslationUnit.m_fingerprint;
+   m_parseNanoseconds = otherTranslationUnit.m_parseNanoseconds;
+   m_dependencies     = otherTranslationUnit.m_dependencies;
+
    /*
     * copy the original records
     */
@@ -52,6 +109,19 @@ void ftags::ProjectDb::TranslationUnit::copyRecords(const TranslationUnit&   oth
                                                     const KeyMap&            symbolKeyMapping,
                                                     const KeyMap&            fileNameKeyMapping)
 {
+   m_isPartial        = otherTranslationUnit.m_isPartial;
+   m_fingerprint      = otherTranslationUnit.m_fingerprint;
+   m_parseNanoseconds = otherTranslationUnit.m_parseNanoseconds;
+
+   m_dependencies.clear();
+   m_dependencies.reserve(otherTranslationUnit.m_dependencies.size());
+   for (const Key otherDependency : otherTranslationUnit.m_dependencies)
+   {
+      const auto iter = fileNameKeyMapping.lookup(otherDependency);
+      assert(iter != fileNameKeyMapping.none());
+      m_dependencies.push_back(iter->second);
+   }
+
    /*
     * copy the original records
     */
@@ -70,57 +140,162 @@ void ftags::ProjectDb::TranslationUnit::copyRecords(const TranslationUnit&   oth
    }
 }
 
-void ftags::ProjectDb::TranslationUnit::flushCurrentSpan(RecordSpanManager& recordSpanManager)
+/*
+ * Clang reports a call to a named function as a FunctionCallExpression followed, somewhere in its subtree, by the
+ * DeclarationReferenceExpression naming the callee, and qualified names carry NamespaceReference children. Merge each
+ * reference into the call it names (the call takes the location of the name) and fold namespace references into the
+ * record they qualify, then drop the duplicate records.
+ *
+ * The pairing relies on the nesting levels of the cursor visitor; the index action front end reports each reference
+ * once, with every record at level zero, so its records are only deduplicated here.
+ */
+void ftags::ProjectDb::TranslationUnit::canonicalizeCurrentSpan()
 {
-   if (!m_currentSpan.empty())
+   static constexpr std::size_t k_noRecord = std::numeric_limits<std::size_t>::max();
+
+   struct PendingCall
    {
-      const auto spanKey = recordSpanManager.addSpan(m_currentSpan);
-      m_recordSpans.push_back(spanKey);
+      std::size_t index;
+      uint32_t    level;
+   };
 
-      m_currentSpan.clear();
-      m_currentSpanLocations.clear();
+   std::vector<PendingCall> pendingCalls;
+   std::size_t              namespaceOwner = k_noRecord;
+   std::size_t              output         = 0;
+
+   // only the qualifiers which are direct children of the name are folded, not those deeper in its arguments
+   uint32_t qualifierLevel = 0;
+
+   for (std::size_t input = 0; input < m_currentSpan.size(); input++)
+   {
+      const Record   record = m_currentSpan[input];
+      const uint32_t level  = record.attributes.level;
+
+      // once we are out of the subtree of a call, its callee can no longer follow
+      while ((!pendingCalls.empty()) && (pendingCalls.back().level >= level))
+      {
+         pendingCalls.pop_back();
+      }
+
+      if (record.getType() == ftags::SymbolType::DeclarationReferenceExpression)
+      {
+         const auto callIter =
+            std::find_if(pendingCalls.rbegin(), pendingCalls.rend(), [this, &record](const PendingCall& pendingCall) {
+               const Record& call = m_currentSpan[pendingCall.index];
+               return (call.symbolNameKey == record.symbolNameKey) && (call.definition == record.definition);
+            });
+
+         if (callIter != pendingCalls.rend())
+         {
+            m_currentSpan[callIter->index].location = record.location;
+
+            namespaceOwner = callIter->index;
+            qualifierLevel = level + 1;
+            pendingCalls.erase(std::next(callIter).base());
+            continue;
+         }
+      }
+      else if (record.getType() == ftags::SymbolType::NamespaceReference)
+      {
+         if ((namespaceOwner != k_noRecord) && (level == qualifierLevel))
+         {
+            m_currentSpan[namespaceOwner].attributes.isQualified = 1;
+            continue;
+         }
+      }
+
+      m_currentSpan[output] = record;
+
+      if (record.getType() == ftags::SymbolType::FunctionCallExpression)
+      {
+         pendingCalls.push_back({output, level});
+      }
+
+      namespaceOwner = canOwnNamespaceReference(record.getType()) ? output : k_noRecord;
+      qualifierLevel = level + 1;
+
+      output++;
    }
-   else
+
+   /*
+    * Remove duplicate records, keeping the first one at each location
+    */
+   m_currentSpanLocations.clear();
+
+   const std::size_t canonicalSize = output;
+   output                          = 0;
+
+   for (std::size_t input = 0; input < canonicalSize; input++)
    {
-      assert(m_currentSpanLocations.empty());
+      const Record& record = m_currentSpan[input];
+
+      const SymbolAtLocation location{
+         record.symbolNameKey, record.location.fileNameKey, record.location.line, record.location.column};
+
+      if (m_currentSpanLocations.insert(location))
+      {
+         m_currentSpan[output] = record;
+         output++;
+      }
    }
+
+   m_currentSpan.resize(output);
 }
 
-void ftags::ProjectDb::TranslationUnit::addCursor(const ftags::Cursor&          cursor,
-                                                  ftags::util::StringTable::Key symbolNameKey,
-                                                  ftags::util::StringTable::Key fileNameKey,
-                                                  ftags::util::StringTable::Key referencedFileNameKey,
-                                                  ftags::RecordSpanManager&     recordSpanManager)
+void ftags::ProjectDb::TranslationUnit::flushCurrentSpan(RecordSpanManager& recordSpanManager)
 {
-   if (cursor.attributes.getType() == ftags::SymbolType::DeclarationReferenceExpression)
+   if (!m_currentSpan.empty())
    {
-      assert(!m_currentSpan.empty());
+      ScopedPhaseTimer timer{m_parsingStatistics, ParsingStatistics::Phase::RecordSpans};
 
-      ftags::Record& oldRecord = m_currentSpan.back();
+      canonicalizeCurrentSpan();
 
-      if (oldRecord.attributes.getType() == ftags::SymbolType::FunctionCallExpression)
+      const auto spanKey = recordSpanManager.addSpan(m_currentSpan);
+      m_recordSpans.push_back(spanKey);
+
+      if (m_parsingStatistics != nullptr)
       {
-         if (oldRecord.symbolNameKey == symbolNameKey)
+         m_parsingStatistics->recordsEmitted += m_currentSpan.size();
+
+         // a new span is only referenced by this translation unit
+         if (recordSpanManager.getSpan(spanKey).getUsage() == 1)
+         {
+            m_parsingStatistics->newSpans++;
+            m_parsingStatistics->bytesAdded += m_currentSpan.size() * sizeof(Record);
+         }
+         else
          {
-            // skip over this record since it is a duplicate FunctionCallExpression / DeclarationReferenceExpression
-            return;
+            m_parsingStatistics->deduplicatedSpans++;
          }
       }
-   }
 
-#if 0
-   if (cursor.attributes.getType() == ftags::SymbolType::NamespaceReference)
-   {
-      assert(!m_currentSpan.empty());
+      m_currentSpan.clear();
+   }
+}
 
-      ftags::Record& oldRecord = m_currentSpan.back();
+void ftags::ProjectDb::TranslationUnit::addRecordSpans(const std::vector<RecordSpan::Store::Key>& recordSpanKeys,
+                                                       ftags::RecordSpanManager&                  recordSpanManager)
+{
+   flushCurrentSpan(recordSpanManager);
 
-      oldRecord.namespaceKey = symbolNameKey;
+   for (const auto recordSpanKey : recordSpanKeys)
+   {
+      recordSpanManager.getSpan(recordSpanKey).addRef();
+      m_recordSpans.push_back(recordSpanKey);
+   }
 
-      return;
+   if (m_parsingStatistics != nullptr)
+   {
+      m_parsingStatistics->deduplicatedSpans += recordSpanKeys.size();
    }
-#endif
+}
 
+void ftags::ProjectDb::TranslationUnit::addCursor(const ftags::Cursor&          cursor,
+                                                  ftags::util::StringTable::Key symbolNameKey,
+                                                  ftags::util::StringTable::Key fileNameKey,
+                                                  ftags::util::StringTable::Key referencedFileNameKey,
+                                                  ftags::RecordSpanManager&     recordSpanManager)
+{
    if (fileNameKey != m_currentRecordSpanFileKey)
    {
       /*
@@ -131,41 +306,45 @@ void ftags::ProjectDb::TranslationUnit::addCursor(const ftags::Cursor&
       m_currentRecordSpanFileKey = fileNameKey;
    }
 
-   const SymbolAtLocation newLocation{symbolNameKey, fileNameKey, cursor.location.line, cursor.location.column};
-
-   if (m_currentSpanLocations.find(newLocation) == m_currentSpanLocations.end())
-   {
-      m_currentSpanLocations.insert(newLocation);
+   // duplicates are removed when the span is canonicalized
+   ftags::Record& newRecord = m_currentSpan.emplace_back();
 
-      ftags::Record& newRecord = m_currentSpan.emplace_back();
+   newRecord.symbolNameKey = symbolNameKey;
+   newRecord.attributes    = cursor.attributes;
 
-      newRecord.symbolNameKey = symbolNameKey;
-      newRecord.attributes    = cursor.attributes;
+   newRecord.setLocationFileKey(fileNameKey);
+   newRecord.setLocationAddress(cursor.location.line, cursor.location.column);
 
-      newRecord.setLocationFileKey(fileNameKey);
-      newRecord.setLocationAddress(cursor.location.line, cursor.location.column);
-
-      newRecord.setDefinitionFileKey(referencedFileNameKey);
-      newRecord.setDefinitionAddress(cursor.definition.line, cursor.definition.column);
-   }
+   newRecord.setDefinitionFileKey(referencedFileNameKey);
+   newRecord.setDefinitionAddress(cursor.definition.line, cursor.definition.column);
 }
 
 std::size_t ftags::ProjectDb::TranslationUnit::computeSerializedSize() const
 {
    std::vector<uint64_t> recordSpanHashes(/* __n = */ m_recordSpans.size());
 
-   return sizeof(ftags::util::SerializedObjectHeader) + sizeof(ftags::util::StringTable::Key) +
+   return sizeof(ftags::util::SerializedObjectHeader) + sizeof(ftags::util::StringTable::Key) + sizeof(uint64_t) +
+          sizeof(uint64_t) + sizeof(uint64_t) +
+          ftags::util::Serializer<std::vector<Key>>::computeSerializedSize(m_dependencies) +
           ftags::util::Serializer<std::vector<RecordSpan::Store::Key>>::computeSerializedSize(m_recordSpans);
 }
 
 void ftags::ProjectDb::TranslationUnit::serialize(ftags::util::TypedInsertor& insertor) const
 {
    ftags::util::SerializedObjectHeader header{"ftags::TranslationUnit"};
+   header.m_version = k_serializationVersion;
    insertor << header;
 
    assert(m_fileNameKey != 0);
    insertor << m_fileNameKey;
 
+   const uint64_t flags = m_isPartial ? k_partialFlag : 0;
+   insertor << flags;
+
+   insertor << m_fingerprint;
+   insertor << m_parseNanoseconds;
+   ftags::util::Serializer<std::vector<Key>>::serialize(m_dependencies, insertor);
+
    std::vector<uint64_t> recordSpanHashes;
 
    ftags::util::Serializer<std::vector<RecordSpan::Store::Key>>::serialize(m_recordSpans, insertor);
@@ -182,11 +361,286 @@ ftags::ProjectDb::TranslationUnit::deserialize(ftags::util::TypedExtractor& extr
    extractor >> retval.m_fileNameKey;
    assert(retval.m_fileNameKey);
 
+   if (header.m_version >= 2)
+   {
+      uint64_t flags = 0;
+      extractor >> flags;
+      retval.m_isPartial = (flags & k_partialFlag) != 0;
+   }
+
+   if (header.m_version >= 3)
+   {
+      extractor >> retval.m_fingerprint;
+      if (header.m_version >= 4)
+      {
+         extractor >> retval.m_parseNanoseconds;
+      }
+      retval.m_dependencies = ftags::util::Serializer<std::vector<Key>>::deserialize(extractor);
+   }
+
    retval.m_recordSpans = ftags::util::Serializer<std::vector<RecordSpan::Store::Key>>::deserialize(extractor);
 
    return retval;
 }
 
+namespace
+{
+
+// translates the keys of the sender to the keys of the receiver
+ftags::util::StringTable::Key
+translateKey(const std::unordered_map<ftags::util::StringTable::Key, ftags::util::StringTable::Key>& mapping,
+             ftags::util::StringTable::Key                                                           key)
+{
+   if (key == 0)
+   {
+      return 0;
+   }
+
+   const auto iter = mapping.find(key);
+   if (iter == mapping.end())
+   {
+      throw std::runtime_error("Streamed translation unit refers to a string without a key");
+   }
+
+   return iter->second;
+}
+
+} // anonymous namespace
+
+std::size_t ftags::ProjectDb::TranslationUnit::computeStreamedSize(const RecordSpanManager&     recordSpanManager,
+                                                                  const std::vector<uint64_t>& referencedSpans) const
+{
+   assert(referencedSpans.size() == m_recordSpans.size());
+
+   std::size_t size = sizeof(ftags::util::SerializedObjectHeader) + sizeof(ftags::util::StringTable::Key) +
+                      sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint64_t) +
+                      ftags::util::Serializer<std::vector<Key>>::computeSerializedSize(m_dependencies) +
+                      sizeof(uint64_t);
+
+   for (std::size_t ii = 0; ii < m_recordSpans.size(); ii++)
+   {
+      // a reference is the content hash; otherwise the record count and the records
+      size += sizeof(uint64_t) + sizeof(uint64_t);
+      if (referencedSpans[ii] == 0)
+      {
+         size += recordSpanManager.getSpan(m_recordSpans[ii]).getSize() * sizeof(Record);
+      }
+   }
+
+   return size;
+}
+
+void ftags::ProjectDb::TranslationUnit::serializeStreamed(ftags::util::TypedInsertor&  insertor,
+                                                         const RecordSpanManager&     recordSpanManager,
+                                                         const std::vector<uint64_t>& referencedSpans,
+                                                         const StreamEncoder&         encoder) const
+{
+   assert(referencedSpans.size() == m_recordSpans.size());
+
+   // without a key dictionary the receiver translates the keys, from the strings sent with the delta
+   const bool useReceiverKeys = encoder.receiverKeysVersion != 0;
+
+   const auto translateFileNameKey = [useReceiverKeys, &encoder](Key key) {
+      return useReceiverKeys ? translateKey(encoder.receiverFileNameKeys, key) : key;
+   };
+
+   ftags::util::SerializedObjectHeader header{"ftags::StreamedTU"};
+   insertor << header;
+
+   assert(m_fileNameKey != 0);
+   insertor << translateFileNameKey(m_fileNameKey);
+
+   const uint64_t flags = m_isPartial ? k_partialFlag : 0;
+   insertor << flags;
+
+   insertor << encoder.receiverKeysVersion;
+
+   insertor << m_fingerprint;
+   insertor << m_parseNanoseconds;
+
+   std::vector<Key> dependencies{m_dependencies};
+   std::transform(dependencies.begin(), dependencies.end(), dependencies.begin(), translateFileNameKey);
+   ftags::util::Serializer<std::vector<Key>>::serialize(dependencies, insertor);
+
+   const uint64_t recordSpanCount = m_recordSpans.size();
+   insertor << recordSpanCount;
+
+   std::vector<Record> records;
+
+   for (std::size_t ii = 0; ii < m_recordSpans.size(); ii++)
+   {
+      const uint64_t isReference = (referencedSpans[ii] != 0) ? 1 : 0;
+      insertor << isReference;
+
+      if (isReference != 0)
+      {
+         insertor << referencedSpans[ii];
+         continue;
+      }
+
+      recordSpanManager.getSpan(m_recordSpans[ii]).copyRecordsTo(records);
+
+      if (useReceiverKeys)
+      {
+         for (Record& record : records)
+         {
+            record.symbolNameKey = translateKey(encoder.receiverSymbolKeys, record.symbolNameKey);
+            record.setLocationFileKey(translateFileNameKey(record.location.fileNameKey));
+            record.setDefinitionFileKey(translateFileNameKey(record.definition.fileNameKey));
+         }
+      }
+
+      const uint64_t recordCount = records.size();
+      insertor << recordCount;
+      insertor << records;
+   }
+}
+
+ftags::ProjectDb::TranslationUnit
+ftags::ProjectDb::TranslationUnit::deserializeStreamed(ftags::util::TypedExtractor& extractor,
+                                                       const StreamDecoder&         decoder,
+                                                       RecordSpanManager&           recordSpanManager)
+{
+   ftags::ProjectDb::TranslationUnit retval;
+
+   ftags::util::SerializedObjectHeader header = {};
+   extractor >> header;
+
+   Key fileNameKey = 0;
+   extractor >> fileNameKey;
+
+   uint64_t flags = 0;
+   extractor >> flags;
+   retval.m_isPartial = (flags & k_partialFlag) != 0;
+
+   // the keys are already the receiver's if the sender used a copy of its key dictionary
+   uint64_t receiverKeysVersion = 0;
+   extractor >> receiverKeysVersion;
+
+   const bool useReceiverKeys = receiverKeysVersion != 0;
+   if (useReceiverKeys && (receiverKeysVersion != decoder.keyDictionaryVersion))
+   {
+      throw std::runtime_error("Streamed translation unit uses the keys of another string table");
+   }
+
+   const auto translateFileNameKey = [useReceiverKeys, &decoder](Key key) {
+      return useReceiverKeys ? key : translateKey(decoder.fileNameKeys, key);
+   };
+
+   retval.m_fileNameKey = translateFileNameKey(fileNameKey);
+   if (retval.m_fileNameKey == 0)
+   {
+      throw std::runtime_error("Streamed translation unit has no file name");
+   }
+
+   extractor >> retval.m_fingerprint;
+   extractor >> retval.m_parseNanoseconds;
+
+   retval.m_dependencies = ftags::util::Serializer<std::vector<Key>>::deserialize(extractor);
+   std::transform(retval.m_dependencies.begin(),
+                  retval.m_dependencies.end(),
+                  retval.m_dependencies.begin(),
+                  translateFileNameKey);
+
+   uint64_t recordSpanCount = 0;
+   extractor >> recordSpanCount;
+
+   try
+   {
+      for (uint64_t ii = 0; ii < recordSpanCount; ii++)
+      {
+         uint64_t isReference = 0;
+         extractor >> isReference;
+
+         if (isReference != 0)
+         {
+            uint64_t contentHash = 0;
+            extractor >> contentHash;
+
+            const auto recordSpanKey = recordSpanManager.findSpanByContentHash(contentHash);
+            if (recordSpanKey == 0)
+            {
+               throw std::runtime_error("Streamed translation unit refers to a record span which was not sent");
+            }
+
+            recordSpanManager.getSpan(recordSpanKey).addRef();
+            retval.m_recordSpans.push_back(recordSpanKey);
+            continue;
+         }
+
+         uint64_t recordCount = 0;
+         extractor >> recordCount;
+
+         std::vector<Record> records(/* __n = */ recordCount);
+         extractor >> records;
+
+         if (!useReceiverKeys)
+         {
+            for (Record& record : records)
+            {
+               record.symbolNameKey = translateKey(decoder.symbolKeys, record.symbolNameKey);
+               record.setLocationFileKey(translateKey(decoder.fileNameKeys, record.location.fileNameKey));
+               record.setDefinitionFileKey(translateKey(decoder.fileNameKeys, record.definition.fileNameKey));
+            }
+         }
+
+         retval.m_recordSpans.push_back(recordSpanManager.addSpan(records));
+      }
+   }
+   catch (...)
+   {
+      retval.releaseRecordSpans(recordSpanManager);
+      throw;
+   }
+
+   return retval;
+}
+
+uint64_t ftags::ProjectDb::TranslationUnit::computeFingerprint(const std::vector<const char*>& arguments,
+                                                              const std::vector<uint64_t>&    dependencyHashes)
+{
+   SpookyHash hash = {};
+
+   hash.Init(k_fingerprintSeed[0], k_fingerprintSeed[1]);
+
+   for (const char* argument : arguments)
+   {
+      // include the terminator, so the boundaries between arguments are significant
+      hash.Update(argument, strlen(argument) + 1);
+   }
+
+   hash.Update(dependencyHashes.data(), dependencyHashes.size() * sizeof(uint64_t));
+
+   uint64_t hash1 = 0;
+   uint64_t hash2 = 0;
+   hash.Final(&hash1, &hash2);
+
+   return hash1;
+}
+
+uint64_t ftags::ProjectDb::TranslationUnit::hashContents(const char* contents, std::size_t size)
+{
+   return SpookyHash::Hash64(contents, size, k_fingerprintSeed[0]);
+}
+
+uint64_t ftags::ProjectDb::TranslationUnit::hashFile(const std::string& fileName)
+{
+   std::ifstream input(fileName, std::ios::binary | std::ios::ate);
+   if (!input)
+   {
+      return 0;
+   }
+
+   std::vector<char> contents(static_cast<std::size_t>(input.tellg()));
+   input.seekg(0);
+   if (!input.read(contents.data(), static_cast<std::streamsize>(contents.size())))
+   {
+      return 0;
+   }
+
+   return hashContents(contents.data(), contents.size());
+}
+
 #if (!defined(NDEBUG)) && (defined(ENABLE_THOROUGH_VALIDITY_CHECKS))
 void ftags::ProjectDb::TranslationUnit::assertValid() const
 {
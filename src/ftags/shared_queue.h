@@ -20,6 +20,7 @@
 #include <condition_variable>
 #include <mutex>
 #include <queue>
+#include <utility>
 
 namespace ftags
 {
@@ -42,7 +43,7 @@ public:
    {
       std::lock_guard<std::mutex> lock{m_mutex};
 
-      m_data.push(value);
+      m_data.push(std::move(value));
       m_dataNotEmpty.notify_one();
    }
 
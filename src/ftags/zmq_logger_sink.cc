@@ -56,7 +56,7 @@ void ftags::ZmqPublisher::publish(::spdlog::level::level_enum level, const std::
 
 ftags::ZmqCentralLogger::ZmqCentralLogger(zmq::context_t& context, const std::string& name)
 {
-   auto sink = std::make_shared<ftags::ZmqLoggerSinkSinglethreaded>(context, name);
+   auto sink = std::make_shared<ftags::ZmqLoggerSinkMultithreaded>(context, name);
 
    // TODO: save default logger and restore it in the destructor
 
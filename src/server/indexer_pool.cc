@@ -0,0 +1,197 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <indexer_pool.h>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <cerrno>
+#include <cstring>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+ftags::IndexerPool::IndexerPool(std::string indexerPath,
+                                unsigned    indexerCount,
+                                unsigned    threadCount,
+                                unsigned    idleExitSeconds) :
+   m_indexerPath{std::move(indexerPath)},
+   m_threadCount{threadCount},
+   m_idleExitSeconds{idleExitSeconds},
+   m_indexers(/* __n = */ indexerCount)
+{
+}
+
+ftags::IndexerPool::~IndexerPool() noexcept
+{
+   stop();
+}
+
+void ftags::IndexerPool::start()
+{
+   for (std::size_t ii = 0; ii < m_indexers.size(); ii++)
+   {
+      Indexer& indexer = m_indexers[ii];
+
+      // a new scan may bring sources the indexer can parse
+      indexer.quickCrashCount = 0;
+
+      if (indexer.pid == 0)
+      {
+         spawn(ii);
+      }
+   }
+}
+
+void ftags::IndexerPool::monitor()
+{
+   for (std::size_t ii = 0; ii < m_indexers.size(); ii++)
+   {
+      Indexer& indexer = m_indexers[ii];
+      if (indexer.pid == 0)
+      {
+         continue;
+      }
+
+      int         status = 0;
+      const pid_t pid    = waitpid(indexer.pid, &status, WNOHANG);
+      if (pid == 0)
+      {
+         continue;
+      }
+
+      indexer.pid = 0;
+
+      if ((pid > 0) && WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+      {
+         spdlog::info("Indexer {} exited", ii);
+         continue;
+      }
+
+      if ((pid > 0) && WIFSIGNALED(status))
+      {
+         spdlog::error("Indexer {} was terminated by signal {}", ii, WTERMSIG(status));
+      }
+      else
+      {
+         spdlog::error("Indexer {} failed", ii);
+      }
+
+      if (std::chrono::steady_clock::now() - indexer.startTime < k_quickCrashInterval)
+      {
+         indexer.quickCrashCount++;
+      }
+      else
+      {
+         indexer.quickCrashCount = 0;
+      }
+
+      if (indexer.quickCrashCount >= k_maxQuickCrashCount)
+      {
+         spdlog::error("Indexer {} keeps crashing; not restarting it until the next scan", ii);
+         continue;
+      }
+
+      spawn(ii);
+   }
+}
+
+unsigned ftags::IndexerPool::getRunningCount() const noexcept
+{
+   return static_cast<unsigned>(
+      std::count_if(m_indexers.cbegin(), m_indexers.cend(), [](const Indexer& indexer) { return indexer.pid != 0; }));
+}
+
+void ftags::IndexerPool::spawn(std::size_t index)
+{
+   Indexer& indexer = m_indexers[index];
+
+   /*
+    * The worker id stays the same across restarts, so the scanner can tell that the batch it
+    * handed out to the previous process was lost.
+    */
+   const std::string threadCount     = std::to_string(m_threadCount);
+   const std::string workerId        = fmt::format("indexer-{}", index);
+   const std::string idleExitSeconds = std::to_string(m_idleExitSeconds);
+
+   std::vector<char*> arguments = {const_cast<char*>(m_indexerPath.c_str()),
+                                   const_cast<char*>("--threads"),
+                                   const_cast<char*>(threadCount.c_str()),
+                                   const_cast<char*>("--worker-id"),
+                                   const_cast<char*>(workerId.c_str()),
+                                   const_cast<char*>("--idle-exit"),
+                                   const_cast<char*>(idleExitSeconds.c_str()),
+                                   nullptr};
+
+   const pid_t pid = fork();
+   if (pid == 0)
+   {
+      execv(arguments[0], arguments.data());
+      _exit(127);
+   }
+
+   if (pid < 0)
+   {
+      spdlog::error("Failed to start indexer {}: {}", index, strerror(errno));
+      return;
+   }
+
+   indexer.pid       = pid;
+   indexer.startTime = std::chrono::steady_clock::now();
+
+   spdlog::info("Started indexer {} as process {}", index, pid);
+}
+
+void ftags::IndexerPool::stop() noexcept
+{
+   for (const auto& indexer : m_indexers)
+   {
+      if (indexer.pid != 0)
+      {
+         kill(indexer.pid, SIGTERM);
+      }
+   }
+
+   // an idle indexer notices the signal within a second; one which is busy parsing is killed
+   const auto deadline = std::chrono::steady_clock::now() + k_stopTimeout;
+
+   for (auto& indexer : m_indexers)
+   {
+      while (indexer.pid != 0)
+      {
+         int status = 0;
+         if (waitpid(indexer.pid, &status, WNOHANG) != 0)
+         {
+            indexer.pid = 0;
+         }
+         else if (std::chrono::steady_clock::now() > deadline)
+         {
+            kill(indexer.pid, SIGKILL);
+            waitpid(indexer.pid, &status, 0);
+            indexer.pid = 0;
+         }
+         else
+         {
+            using namespace std::chrono_literals;
+            std::this_thread::sleep_for(100ms);
+         }
+      }
+   }
+}
@@ -0,0 +1,86 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef FTAGS_SERVER_INDEXER_POOL_H_INCLUDED
+#define FTAGS_SERVER_INDEXER_POOL_H_INCLUDED
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace ftags
+{
+
+/*
+ * Indexer processes started and supervised by the server.
+ *
+ * The indexers are started when a scan begins and exit on their own once they have been idle for
+ * a while. An indexer which crashes, typically inside libclang, is started again under the same
+ * worker id; the scanner hands the batch it was working on to the next indexer which asks.
+ */
+class IndexerPool
+{
+public:
+   IndexerPool(std::string indexerPath, unsigned indexerCount, unsigned threadCount, unsigned idleExitSeconds);
+
+   IndexerPool(const IndexerPool& other) = delete;
+   IndexerPool& operator=(const IndexerPool& other) = delete;
+
+   // stops the indexers which are still running
+   ~IndexerPool() noexcept;
+
+   // starts the indexers which are not running
+   void start();
+
+   // collects the indexers which exited, and starts again the ones which crashed
+   void monitor();
+
+   unsigned getRunningCount() const noexcept;
+
+private:
+   struct Indexer
+   {
+      pid_t                                 pid = 0;
+      std::chrono::steady_clock::time_point startTime;
+
+      // crashes shortly after starting, one after the other
+      unsigned quickCrashCount = 0;
+   };
+
+   void spawn(std::size_t index);
+
+   void stop() noexcept;
+
+   std::string m_indexerPath;
+   unsigned    m_threadCount;
+   unsigned    m_idleExitSeconds;
+
+   std::vector<Indexer> m_indexers;
+
+   // an indexer which crashes this soon after starting probably cannot parse its batch at all
+   static constexpr std::chrono::seconds k_quickCrashInterval{10};
+
+   // after this many quick crashes in a row the indexer is not started again until the next scan
+   static constexpr unsigned k_maxQuickCrashCount = 5;
+
+   static constexpr std::chrono::seconds k_stopTimeout{5};
+};
+
+} // namespace ftags
+
+#endif // FTAGS_SERVER_INDEXER_POOL_H_INCLUDED
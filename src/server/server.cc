@@ -14,6 +14,7 @@
    limitations under the License.
 */
 
+#include <indexer_pool.h>
 #include <project.h>
 #include <serialization_iostream.h>
 #include <serialization_legacy.h>
@@ -26,22 +27,117 @@
 
 #include <clara.hpp>
 
+#include <clang-c/CXCompilationDatabase.h>
+
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <deque>
 #include <filesystem>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <cstdlib>
 #include <ctime>
 
 namespace
 {
+
+// the query threads and the ingest thread get their requests from the front end on these
+const char* const k_QueryEndpoint  = "inproc://ftags_queries";
+const char* const k_IngestEndpoint = "inproc://ftags_ingest";
+
+// the longest the ingest thread waits for the interactive queries before it takes the lock anyway
+const int k_MaxIngestPauseMs = 100;
+
+/*
+ * The projects are read by the query threads, and changed only by the ingest thread, which does
+ * not need the lock to read them. The lock lets in many readers at once, or the ingest thread
+ * alone. The projects are never removed, so a pointer to one remains valid without the lock.
+ */
+struct SharedProjects
+{
+   std::shared_mutex                        mutex;
+   std::map<std::string, ftags::ProjectDb>  projects;
+   std::map<std::string, ftags::ProjectDb*> projectsByPath;
+
+   // the interactive queries received by the front end and not answered yet
+   std::atomic<unsigned> pendingInteractiveQueries{0};
+};
+
+/*
+ * The queries are served in the order of their class: the user waits for the interactive ones, while
+ * nobody waits for the background ones, such as the scans, the saves and the analyses.
+ */
+enum class RequestClass : uint8_t
+{
+   Interactive,
+   Background,
+};
+
+const std::size_t k_RequestClassCount = 2;
+
+RequestClass classifyRequest(const ftags::Command& command)
+{
+   switch (command.type())
+   {
+   case ftags::Command_Type::Command_Type_QUERY:
+   case ftags::Command_Type::Command_Type_DUMP_TRANSLATION_UNIT:
+   case ftags::Command_Type::Command_Type_LIST_PROJECTS:
+   case ftags::Command_Type::Command_Type_QUERY_STATISTICS:
+      return RequestClass::Interactive;
+
+   default:
+      return RequestClass::Background;
+   }
+}
+
+/*
+ * Gives the interactive queries waiting for the lock a head start, but only for a while, so that a
+ * steady stream of queries does not hold up the updates indefinitely.
+ */
+void waitForInteractiveQueries(const SharedProjects& sharedProjects)
+{
+   const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{k_MaxIngestPauseMs};
+   while ((sharedProjects.pendingInteractiveQueries > 0) && (std::chrono::steady_clock::now() < deadline))
+   {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+   }
+}
+
+// every change made by the ingest thread starts here
+std::unique_lock<std::shared_mutex> lockForIngest(SharedProjects& sharedProjects)
+{
+   waitForInteractiveQueries(sharedProjects);
+   return std::unique_lock<std::shared_mutex>{sharedProjects.mutex};
+}
+
+/*
+ * Called by the ingest thread between the slices of a long change, while the project is consistent,
+ * so that an interactive query waits for one slice rather than for the whole change.
+ */
+void yieldToInteractiveQueries(SharedProjects& sharedProjects, std::unique_lock<std::shared_mutex>& lock)
+{
+   if (sharedProjects.pendingInteractiveQueries > 0)
+   {
+      lock.unlock();
+      waitForInteractiveQueries(sharedProjects);
+      lock.lock();
+   }
+}
+
 std::string getTimeStamp()
 {
    auto now       = std::chrono::system_clock::now();
@@ -74,46 +170,139 @@ void reportUnknownProject(zmq::socket_t&                                 socket,
    socket.send(reply);
 }
 
-void dispatchFind(zmq::socket_t&                socket,
-                  const ftags::ProjectDb*       projectDb,
-                  ftags::Command_QueryType      queryType,
-                  ftags::Command_QueryQualifier queryQualifier,
-                  const std::string&            symbolName)
+// the records of a reply are sent in cursor sets of at most this many records, one per frame
+const std::size_t k_MaxRecordsPerResultFrame = 1024;
+
+/*
+ * Sends the status, then the records in cursor sets of bounded size, so that neither side builds
+ * the whole reply in one buffer, and the client can print each set as it decodes it.
+ */
+void sendQueryResults(zmq::socket_t&                           socket,
+                      const ftags::ProjectDb*                  projectDb,
+                      ftags::Status&                           status,
+                      const std::vector<const ftags::Record*>& records)
 {
-   ftags::Status status{};
-   status.set_timestamp(getTimeStamp());
+   status.set_type(records.empty() ? ftags::Status_Type::Status_Type_QUERY_NO_RESULTS
+                                   : ftags::Status_Type::Status_Type_QUERY_RESULTS);
+   status.set_resultcount(static_cast<int32_t>(records.size()));
 
-   spdlog::info("Received {} {} query for '{}' in project {}",
-                ftags::Command_QueryType_Name(queryType),
-                ftags::Command::QueryQualifier_Name(queryQualifier),
-                symbolName,
-                projectDb->getName());
-   const std::vector<const ftags::Record*> queryResultsVector = projectDb->findSymbol(symbolName);
-   spdlog::info("Found {} occurrences for '{}'", queryResultsVector.size(), symbolName);
+   const std::size_t headerSize = status.ByteSizeLong();
+   zmq::message_t    reply(headerSize);
+   status.SerializeToArray(reply.data(), static_cast<int>(headerSize));
+   socket.send(reply, records.empty() ? 0 : ZMQ_SNDMORE);
 
-   std::string serializedStatus;
+   for (std::size_t frameBegin = 0; frameBegin < records.size(); frameBegin += k_MaxRecordsPerResultFrame)
+   {
+      const std::size_t frameEnd = std::min(frameBegin + k_MaxRecordsPerResultFrame, records.size());
+
+      const std::vector<const ftags::Record*> frameRecords{
+         std::next(records.cbegin(), static_cast<std::ptrdiff_t>(frameBegin)),
+         std::next(records.cbegin(), static_cast<std::ptrdiff_t>(frameEnd))};
+      const ftags::CursorSet queryResultsCursor = projectDb->inflateRecords(frameRecords);
+
+      const std::size_t           payloadSize = queryResultsCursor.computeSerializedSize();
+      zmq::message_t              resultsMessage(payloadSize);
+      ftags::util::BufferInsertor insertor(static_cast<std::byte*>(resultsMessage.data()), payloadSize);
+      queryResultsCursor.serialize(insertor.getInsertor());
+      socket.send(resultsMessage, (frameEnd < records.size()) ? ZMQ_SNDMORE : 0);
+   }
+}
 
-   if (queryResultsVector.empty())
+/*
+ * The records of the references only tell what kind of reference they are, not what they refer to,
+ * so a query for a type of symbol matches the kinds of references which are specific to it.
+ */
+std::vector<ftags::SymbolType> getQuerySymbolTypes(ftags::Command_QueryType queryType)
+{
+   switch (queryType)
    {
-      status.set_type(ftags::Status_Type::Status_Type_QUERY_NO_RESULTS);
+   case ftags::Command_QueryType::Command_QueryType_FUNCTION:
+      return {ftags::SymbolType::FunctionDeclaration,
+              ftags::SymbolType::MethodDeclaration,
+              ftags::SymbolType::Constructor,
+              ftags::SymbolType::Destructor,
+              ftags::SymbolType::ConversionFunction,
+              ftags::SymbolType::FunctionTemplate,
+              ftags::SymbolType::FunctionCallExpression,
+              ftags::SymbolType::OverloadedDeclarationReference};
+
+   case ftags::Command_QueryType::Command_QueryType_CLASS:
+      return {ftags::SymbolType::StructDeclaration,
+              ftags::SymbolType::UnionDeclaration,
+              ftags::SymbolType::ClassDeclaration,
+              ftags::SymbolType::ClassTemplate,
+              ftags::SymbolType::ClassTemplatePartialSpecialization,
+              ftags::SymbolType::TypeReference,
+              ftags::SymbolType::TemplateReference,
+              ftags::SymbolType::BaseSpecifier};
+
+   case ftags::Command_QueryType::Command_QueryType_VARIABLE:
+      return {ftags::SymbolType::VariableDeclaration,
+              ftags::SymbolType::FieldDeclaration,
+              ftags::SymbolType::VariableReference,
+              ftags::SymbolType::MemberReference,
+              ftags::SymbolType::MemberReferenceExpression,
+              ftags::SymbolType::DeclarationReferenceExpression};
+
+   case ftags::Command_QueryType::Command_QueryType_PARAMETER:
+      return {ftags::SymbolType::ParameterDeclaration, ftags::SymbolType::DeclarationReferenceExpression};
+
+   default:
+      // any type of symbol
+      return {};
    }
-   else
+}
+
+ftags::ProjectDb::SymbolQualifier getQuerySymbolQualifier(ftags::Command_QueryQualifier queryQualifier)
+{
+   switch (queryQualifier)
    {
-      status.set_type(ftags::Status_Type::Status_Type_QUERY_RESULTS);
+   case ftags::Command_QueryQualifier::Command_QueryQualifier_DECLARATION:
+      return ftags::ProjectDb::SymbolQualifier::Declaration;
+
+   case ftags::Command_QueryQualifier::Command_QueryQualifier_DEFINITION:
+      return ftags::ProjectDb::SymbolQualifier::Definition;
+
+   case ftags::Command_QueryQualifier::Command_QueryQualifier_REFERENCE:
+      return ftags::ProjectDb::SymbolQualifier::Reference;
+
+   case ftags::Command_QueryQualifier::Command_QueryQualifier_INSTANTIATION:
+      return ftags::ProjectDb::SymbolQualifier::Instantiation;
+
+   case ftags::Command_QueryQualifier::Command_QueryQualifier_DESTRUCTION:
+      return ftags::ProjectDb::SymbolQualifier::Destruction;
+
+   default:
+      return ftags::ProjectDb::SymbolQualifier::Any;
    }
+}
 
-   const std::size_t headerSize = status.ByteSizeLong();
-   zmq::message_t    reply(headerSize);
-   status.SerializeToArray(reply.data(), static_cast<int>(headerSize));
-   socket.send(reply, ZMQ_SNDMORE);
+void dispatchFind(zmq::socket_t& socket, const ftags::ProjectDb* projectDb, const ftags::Command& command)
+{
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+
+   const std::string& symbolName = command.symbolname();
+
+   spdlog::info("Received {} {} query for '{}' in project {}",
+                ftags::Command_QueryType_Name(command.querytype()),
+                ftags::Command::QueryQualifier_Name(command.queryqualifier()),
+                symbolName,
+                projectDb->getName());
+
+   ftags::ProjectDb::SymbolQuery symbolQuery{getQuerySymbolTypes(command.querytype()),
+                                             getQuerySymbolQualifier(command.queryqualifier())};
+   symbolQuery.offset = command.resultoffset();
+   symbolQuery.limit  = command.resultlimit();
+
+   bool                                    hasMoreResults = false;
+   const std::vector<const ftags::Record*> queryResultsVector =
+      projectDb->findSymbol(symbolName, symbolQuery, hasMoreResults);
+   spdlog::info("Found {} occurrences for '{}'", queryResultsVector.size(), symbolName);
 
-   const ftags::CursorSet queryResultsCursor = projectDb->inflateRecords(queryResultsVector);
+   status.set_hasmoreresults(hasMoreResults);
 
-   const std::size_t           payloadSize = queryResultsCursor.computeSerializedSize();
-   zmq::message_t              resultsMessage(payloadSize);
-   ftags::util::BufferInsertor insertor(static_cast<std::byte*>(resultsMessage.data()), payloadSize);
-   queryResultsCursor.serialize(insertor.getInsertor());
-   socket.send(resultsMessage);
+   sendQueryResults(socket, projectDb, status, queryResultsVector);
 }
 
 void dispatchQueryIdentify(zmq::socket_t&          socket,
@@ -130,29 +319,7 @@ void dispatchQueryIdentify(zmq::socket_t&          socket,
       projectDb->identifySymbol(fileName, lineNumber, columnNumber);
    spdlog::info("Found {} records for {}:{}:{}", queryResultsVector.size(), fileName, lineNumber, columnNumber);
 
-   std::string serializedStatus;
-
-   if (queryResultsVector.empty())
-   {
-      status.set_type(ftags::Status_Type::Status_Type_QUERY_NO_RESULTS);
-   }
-   else
-   {
-      status.set_type(ftags::Status_Type::Status_Type_QUERY_RESULTS);
-   }
-
-   const std::size_t headerSize = status.ByteSizeLong();
-   zmq::message_t    reply(headerSize);
-   status.SerializeToArray(reply.data(), static_cast<int>(headerSize));
-   socket.send(reply, ZMQ_SNDMORE);
-
-   const ftags::CursorSet queryResultsCursor = projectDb->inflateRecords(queryResultsVector);
-
-   const std::size_t           payloadSize = queryResultsCursor.computeSerializedSize();
-   zmq::message_t              resultsMessage(payloadSize);
-   ftags::util::BufferInsertor insertor(static_cast<std::byte*>(resultsMessage.data()), payloadSize);
-   queryResultsCursor.serialize(insertor.getInsertor());
-   socket.send(resultsMessage);
+   sendQueryResults(socket, projectDb, status, queryResultsVector);
 }
 
 void dispatchDumpTranslationUnit(zmq::socket_t&          socket,
@@ -165,37 +332,78 @@ void dispatchDumpTranslationUnit(zmq::socket_t&          socket,
    spdlog::info("Received dump request for {}", fileName);
    const std::vector<const ftags::Record*> queryResultsVector = projectDb->dumpTranslationUnit(fileName);
 
-   std::string serializedStatus;
+   sendQueryResults(socket, projectDb, status, queryResultsVector);
+}
+
+ftags::ParsingStatistics getParsingStatistics(const ftags::IndexingStatistics& indexingStatistics)
+{
+   using Phase = ftags::ParsingStatistics::Phase;
 
-   if (queryResultsVector.empty())
-   {
-      status.set_type(ftags::Status_Type::Status_Type_QUERY_NO_RESULTS);
-   }
-   else
+   ftags::ParsingStatistics parsingStatistics{};
+
+   parsingStatistics.getPhaseNanoseconds(Phase::Parse)       = indexingStatistics.parsenanoseconds();
+   parsingStatistics.getPhaseNanoseconds(Phase::Visit)       = indexingStatistics.visitnanoseconds();
+   parsingStatistics.getPhaseNanoseconds(Phase::SymbolTable) = indexingStatistics.symboltablenanoseconds();
+   parsingStatistics.getPhaseNanoseconds(Phase::RecordSpans) = indexingStatistics.recordspansnanoseconds();
+
+   parsingStatistics.translationUnits  = indexingStatistics.translationunits();
+   parsingStatistics.cursorsVisited    = indexingStatistics.cursorsvisited();
+   parsingStatistics.cursorsKept       = indexingStatistics.cursorskept();
+   parsingStatistics.recordsEmitted    = indexingStatistics.recordsemitted();
+   parsingStatistics.newSpans          = indexingStatistics.newspans();
+   parsingStatistics.deduplicatedSpans = indexingStatistics.deduplicatedspans();
+   parsingStatistics.bytesAdded        = indexingStatistics.bytesadded();
+
+   return parsingStatistics;
+}
+
+/*
+ * Finds the project the indexer parsed for, creating it if this is the first fragment; the caller
+ * holds the lock for writing.
+ */
+ftags::ProjectDb* getOrCreateProject(SharedProjects& sharedProjects, const ftags::Command& command)
+{
+   auto& projects       = sharedProjects.projects;
+   auto& projectsByPath = sharedProjects.projectsByPath;
+
+   auto iter = projects.find(command.projectname());
+   if (iter != projects.end())
    {
-      status.set_type(ftags::Status_Type::Status_Type_QUERY_RESULTS);
+      return &iter->second;
    }
 
-   const std::size_t headerSize = status.ByteSizeLong();
-   zmq::message_t    reply(headerSize);
-   status.SerializeToArray(reply.data(), static_cast<int>(headerSize));
-   socket.send(reply, ZMQ_SNDMORE);
+   spdlog::info(fmt::format("Creating new project: {} in {}", command.projectname(), command.directoryname()));
+   iter = projects
+             .emplace(command.projectname(),
+                      ftags::ProjectDb(/* name = */ command.projectname(),
+                                       /* rootDirectory = */ command.directoryname()))
+             .first;
+
+   ftags::ProjectDb* projectDb = &iter->second;
+   projectsByPath.emplace(command.directoryname(), projectDb);
+
+#ifndef NDEBUG
+   // self-check
+   {
+      for (const auto& [name, project] : projects)
+      {
+         assert(name == project.getName());
+      }
 
-   const ftags::CursorSet queryResultsCursor = projectDb->inflateRecords(queryResultsVector);
+      for (const auto& [path, project] : projectsByPath)
+      {
+         assert(path == project->getRoot());
+      }
+   }
+#endif
 
-   const std::size_t           payloadSize = queryResultsCursor.computeSerializedSize();
-   zmq::message_t              resultsMessage(payloadSize);
-   ftags::util::BufferInsertor insertor(static_cast<std::byte*>(resultsMessage.data()), payloadSize);
-   queryResultsCursor.serialize(insertor.getInsertor());
-   socket.send(resultsMessage);
+   return projectDb;
 }
 
-void dispatchUpdateTranslationUnit(zmq::socket_t& socket, ftags::ProjectDb* projectDb, const std::string& fileName)
+// the fragments are deserialized before the projects are locked, so the queries go on meanwhile
+ftags::ProjectDb deserializeTranslationUnits(const std::string& projectName, zmq::message_t& payload)
 {
-   zmq::message_t payload;
-   socket.recv(&payload);
-
-   spdlog::info("Received {:n} bytes of serialized data for project {}", payload.size(), projectDb->getName());
+   spdlog::info("Received {:n} bytes of serialized data for project {}", payload.size(), projectName);
 
    ftags::util::BufferExtractor extractor(static_cast<std::byte*>(payload.data()), payload.size());
 
@@ -208,37 +416,50 @@ void dispatchUpdateTranslationUnit(zmq::socket_t& socket, ftags::ProjectDb* proj
                 updatedTranslationUnit.getSymbolCount(),
                 updatedTranslationUnit.getFilesCount());
 
+   return updatedTranslationUnit;
+}
+
+ftags::Status updateTranslationUnit(ftags::ProjectDb*                projectDb,
+                                    const std::string&               fileName,
+                                    const ftags::IndexingStatistics& indexingStatistics,
+                                    const ftags::ProjectDb&          updatedTranslationUnit,
+                                    const std::function<void()>&     betweenSlices)
+{
    projectDb->assertValid();
 
-   projectDb->updateFrom(fileName, updatedTranslationUnit);
+   projectDb->updateFrom(fileName, updatedTranslationUnit, betweenSlices);
 
    projectDb->assertValid();
 
+   // reported by the indexer; see the "parsing" statistics group
+   projectDb->addParsingStatistics(getParsingStatistics(indexingStatistics));
+
    ftags::Status status{};
    status.set_timestamp(getTimeStamp());
    status.set_type(ftags::Status_Type::Status_Type_TRANSLATION_UNIT_UPDATED);
+   status.set_projectname(projectDb->getName());
 
-   const std::size_t replySize = status.ByteSizeLong();
-   zmq::message_t    reply(replySize);
-   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
-
-   socket.send(reply);
-   spdlog::info("Acknowledged translation unit {}", fileName);
+   return status;
 }
 
-void dispatchQueryStatistics(zmq::socket_t&          socket,
-                             const ftags::ProjectDb* projectDb,
-                             const std::string&      statisticsGroup)
+void dispatchUpdateTranslationUnit(zmq::socket_t&        socket,
+                                   SharedProjects&       sharedProjects,
+                                   const ftags::Command& command)
 {
-   ftags::Status status{};
-   status.set_timestamp(getTimeStamp());
-   status.set_type(ftags::Status_Type::Status_Type_STATISTICS_REMARKS);
+   zmq::message_t payload;
+   socket.recv(&payload);
 
-   std::vector<std::string> statisticsRemarks = projectDb->getStatisticsRemarks(statisticsGroup);
+   const ftags::ProjectDb updatedTranslationUnit = deserializeTranslationUnits(command.projectname(), payload);
 
-   for (const auto& remark : statisticsRemarks)
+   ftags::Status status{};
    {
-      *status.add_remarks() = remark;
+      std::unique_lock<std::shared_mutex> lock = lockForIngest(sharedProjects);
+
+      ftags::ProjectDb* projectDb = getOrCreateProject(sharedProjects, command);
+      status                      = updateTranslationUnit(
+         projectDb, command.filename(), command.indexingstatistics(), updatedTranslationUnit, [&]() {
+            yieldToInteractiveQueries(sharedProjects, lock);
+         });
    }
 
    const std::size_t replySize = status.ByteSizeLong();
@@ -246,155 +467,644 @@ void dispatchQueryStatistics(zmq::socket_t&          socket,
    status.SerializeToArray(reply.data(), static_cast<int>(replySize));
 
    socket.send(reply);
+   spdlog::info("Acknowledged translation unit {}", command.filename());
 }
 
-void dispatchDataAnalysis(zmq::socket_t& socket, const ftags::ProjectDb* projectDb, const std::string& analysisType)
+/*
+ * The receiving end of a stream of translation units; an indexer starts a new stream for every batch,
+ * under the same name. The stream holds references to the record spans the indexer may refer to.
+ */
+struct TranslationUnitStream
 {
-   ftags::Status status{};
-   status.set_timestamp(getTimeStamp());
-   status.set_type(ftags::Status_Type::Status_Type_STATISTICS_REMARKS);
+   ftags::ProjectDb*                     projectDb = nullptr;
+   ftags::ProjectDb::StreamDecoder       decoder;
+   uint64_t                              nextSequence = 0;
+   std::chrono::steady_clock::time_point lastUsed;
+};
 
-   std::vector<std::string> statisticsRemarks = projectDb->analyzeData(analysisType);
+using TranslationUnitStreams = std::map<std::string, TranslationUnitStream>;
 
-   for (const auto& remark : statisticsRemarks)
-   {
-      *status.add_remarks() = remark;
-   }
+// the oldest stream is dropped when there are more than this many
+const std::size_t k_MaxTranslationUnitStreams = 256;
 
-   const std::size_t replySize = status.ByteSizeLong();
-   zmq::message_t    reply(replySize);
-   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+/*
+ * A stream unused for this long is dropped, with the references it holds on the record spans; the
+ * indexer uploads the translation units of a batch as soon as they are parsed, so it is done with it.
+ */
+const auto k_TranslationUnitStreamIdleTimeout = std::chrono::minutes{5};
 
-   socket.send(reply);
+void endTranslationUnitStream(TranslationUnitStreams& streams, TranslationUnitStreams::iterator iter)
+{
+   iter->second.projectDb->releaseStream(iter->second.decoder);
+   streams.erase(iter);
 }
 
-std::filesystem::path getFtagsCachePath()
+// drops the streams of the indexers which finished their batch or exited
+void expireTranslationUnitStreams(SharedProjects& sharedProjects, TranslationUnitStreams& streams)
 {
-   const char* xdgCacheHomeDirName = std::getenv("XDG_CACHE_HOME");
-
-   std::filesystem::path xdgCachePath;
+   const auto expiry = std::chrono::steady_clock::now() - k_TranslationUnitStreamIdleTimeout;
 
-   if (xdgCacheHomeDirName == nullptr)
-   {
-      const char* homeDirName = std::getenv("HOME");
-      if (homeDirName == nullptr)
-      {
-         throw(std::runtime_error("HOME environment variable is not defined"));
-      }
-
-      const std::filesystem::path homePath = std::filesystem::path{homeDirName};
-
-      if (!std::filesystem::exists(homePath))
-      {
-         throw(std::runtime_error(
-            fmt::format("HOME environment variable points to an invalid directory {}", homeDirName)));
-      }
+   const auto isExpired = [expiry](const auto& stream) {
+      return stream.second.lastUsed < expiry;
+   };
 
-      xdgCachePath = homePath / ".config";
-   }
-   else
+   if (std::none_of(streams.cbegin(), streams.cend(), isExpired))
    {
-      xdgCachePath = std::filesystem::path{xdgCacheHomeDirName};
+      return;
    }
 
-   if (!std::filesystem::exists(xdgCachePath))
-   {
-      std::error_code ec;
+   std::unique_lock<std::shared_mutex> lock = lockForIngest(sharedProjects);
 
-      const bool createdDir = std::filesystem::create_directory(xdgCachePath, ec);
-      if (createdDir)
+   for (auto iter = streams.begin(); iter != streams.end();)
+   {
+      if (isExpired(*iter))
       {
-         spdlog::warn("Created missing cache dir {}", xdgCachePath.string());
+         spdlog::info("Stream {} is idle; releasing its record spans", iter->first);
+         endTranslationUnitStream(streams, iter++);
       }
       else
       {
-         const std::string errorMessage{
-            fmt::format("Failed to create missing cache directory {}: {}", xdgCachePath.string(), ec.message())};
-         spdlog::error(errorMessage);
-         throw(std::runtime_error(errorMessage));
+         ++iter;
       }
    }
-
-   const std::filesystem::path ftagsCachePath = xdgCachePath / "ftags" / "project";
-
-   return ftagsCachePath;
 }
 
-std::filesystem::path getProjectSaveLocation(const std::string& projectDirName)
+/*
+ * Starts the stream over when the command is the first of a stream, then returns the stream if the
+ * command is the next one expected on it.
+ */
+TranslationUnitStream*
+findTranslationUnitStream(ftags::ProjectDb* projectDb, const ftags::Command& command, TranslationUnitStreams& streams)
 {
-   const std::filesystem::path ftagsCachePath = getFtagsCachePath();
+   auto iter = streams.find(command.streamname());
 
-   if (!std::filesystem::exists(ftagsCachePath))
+   if (command.streamsequence() == 0)
    {
-      std::error_code ec;
-
-      const bool createdDir = std::filesystem::create_directory(ftagsCachePath, ec);
-      if (createdDir)
+      if (iter != streams.end())
       {
-         spdlog::warn("Created missing ftags cache dir {}", ftagsCachePath.string());
+         endTranslationUnitStream(streams, iter);
       }
-      else
+      else if (streams.size() >= k_MaxTranslationUnitStreams)
       {
-         const std::string errorMessage{fmt::format(
-            "Failed to create missing ftags cache directory {}: {}", ftagsCachePath.string(), ec.message())};
-         spdlog::error(errorMessage);
-         throw(std::runtime_error(errorMessage));
+         endTranslationUnitStream(
+            streams, std::min_element(streams.begin(), streams.end(), [](const auto& left, const auto& right) {
+               return left.second.lastUsed < right.second.lastUsed;
+            }));
       }
+
+      iter                   = streams.emplace(command.streamname(), TranslationUnitStream{}).first;
+      iter->second.projectDb = projectDb;
+
+      iter->second.decoder.keyDictionaryVersion = projectDb->getKeyDictionaryVersion();
    }
 
-   const std::filesystem::path projectSourcePath{projectDirName};
+   if ((iter == streams.end()) || (iter->second.projectDb != projectDb) ||
+       (iter->second.nextSequence != command.streamsequence()))
+   {
+      spdlog::error("Command is out of sequence on stream {}", command.streamname());
+      return nullptr;
+   }
 
-   const std::filesystem::path projectSaveLocation = ftagsCachePath / projectSourcePath.relative_path();
+   iter->second.nextSequence++;
+   iter->second.lastUsed = std::chrono::steady_clock::now();
 
-   return projectSaveLocation;
+   return &iter->second;
 }
 
-std::vector<std::filesystem::path> getSavedProjects()
+/*
+ * An indexer offers the content hashes of the record spans of a batch before uploading it, and
+ * only sends the ones which are missing here; the others are sent as references.
+ */
+ftags::Status offerRecordSpans(ftags::ProjectDb*       projectDb,
+                               const ftags::Command&   command,
+                               zmq::message_t&         payload,
+                               TranslationUnitStreams& streams)
 {
-   std::vector<std::filesystem::path> retval;
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_projectname(projectDb->getName());
+   status.set_type(ftags::Status_Type::Status_Type_RECORD_SPANS_MISSING);
 
-   const std::filesystem::path ftagsCachePath = getFtagsCachePath();
+   // the indexer drops its copy of the key dictionary if the version changed
+   status.set_keydictionaryversion(projectDb->getKeyDictionaryVersion());
 
-   if (!std::filesystem::exists(ftagsCachePath))
-   {
-      return retval;
-   }
+   ftags::util::BufferExtractor extractor(static_cast<std::byte*>(payload.data()), payload.size());
 
-   for (auto& entry : std::filesystem::recursive_directory_iterator(ftagsCachePath))
+   const std::vector<uint64_t> offeredRecordSpans =
+      ftags::util::Serializer<std::vector<uint64_t>>::deserialize(extractor.getExtractor());
+
+   // without a stream to hold them, none of the spans can be referred to
+   TranslationUnitStream*      stream = findTranslationUnitStream(projectDb, command, streams);
+   const std::vector<uint64_t> missingRecordSpans =
+      (stream != nullptr) ? projectDb->findMissingRecordSpans(offeredRecordSpans, stream->decoder)
+                          : offeredRecordSpans;
+
+   spdlog::info("{} of {} record spans offered by {} need to be sent",
+                missingRecordSpans.size(),
+                offeredRecordSpans.size(),
+                command.streamname());
+
+   for (const uint64_t contentHash : missingRecordSpans)
    {
-      if (entry.is_regular_file())
-      {
-         spdlog::debug("Examining {}", entry.path().string());
-         if (entry.path().filename().string() == "project.data")
-         {
-            auto projectPath = std::filesystem::relative(entry.path().parent_path(), ftagsCachePath);
-            spdlog::info("Found saved project {}", projectPath.string());
-            retval.push_back(entry.path().parent_path());
-         }
-      }
+      status.add_recordspanhash(contentHash);
    }
 
-   spdlog::info("Found {} saved projects", retval.size());
-
-   return retval;
+   return status;
 }
 
-void dispatchSaveDatabase(zmq::socket_t&          socket,
-                          const ftags::ProjectDb* projectDb,
-                          const std::string&      projectName,
-                          const std::string&      projectDirectory)
+/*
+ * An indexer keeps a copy of the keys of the strings it uploaded, so it can upload the records with
+ * this project's keys instead of with its own strings; it asks for the keys of the strings it misses.
+ */
+ftags::Status resolveKeys(ftags::ProjectDb* projectDb, const ftags::Command& command)
 {
    ftags::Status status{};
    status.set_timestamp(getTimeStamp());
-   status.set_type(ftags::Status_Type::Status_Type_STATISTICS_REMARKS);
+   status.set_projectname(projectDb->getName());
+   status.set_type(ftags::Status_Type::Status_Type_KEYS_RESOLVED);
+   status.set_keydictionaryversion(projectDb->getKeyDictionaryVersion());
 
-   try
+   const std::vector<std::string> symbolNames(command.resolvesymbolname().cbegin(),
+                                              command.resolvesymbolname().cend());
+   const std::vector<std::string> fileNames(command.resolvefilename().cbegin(), command.resolvefilename().cend());
+
+   for (const ftags::util::StringTable::Key key : projectDb->resolveSymbolKeys(symbolNames))
    {
-      const std::filesystem::path saveLocation{getProjectSaveLocation(projectDirectory)};
+      status.add_symbolkey(key);
+   }
 
-      if (!std::filesystem::exists(saveLocation))
-      {
-         std::error_code ec;
+   for (const ftags::util::StringTable::Key key : projectDb->resolveFileNameKeys(fileNames))
+   {
+      status.add_filenamekey(key);
+   }
+
+   spdlog::info(
+      "Resolved {} symbols and {} file names for {}", symbolNames.size(), fileNames.size(), command.source());
+
+   return status;
+}
+
+ftags::Status updateTranslationUnitDelta(ftags::ProjectDb*       projectDb,
+                                         const ftags::Command&   command,
+                                         zmq::message_t&         payload,
+                                         TranslationUnitStreams& streams)
+{
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_projectname(projectDb->getName());
+   status.set_type(ftags::Status_Type::Status_Type_TRANSLATION_UNIT_UPDATE_FAILED);
+
+   TranslationUnitStream* stream = findTranslationUnitStream(projectDb, command, streams);
+   if (stream == nullptr)
+   {
+      return status;
+   }
+
+   try
+   {
+      ftags::util::BufferExtractor extractor(static_cast<std::byte*>(payload.data()), payload.size());
+
+      projectDb->addTranslationUnitDelta(extractor.getExtractor(), stream->decoder);
+   }
+   catch (const std::exception& ex)
+   {
+      spdlog::error("Failed to add translation unit {}: {}", command.filename(), ex.what());
+      endTranslationUnitStream(streams, streams.find(command.streamname()));
+
+      return status;
+   }
+
+   projectDb->assertValid();
+
+   projectDb->addParsingStatistics(getParsingStatistics(command.indexingstatistics()));
+
+   status.set_type(ftags::Status_Type::Status_Type_TRANSLATION_UNIT_UPDATED);
+   return status;
+}
+
+/*
+ * Fragments arrive on their own socket, as the indexer's identity, the command and the payload: either
+ * UPDATE_TRANSLATION_UNIT and a serialized database, or UPDATE_TRANSLATION_UNIT_DELTA and one streamed
+ * translation unit, or OFFER_RECORD_SPANS and the content hashes of the spans the indexer is about to
+ * send, or RESOLVE_KEYS and an empty payload. The indexers do not wait for the acknowledgement of an
+ * update before they parse further; it only returns them the credit to upload another fragment.
+ */
+void dispatchFragment(zmq::socket_t& fragmentSocket, SharedProjects& sharedProjects, TranslationUnitStreams& streams)
+{
+   zmq::message_t identity;
+   zmq::message_t header;
+   zmq::message_t payload;
+   fragmentSocket.recv(&identity);
+   fragmentSocket.recv(&header);
+   fragmentSocket.recv(&payload);
+
+   ftags::Command command{};
+   command.ParseFromArray(header.data(), static_cast<int>(header.size()));
+
+   ftags::Status status{};
+   if (command.type() == ftags::Command_Type::Command_Type_UPDATE_TRANSLATION_UNIT_DELTA)
+   {
+      spdlog::debug("Received {} from {}", command.filename(), command.streamname());
+
+      std::unique_lock<std::shared_mutex> lock = lockForIngest(sharedProjects);
+      ftags::ProjectDb* projectDb = getOrCreateProject(sharedProjects, command);
+      status                      = updateTranslationUnitDelta(projectDb, command, payload, streams);
+   }
+   else if (command.type() == ftags::Command_Type::Command_Type_OFFER_RECORD_SPANS)
+   {
+      // the stream takes references to the spans
+      std::unique_lock<std::shared_mutex> lock = lockForIngest(sharedProjects);
+      ftags::ProjectDb* projectDb = getOrCreateProject(sharedProjects, command);
+      status                      = offerRecordSpans(projectDb, command, payload, streams);
+   }
+   else if (command.type() == ftags::Command_Type::Command_Type_RESOLVE_KEYS)
+   {
+      std::unique_lock<std::shared_mutex> lock = lockForIngest(sharedProjects);
+      ftags::ProjectDb* projectDb = getOrCreateProject(sharedProjects, command);
+      status                      = resolveKeys(projectDb, command);
+   }
+   else
+   {
+      spdlog::info("Received fragment from {}", command.source());
+
+      const ftags::ProjectDb updatedTranslationUnit = deserializeTranslationUnits(command.projectname(), payload);
+
+      std::unique_lock<std::shared_mutex> lock = lockForIngest(sharedProjects);
+      ftags::ProjectDb* projectDb = getOrCreateProject(sharedProjects, command);
+      status                      = updateTranslationUnit(
+         projectDb, command.filename(), command.indexingstatistics(), updatedTranslationUnit, [&]() {
+            yieldToInteractiveQueries(sharedProjects, lock);
+         });
+   }
+
+   const std::size_t replySize = status.ByteSizeLong();
+   zmq::message_t    reply(replySize);
+   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+
+   fragmentSocket.send(identity, ZMQ_SNDMORE);
+   fragmentSocket.send(reply);
+}
+
+/*
+ * Looks up the compilation arguments for fileName in the compile_commands.json found in the project root,
+ * skipping -c and -o and their arguments, like the scanner does
+ */
+std::vector<std::string> getCompileArguments(const std::string& rootDirectory, const std::string& fileName)
+{
+   std::vector<std::string> arguments;
+
+   CXCompilationDatabase_Error ccderror = CXCompilationDatabase_NoError;
+   CXCompilationDatabase compilationDatabase =
+      clang_CompilationDatabase_fromDirectory(rootDirectory.c_str(), &ccderror);
+
+   if (CXCompilationDatabase_NoError == ccderror)
+   {
+      CXCompileCommands compileCommands =
+         clang_CompilationDatabase_getCompileCommands(compilationDatabase, fileName.c_str());
+
+      if ((compileCommands != nullptr) && (clang_CompileCommands_getSize(compileCommands) != 0))
+      {
+         CXCompileCommand compileCommand = clang_CompileCommands_getCommand(compileCommands, 0);
+
+         const unsigned argCount      = clang_CompileCommand_getNumArgs(compileCommand);
+         bool           skipFileNames = false;
+
+         for (unsigned jj = 0; jj < argCount; jj++)
+         {
+            if (skipFileNames)
+            {
+               skipFileNames = false;
+               continue;
+            }
+
+            CXString    cxString     = clang_CompileCommand_getArg(compileCommand, jj);
+            const char* argumentText = clang_getCString(cxString);
+
+            if ((argumentText[0] == '-') && ((argumentText[1] == 'c') || (argumentText[1] == 'o')))
+            {
+               skipFileNames = true;
+            }
+            else
+            {
+               arguments.emplace_back(argumentText);
+            }
+
+            clang_disposeString(cxString);
+         }
+      }
+
+      clang_CompileCommands_dispose(compileCommands);
+   }
+
+   clang_CompilationDatabase_dispose(compilationDatabase);
+
+   return arguments;
+}
+
+/*
+ * Reading the compilation database of a large project takes longer than parsing the buffer, so the
+ * arguments of the buffers are kept, by project root and file name, until compile_commands.json
+ * is modified. Only used by the ingest thread.
+ */
+class CompileArgumentsCache
+{
+public:
+   const std::vector<std::string>& getArguments(const std::string& rootDirectory, const std::string& fileName)
+   {
+      std::error_code                       errorCode;
+      const std::filesystem::file_time_type modified = std::filesystem::last_write_time(
+         std::filesystem::path{rootDirectory} / "compile_commands.json", errorCode);
+
+      ProjectArguments& projectArguments = m_projects[rootDirectory];
+      if (projectArguments.modified != modified)
+      {
+         projectArguments.modified = modified;
+         projectArguments.arguments.clear();
+      }
+
+      auto iter = projectArguments.arguments.find(fileName);
+      if (iter == projectArguments.arguments.end())
+      {
+         iter = projectArguments.arguments.emplace(fileName, getCompileArguments(rootDirectory, fileName)).first;
+      }
+
+      return iter->second;
+   }
+
+private:
+   struct ProjectArguments
+   {
+      std::filesystem::file_time_type                            modified = std::filesystem::file_time_type::min();
+      std::unordered_map<std::string, std::vector<std::string>> arguments;
+   };
+
+   std::map<std::string, ProjectArguments> m_projects;
+};
+
+/*
+ * The buffer is parsed into a database of its own, which is then merged into the project, so the
+ * project is locked only while merging.
+ */
+void dispatchUpdateBuffer(zmq::socket_t&         socket,
+                          SharedProjects&        sharedProjects,
+                          ftags::ProjectDb*      projectDb,
+                          ftags::ParsingSession& parsingSession,
+                          CompileArgumentsCache& compileArgumentsCache,
+                          const std::string&     fileName,
+                          const std::string&     contents)
+{
+   spdlog::info("Received {:n} bytes of unsaved contents for {}", contents.size(), fileName);
+
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+
+   const std::vector<std::string>& compileArguments =
+      compileArgumentsCache.getArguments(projectDb->getRoot(), fileName);
+
+   std::vector<const char*> arguments;
+   arguments.reserve(compileArguments.size());
+   for (const auto& argument : compileArguments)
+   {
+      arguments.push_back(argument.c_str());
+   }
+
+   if (arguments.empty())
+   {
+      status.set_type(ftags::Status_Type::Status_Type_TRANSLATION_UNIT_UPDATE_FAILED);
+      *status.add_remarks() = fmt::format("No compilation command for {}", fileName);
+   }
+   else
+   {
+      try
+      {
+         const auto startTimestamp = std::chrono::steady_clock::now();
+
+         ftags::ProjectDb bufferDb{/* name = */ projectDb->getName(), /* rootDirectory = */ projectDb->getRoot()};
+         bufferDb.reparseOneFile(parsingSession, fileName, arguments, contents, /* includeEverything = */ false);
+
+         {
+            // the buffer is a query in its own right, so it does not yield to the others
+            std::unique_lock<std::shared_mutex> lock{sharedProjects.mutex};
+            projectDb->updateFrom(fileName, bufferDb);
+         }
+
+         const auto endTimestamp = std::chrono::steady_clock::now();
+
+         status.set_type(ftags::Status_Type::Status_Type_TRANSLATION_UNIT_UPDATED);
+         *status.add_remarks() = fmt::format(
+            "Reindexed {} in {:n} ms",
+            fileName,
+            std::chrono::duration_cast<std::chrono::milliseconds>(endTimestamp - startTimestamp).count());
+      }
+      catch (const std::exception& ex)
+      {
+         status.set_type(ftags::Status_Type::Status_Type_TRANSLATION_UNIT_UPDATE_FAILED);
+         *status.add_remarks() = ex.what();
+      }
+   }
+
+   const std::size_t replySize = status.ByteSizeLong();
+   zmq::message_t    reply(replySize);
+   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+
+   socket.send(reply);
+}
+
+void dispatchFindDependentTranslationUnits(zmq::socket_t&          socket,
+                                           const ftags::ProjectDb* projectDb,
+                                           const ftags::Command&   command)
+{
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_type(ftags::Status_Type::Status_Type_DEPENDENT_TRANSLATION_UNITS);
+
+   const std::vector<std::string> fileNames(command.translationunit().begin(), command.translationunit().end());
+
+   for (auto& translationUnit : projectDb->findDependentTranslationUnits(fileNames))
+   {
+      *status.add_translationunit() = std::move(translationUnit);
+   }
+
+   spdlog::info("{} translation units depend on the {} changed files",
+                status.translationunit_size(),
+                command.translationunit_size());
+
+   const std::size_t replySize = status.ByteSizeLong();
+   zmq::message_t    reply(replySize);
+   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+
+   socket.send(reply);
+}
+
+void dispatchQueryStatistics(zmq::socket_t&          socket,
+                             const ftags::ProjectDb* projectDb,
+                             const std::string&      statisticsGroup)
+{
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_type(ftags::Status_Type::Status_Type_STATISTICS_REMARKS);
+
+   std::vector<std::string> statisticsRemarks = projectDb->getStatisticsRemarks(statisticsGroup);
+
+   for (const auto& remark : statisticsRemarks)
+   {
+      *status.add_remarks() = remark;
+   }
+
+   const std::size_t replySize = status.ByteSizeLong();
+   zmq::message_t    reply(replySize);
+   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+
+   socket.send(reply);
+}
+
+void dispatchDataAnalysis(zmq::socket_t& socket, const ftags::ProjectDb* projectDb, const std::string& analysisType)
+{
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_type(ftags::Status_Type::Status_Type_STATISTICS_REMARKS);
+
+   std::vector<std::string> statisticsRemarks = projectDb->analyzeData(analysisType);
+
+   for (const auto& remark : statisticsRemarks)
+   {
+      *status.add_remarks() = remark;
+   }
+
+   const std::size_t replySize = status.ByteSizeLong();
+   zmq::message_t    reply(replySize);
+   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+
+   socket.send(reply);
+}
+
+std::filesystem::path getFtagsCachePath()
+{
+   const char* xdgCacheHomeDirName = std::getenv("XDG_CACHE_HOME");
+
+   std::filesystem::path xdgCachePath;
+
+   if (xdgCacheHomeDirName == nullptr)
+   {
+      const char* homeDirName = std::getenv("HOME");
+      if (homeDirName == nullptr)
+      {
+         throw(std::runtime_error("HOME environment variable is not defined"));
+      }
+
+      const std::filesystem::path homePath = std::filesystem::path{homeDirName};
+
+      if (!std::filesystem::exists(homePath))
+      {
+         throw(std::runtime_error(
+            fmt::format("HOME environment variable points to an invalid directory {}", homeDirName)));
+      }
+
+      xdgCachePath = homePath / ".config";
+   }
+   else
+   {
+      xdgCachePath = std::filesystem::path{xdgCacheHomeDirName};
+   }
+
+   if (!std::filesystem::exists(xdgCachePath))
+   {
+      std::error_code ec;
+
+      const bool createdDir = std::filesystem::create_directory(xdgCachePath, ec);
+      if (createdDir)
+      {
+         spdlog::warn("Created missing cache dir {}", xdgCachePath.string());
+      }
+      else
+      {
+         const std::string errorMessage{
+            fmt::format("Failed to create missing cache directory {}: {}", xdgCachePath.string(), ec.message())};
+         spdlog::error(errorMessage);
+         throw(std::runtime_error(errorMessage));
+      }
+   }
+
+   const std::filesystem::path ftagsCachePath = xdgCachePath / "ftags" / "project";
+
+   return ftagsCachePath;
+}
+
+std::filesystem::path getProjectSaveLocation(const std::string& projectDirName)
+{
+   const std::filesystem::path ftagsCachePath = getFtagsCachePath();
+
+   if (!std::filesystem::exists(ftagsCachePath))
+   {
+      std::error_code ec;
+
+      const bool createdDir = std::filesystem::create_directory(ftagsCachePath, ec);
+      if (createdDir)
+      {
+         spdlog::warn("Created missing ftags cache dir {}", ftagsCachePath.string());
+      }
+      else
+      {
+         const std::string errorMessage{fmt::format(
+            "Failed to create missing ftags cache directory {}: {}", ftagsCachePath.string(), ec.message())};
+         spdlog::error(errorMessage);
+         throw(std::runtime_error(errorMessage));
+      }
+   }
+
+   const std::filesystem::path projectSourcePath{projectDirName};
+
+   const std::filesystem::path projectSaveLocation = ftagsCachePath / projectSourcePath.relative_path();
+
+   return projectSaveLocation;
+}
+
+std::vector<std::filesystem::path> getSavedProjects()
+{
+   std::vector<std::filesystem::path> retval;
+
+   const std::filesystem::path ftagsCachePath = getFtagsCachePath();
+
+   if (!std::filesystem::exists(ftagsCachePath))
+   {
+      return retval;
+   }
+
+   for (auto& entry : std::filesystem::recursive_directory_iterator(ftagsCachePath))
+   {
+      if (entry.is_regular_file())
+      {
+         spdlog::debug("Examining {}", entry.path().string());
+         if (entry.path().filename().string() == "project.data")
+         {
+            auto projectPath = std::filesystem::relative(entry.path().parent_path(), ftagsCachePath);
+            spdlog::info("Found saved project {}", projectPath.string());
+            retval.push_back(entry.path().parent_path());
+         }
+      }
+   }
+
+   spdlog::info("Found {} saved projects", retval.size());
+
+   return retval;
+}
+
+void dispatchSaveDatabase(zmq::socket_t&          socket,
+                          const ftags::ProjectDb* projectDb,
+                          const std::string&      projectName,
+                          const std::string&      projectDirectory)
+{
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_type(ftags::Status_Type::Status_Type_STATISTICS_REMARKS);
+
+   try
+   {
+      const std::filesystem::path saveLocation{getProjectSaveLocation(projectDirectory)};
+
+      if (!std::filesystem::exists(saveLocation))
+      {
+         std::error_code ec;
 
          const bool createdDir = std::filesystem::create_directories(saveLocation, ec);
          if (createdDir)
@@ -416,30 +1126,297 @@ void dispatchSaveDatabase(zmq::socket_t&          socket,
 
       const auto startSavingTimestamp = std::chrono::steady_clock::now();
 
-      const std::size_t serializedSize{projectDb->computeSerializedSize()};
+      const std::size_t serializedSize{projectDb->computeSerializedSize()};
+
+      const std::filesystem::path saveFile{saveLocation / "project.data"};
+
+      ftags::util::OfstreamSerializationWriter writer{saveFile.string(), serializedSize};
+
+      ftags::util::TypedInsertor insertor{writer};
+
+      projectDb->serialize(insertor);
+
+      const auto endSavingTimestamp = std::chrono::steady_clock::now();
+
+      *status.add_remarks() =
+         fmt::format("Saved {} to {} ({:n} bytes)", projectName, saveFile.string(), serializedSize);
+
+      *status.add_remarks() = fmt::format(
+         "Save duration: {:n} seconds",
+         std::chrono::duration_cast<std::chrono::seconds>(endSavingTimestamp - startSavingTimestamp).count());
+   }
+   catch (std::exception& ex)
+   {
+      *status.add_remarks() = fmt::format("Caught exception during save project: {}", ex.what());
+   }
+
+   const std::size_t replySize = status.ByteSizeLong();
+   zmq::message_t    reply(replySize);
+   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+
+   socket.send(reply);
+}
+
+void dispatchLoadDatabase(zmq::socket_t&     socket,
+                          const std::string& projectName,
+                          const std::string& projectDirectory,
+                          SharedProjects&    sharedProjects)
+{
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_type(ftags::Status_Type::Status_Type_STATISTICS_REMARKS);
+
+   try
+   {
+      const std::filesystem::path saveLocation{getProjectSaveLocation(projectDirectory)};
+
+      if (!std::filesystem::exists(saveLocation))
+      {
+         *status.add_remarks() = fmt::format("There is no project saved in {}", saveLocation.string());
+      }
+      else
+      {
+         const std::filesystem::path saveFile{saveLocation / "project.data"};
+
+         spdlog::info("Preparing to load data from {}", saveFile.string());
+
+         ftags::util::IfstreamSerializationReader reader{saveFile.string()};
+
+         ftags::util::TypedExtractor extractor{reader};
+
+         const auto startLoadingTimestamp = std::chrono::steady_clock::now();
+
+         ftags::ProjectDb pdb = ftags::ProjectDb::deserialize(extractor);
+
+         const auto endLoadingTimestamp = std::chrono::steady_clock::now();
+
+         {
+            std::unique_lock<std::shared_mutex> lock = lockForIngest(sharedProjects);
+
+            auto iter = sharedProjects.projects.emplace(projectName, std::move(pdb));
+            sharedProjects.projectsByPath.emplace(projectDirectory, &iter.first->second);
+         }
+
+         spdlog::info("Loaded project from {}", saveFile.string());
+
+         *status.add_remarks() = fmt::format("Loaded {} from disk", projectName);
+         *status.add_remarks() = fmt::format(
+            "Load duration: {:n} seconds",
+            std::chrono::duration_cast<std::chrono::seconds>(endLoadingTimestamp - startLoadingTimestamp).count());
+      }
+   }
+   catch (std::exception& ex)
+   {
+      *status.add_remarks() = fmt::format("Caught exception during save project: {}", ex.what());
+   }
+
+   const std::size_t replySize = status.ByteSizeLong();
+   zmq::message_t    reply(replySize);
+   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+
+   socket.send(reply);
+}
+
+void dispatchPing(zmq::socket_t& socket)
+{
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_type(ftags::Status_Type::Status_Type_IDLE);
+
+   const std::size_t replySize = status.ByteSizeLong();
+   zmq::message_t    reply(replySize);
+   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+
+   socket.send(reply);
+}
+
+void dispatchUnknownCommand(zmq::socket_t& socket)
+{
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_type(ftags::Status_Type::Status_Type_UNKNOWN);
+
+   const std::size_t replySize = status.ByteSizeLong();
+   zmq::message_t    reply(replySize);
+   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+
+   socket.send(reply);
+}
+
+void dispatchShutdown(zmq::socket_t& socket)
+{
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_type(ftags::Status_Type::Status_Type_SHUTTING_DOWN);
+
+   const std::size_t replySize = status.ByteSizeLong();
+   zmq::message_t    reply(replySize);
+   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+
+   socket.send(reply);
+}
+
+// how often the server checks on the indexers it started, when there are no requests
+const int k_MonitorIntervalMs = 1000;
+
+const unsigned k_DefaultIndexerThreads = 4;
+
+// indexers which have had no work for this long exit, and are started again by the next scan
+const unsigned k_DefaultIndexerIdleExitSeconds = 5 * 60;
+
+const unsigned k_DefaultQueryThreads = 4;
+
+// finds the project named in the command, or else the one whose root contains the directory in the command
+ftags::ProjectDb* findProject(SharedProjects& sharedProjects, const ftags::Command& command)
+{
+   ftags::ProjectDb* projectDb = nullptr;
+
+   if (command.projectname().empty())
+   {
+      if (!command.directoryname().empty())
+      {
+         std::filesystem::path inputPath{command.directoryname()};
+
+         /*
+          * traverse directory up to find a project root
+          */
+         while ((nullptr == projectDb) && (inputPath != inputPath.root_directory()))
+         {
+            auto iter = sharedProjects.projectsByPath.find(inputPath.string());
+            if (iter != sharedProjects.projectsByPath.end())
+            {
+               projectDb = iter->second;
+            }
+            else
+            {
+               inputPath = inputPath.parent_path();
+            }
+         }
+      }
+   }
+   else
+   {
+      auto iter = sharedProjects.projects.find(command.projectname());
+      if (iter != sharedProjects.projects.end())
+      {
+         projectDb = &iter->second;
+      }
+   }
+
+   return projectDb;
+}
+
+// receives all the parts of the next message
+std::vector<zmq::message_t> receiveMessage(zmq::socket_t& socket)
+{
+   std::vector<zmq::message_t> parts;
+
+   do
+   {
+      socket.recv(&parts.emplace_back());
+   } while (parts.back().more());
+
+   return parts;
+}
+
+void sendMessage(zmq::socket_t& socket, std::vector<zmq::message_t>& parts, std::size_t firstPart = 0)
+{
+   for (std::size_t ii = firstPart; ii < parts.size(); ii++)
+   {
+      socket.send(parts[ii], (ii + 1 < parts.size()) ? ZMQ_SNDMORE : 0);
+   }
+}
+
+/*
+ * The requests reach the query threads and the ingest thread as the client's identity, an empty
+ * delimiter and the command, followed by the payload if there is one; the replies go back behind
+ * the same identity and delimiter.
+ */
+struct Envelope
+{
+   zmq::message_t identity;
+   zmq::message_t delimiter;
+};
+
+ftags::Command receiveRequest(zmq::socket_t& socket, Envelope& envelope)
+{
+   zmq::message_t request;
+   socket.recv(&envelope.identity);
+   socket.recv(&envelope.delimiter);
+   socket.recv(&request);
+
+   ftags::Command command{};
+   command.ParseFromArray(request.data(), static_cast<int>(request.size()));
+
+   socket.send(envelope.identity, ZMQ_SNDMORE);
+   socket.send(envelope.delimiter, ZMQ_SNDMORE);
+
+   return command;
+}
 
-      const std::filesystem::path saveFile{saveLocation / "project.data"};
+/*
+ * Hashing the sources of a large project takes a while, so the projects are only locked while the
+ * fingerprints are looked up, and the uploads are not held up while the files are read.
+ */
+void dispatchCheckFingerprints(zmq::socket_t& socket, SharedProjects& sharedProjects, const ftags::Command& command)
+{
+   const auto startTimestamp = std::chrono::steady_clock::now();
 
-      ftags::util::OfstreamSerializationWriter writer{saveFile.string(), serializedSize};
+   ftags::Status status{};
+   status.set_timestamp(getTimeStamp());
+   status.set_type(ftags::Status_Type::Status_Type_TRANSLATION_UNITS_CURRENT);
 
-      ftags::util::TypedInsertor insertor{writer};
+   std::vector<ftags::ProjectDb::TranslationUnitFingerprint> fingerprints;
+   fingerprints.reserve(static_cast<std::size_t>(command.translationunitarguments_size()));
 
-      projectDb->serialize(insertor);
+   {
+      std::shared_lock<std::shared_mutex> lock{sharedProjects.mutex};
 
-      const auto endSavingTimestamp = std::chrono::steady_clock::now();
+      const ftags::ProjectDb* projectDb = findProject(sharedProjects, command);
+      if (nullptr == projectDb)
+      {
+         reportUnknownProject(socket, command.projectname(), sharedProjects.projects);
+         return;
+      }
 
-      *status.add_remarks() =
-         fmt::format("Saved {} to {} ({:n} bytes)", projectName, saveFile.string(), serializedSize);
+      for (const auto& translationUnitArguments : command.translationunitarguments())
+      {
+         const std::string& fileName = translationUnitArguments.filename();
 
-      *status.add_remarks() = fmt::format(
-         "Save duration: {:n} seconds",
-         std::chrono::duration_cast<std::chrono::seconds>(endSavingTimestamp - startSavingTimestamp).count());
+         fingerprints.push_back(projectDb->getTranslationUnitFingerprint(fileName));
+         status.add_parsenanoseconds(projectDb->getTranslationUnitParseNanoseconds(fileName));
+         status.add_includesignature(projectDb->getTranslationUnitIncludeSignature(fileName));
+      }
    }
-   catch (std::exception& ex)
+
+   ftags::ProjectDb::FileHashCache fileHashCache;
+
+   std::vector<const char*> arguments;
+
+   for (std::size_t ii = 0; ii < fingerprints.size(); ii++)
    {
-      *status.add_remarks() = fmt::format("Caught exception during save project: {}", ex.what());
+      const auto& translationUnitArguments = command.translationunitarguments(static_cast<int>(ii));
+
+      arguments.clear();
+      for (const auto& argument : translationUnitArguments.argument())
+      {
+         arguments.push_back(argument.c_str());
+      }
+
+      if (ftags::ProjectDb::isFingerprintCurrent(fingerprints[ii], arguments, fileHashCache))
+      {
+         *status.add_translationunit() = translationUnitArguments.filename();
+      }
    }
 
+   const auto endTimestamp = std::chrono::steady_clock::now();
+
+   spdlog::info("{:n} of {:n} translation units are unchanged; checked {:n} files in {:n} ms",
+                status.translationunit_size(),
+                command.translationunitarguments_size(),
+                fileHashCache.size(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(endTimestamp - startTimestamp).count());
+
    const std::size_t replySize = status.ByteSizeLong();
    zmq::message_t    reply(replySize);
    status.SerializeToArray(reply.data(), static_cast<int>(replySize));
@@ -447,110 +1424,281 @@ void dispatchSaveDatabase(zmq::socket_t&          socket,
    socket.send(reply);
 }
 
-ftags::ProjectDb* dispatchLoadDatabase(zmq::socket_t&                           socket,
-                                       const std::string&                       projectName,
-                                       const std::string&                       projectDirectory,
-                                       std::map<std::string, ftags::ProjectDb>& projects)
+// answers the requests which only read the projects; the caller holds the lock for reading
+void dispatchQuery(zmq::socket_t& socket, SharedProjects& sharedProjects, const ftags::Command& command)
 {
-   ftags::Status status{};
-   status.set_timestamp(getTimeStamp());
-   status.set_type(ftags::Status_Type::Status_Type_STATISTICS_REMARKS);
-
-   ftags::ProjectDb* retval = nullptr;
+   const ftags::ProjectDb* projectDb = findProject(sharedProjects, command);
 
-   try
+   switch (command.type())
    {
-      const std::filesystem::path saveLocation{getProjectSaveLocation(projectDirectory)};
+   case ftags::Command_Type::Command_Type_QUERY:
+      if (nullptr == projectDb)
+      {
+         reportUnknownProject(socket, command.projectname(), sharedProjects.projects);
+      }
+      else
+      {
+         switch (command.querytype())
+         {
+         case ftags::Command_QueryType::Command_QueryType_IDENTIFY:
+            dispatchQueryIdentify(
+               socket, projectDb, command.filename(), command.linenumber(), command.columnnumber());
+            break;
+         default:
+            dispatchFind(socket, projectDb, command);
+            break;
+         }
+      }
+      break;
 
-      if (!std::filesystem::exists(saveLocation))
+   case ftags::Command_Type::Command_Type_DUMP_TRANSLATION_UNIT:
+      if (nullptr == projectDb)
       {
-         *status.add_remarks() = fmt::format("There is no project saved in {}", saveLocation.string());
+         reportUnknownProject(socket, command.projectname(), sharedProjects.projects);
       }
       else
       {
-         const std::filesystem::path saveFile{saveLocation / "project.data"};
+         dispatchDumpTranslationUnit(socket, projectDb, command.filename());
+      }
+      break;
 
-         spdlog::info("Preparing to load data from {}", saveFile.string());
+   case ftags::Command_Type::Command_Type_FIND_DEPENDENT_TRANSLATION_UNITS:
+      if (nullptr == projectDb)
+      {
+         reportUnknownProject(socket, command.projectname(), sharedProjects.projects);
+      }
+      else
+      {
+         dispatchFindDependentTranslationUnits(socket, projectDb, command);
+      }
+      break;
 
-         ftags::util::IfstreamSerializationReader reader{saveFile.string()};
+   case ftags::Command_Type::Command_Type_LIST_PROJECTS: {
+      ftags::Status status{};
+      status.set_timestamp(getTimeStamp());
+      status.set_type(ftags::Status_Type::Status_Type_QUERY_RESULTS);
 
-         ftags::util::TypedExtractor extractor{reader};
+      for (const auto& iter : sharedProjects.projects)
+      {
+         *status.add_remarks() = fmt::format("{} in {}", iter.second.getName(), iter.second.getRoot());
+      }
 
-         const auto startLoadingTimestamp = std::chrono::steady_clock::now();
+      const std::size_t replySize = status.ByteSizeLong();
+      zmq::message_t    reply(replySize);
+      status.SerializeToArray(reply.data(), static_cast<int>(replySize));
 
-         ftags::ProjectDb pdb = ftags::ProjectDb::deserialize(extractor);
+      socket.send(reply);
+   }
+   break;
 
-         const auto endLoadingTimestamp = std::chrono::steady_clock::now();
+   case ftags::Command_Type::Command_Type_QUERY_STATISTICS:
+      if (nullptr == projectDb)
+      {
+         reportUnknownProject(socket, command.projectname(), sharedProjects.projects);
+      }
+      else
+      {
+         dispatchQueryStatistics(socket, projectDb, command.symbolname());
+      }
+      break;
 
-         auto iter = projects.emplace(projectName, std::move(pdb));
+   case ftags::Command_Type::Command_Type_SAVE_DATABASE:
+      dispatchSaveDatabase(socket, projectDb, command.projectname(), command.directoryname());
+      break;
 
-         retval = &iter.first->second;
+   case ftags::Command_Type::Command_Type_ANALYZE_DATA:
+      dispatchDataAnalysis(socket, projectDb, command.symbolname());
+      break;
 
-         spdlog::info("Loaded project from {}", saveFile.string());
+   default:
+      dispatchUnknownCommand(socket);
+      break;
+   }
+}
 
-         *status.add_remarks() = fmt::format("Loaded {} from disk", projectName);
-         *status.add_remarks() = fmt::format(
-            "Load duration: {:n} seconds",
-            std::chrono::duration_cast<std::chrono::seconds>(endLoadingTimestamp - startLoadingTimestamp).count());
+/*
+ * A query thread asks the front end for work with an empty message, and every reply it sends is
+ * also a request for more work, so the front end only hands out requests to idle threads.
+ */
+void serveQueries(zmq::context_t& context, SharedProjects& sharedProjects, const std::atomic<bool>& shuttingDown)
+{
+   zmq::socket_t socket(context, ZMQ_DEALER);
+   socket.setsockopt(ZMQ_LINGER, 0);
+   socket.connect(k_QueryEndpoint);
+
+   socket.send(zmq::message_t{});
+
+   zmq::pollitem_t pollItem = {static_cast<void*>(socket), 0, ZMQ_POLLIN, 0};
+
+   while (!shuttingDown)
+   {
+      zmq::poll(&pollItem, 1, k_MonitorIntervalMs);
+      if ((pollItem.revents & ZMQ_POLLIN) == 0)
+      {
+         continue;
+      }
+
+      Envelope             envelope;
+      const ftags::Command command = receiveRequest(socket, envelope);
+
+      try
+      {
+         if (command.type() == ftags::Command_Type::Command_Type_CHECK_FINGERPRINTS)
+         {
+            dispatchCheckFingerprints(socket, sharedProjects, command);
+         }
+         else
+         {
+            std::shared_lock<std::shared_mutex> lock{sharedProjects.mutex};
+            dispatchQuery(socket, sharedProjects, command);
+         }
+      }
+      catch (const std::exception& ex)
+      {
+         spdlog::error(
+            "Failed to answer {} from {}: {}", command.Type_Name(command.type()), command.source(), ex.what());
+         dispatchUnknownCommand(socket);
       }
    }
-   catch (std::exception& ex)
+}
+
+// answers the requests which change the projects
+void dispatchUpdate(zmq::socket_t&         socket,
+                    SharedProjects&        sharedProjects,
+                    ftags::ParsingSession& bufferParsingSession,
+                    CompileArgumentsCache& compileArgumentsCache,
+                    const ftags::Command&  command)
+{
+   switch (command.type())
    {
-      *status.add_remarks() = fmt::format("Caught exception during save project: {}", ex.what());
+   case ftags::Command_Type::Command_Type_UPDATE_TRANSLATION_UNIT:
+      // sent by indexers which wait for the acknowledgement; the others use the fragment socket
+      dispatchUpdateTranslationUnit(socket, sharedProjects, command);
+      break;
+
+   case ftags::Command_Type::Command_Type_UPDATE_BUFFER: {
+      ftags::ProjectDb* projectDb = findProject(sharedProjects, command);
+      if (nullptr == projectDb)
+      {
+         reportUnknownProject(socket, command.projectname(), sharedProjects.projects);
+      }
+      else
+      {
+         dispatchUpdateBuffer(socket,
+                              sharedProjects,
+                              projectDb,
+                              bufferParsingSession,
+                              compileArgumentsCache,
+                              command.filename(),
+                              command.contents());
+      }
    }
+   break;
 
-   const std::size_t replySize = status.ByteSizeLong();
-   zmq::message_t    reply(replySize);
-   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
-
-   socket.send(reply);
+   case ftags::Command_Type::Command_Type_LOAD_DATABASE:
+      dispatchLoadDatabase(socket, command.projectname(), command.directoryname(), sharedProjects);
+      break;
 
-   return retval;
+   default:
+      dispatchUnknownCommand(socket);
+      break;
+   }
 }
 
-void dispatchPing(zmq::socket_t& socket)
+/*
+ * The ingest thread is the only one which changes the projects: it merges the fragments uploaded by
+ * the indexers, the translation units of the indexers which wait for the acknowledgement, and the
+ * editor buffers, and loads the saved projects. It locks the projects only while changing them.
+ * The fragment socket is bound by the main thread and only used by the ingest thread.
+ */
+void ingestUpdates(zmq::context_t&          context,
+                   zmq::socket_t&           fragmentSocket,
+                   SharedProjects&          sharedProjects,
+                   const std::atomic<bool>& shuttingDown)
 {
-   ftags::Status status{};
-   status.set_timestamp(getTimeStamp());
-   status.set_type(ftags::Status_Type::Status_Type_IDLE);
+   zmq::socket_t socket(context, ZMQ_PAIR);
+   socket.setsockopt(ZMQ_LINGER, 0);
+   socket.connect(k_IngestEndpoint);
 
-   const std::size_t replySize = status.ByteSizeLong();
-   zmq::message_t    reply(replySize);
-   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+   std::array<zmq::pollitem_t, 2> pollItems = {{
+      {static_cast<void*>(socket), 0, ZMQ_POLLIN, 0},
+      {static_cast<void*>(fragmentSocket), 0, ZMQ_POLLIN, 0},
+   }};
 
-   socket.send(reply);
-}
+   TranslationUnitStreams translationUnitStreams;
 
-void dispatchUnknownCommand(zmq::socket_t& socket)
-{
-   ftags::Status status{};
-   status.set_timestamp(getTimeStamp());
-   status.set_type(ftags::Status_Type::Status_Type_UNKNOWN);
+   /*
+    * Editor buffers are parsed in-process; the session keeps the most recently updated translation
+    * units (and their preambles) alive so that repeated updates only reparse the main file.
+    */
+   ftags::ParsingSession bufferParsingSession{ftags::ParsingSession::Profile::Interactive};
 
-   const std::size_t replySize = status.ByteSizeLong();
-   zmq::message_t    reply(replySize);
-   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+   CompileArgumentsCache compileArgumentsCache;
 
-   socket.send(reply);
+   while (!shuttingDown)
+   {
+      zmq::poll(pollItems.data(), pollItems.size(), k_MonitorIntervalMs);
+
+      // the editor buffers come from the front end, so its requests go ahead of the fragments
+      if ((pollItems[0].revents & ZMQ_POLLIN) != 0)
+      {
+         Envelope             envelope;
+         const ftags::Command command = receiveRequest(socket, envelope);
+
+         try
+         {
+            dispatchUpdate(socket, sharedProjects, bufferParsingSession, compileArgumentsCache, command);
+         }
+         catch (const std::exception& ex)
+         {
+            spdlog::error(
+               "Failed to apply {} from {}: {}", command.Type_Name(command.type()), command.source(), ex.what());
+            dispatchUnknownCommand(socket);
+         }
+      }
+
+      if ((pollItems[1].revents & ZMQ_POLLIN) != 0)
+      {
+         try
+         {
+            dispatchFragment(fragmentSocket, sharedProjects, translationUnitStreams);
+         }
+         catch (const std::exception& ex)
+         {
+            spdlog::error("Failed to ingest a fragment: {}", ex.what());
+         }
+      }
+
+      expireTranslationUnitStreams(sharedProjects, translationUnitStreams);
+   }
 }
 
-void dispatchShutdown(zmq::socket_t& socket)
+// the indexer is built next to the server, in src/worker
+std::string getDefaultIndexerPath()
 {
-   ftags::Status status{};
-   status.set_timestamp(getTimeStamp());
-   status.set_type(ftags::Status_Type::Status_Type_SHUTTING_DOWN);
-
-   const std::size_t replySize = status.ByteSizeLong();
-   zmq::message_t    reply(replySize);
-   status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+   std::error_code             errorCode;
+   const std::filesystem::path serverPath = std::filesystem::read_symlink("/proc/self/exe", errorCode);
+   if (errorCode)
+   {
+      return {};
+   }
 
-   socket.send(reply);
+   return (serverPath.parent_path().parent_path() / "worker" / "ft_indexer").string();
 }
 
-bool showHelp         = false;
-bool autoloadProjects = false;
+bool        showHelp         = false;
+bool        autoloadProjects = false;
+unsigned    indexerThreads   = k_DefaultIndexerThreads;
+unsigned    indexerCount     = std::max(1U, std::thread::hardware_concurrency() / k_DefaultIndexerThreads); // NOLINT
+std::string indexerPath      = getDefaultIndexerPath();                                                   // NOLINT
+unsigned    queryThreads     = k_DefaultQueryThreads;
 
-auto cli = clara::Help(showHelp) | clara::Opt(autoloadProjects)["-a"]["--autoload"]("Autoload projects"); // NOLINT
+auto cli = clara::Help(showHelp) | clara::Opt(autoloadProjects)["-a"]["--autoload"]("Autoload projects") |
+           clara::Opt(indexerCount, "indexers")["--indexers"](
+              "How many indexers to start when a project is scanned; 0 if they are started by hand") |
+           clara::Opt(indexerThreads, "threads")["--indexer-threads"]("How many threads each indexer uses") |
+           clara::Opt(indexerPath, "path")["--indexer"]("Path to the indexer executable") |
+           clara::Opt(queryThreads, "threads")["--query-threads"]("How many queries to answer at once"); // NOLINT
 
 } // namespace
 
@@ -580,8 +1728,7 @@ int main(int argc, char* argv[])
 
       spdlog::info("Started");
 
-      std::map<std::string, ftags::ProjectDb>  projects;
-      std::map<std::string, ftags::ProjectDb*> projectsByPath;
+      SharedProjects sharedProjects;
 
       if (autoloadProjects)
       {
@@ -607,9 +1754,9 @@ int main(int argc, char* argv[])
 
             const std::string projectRoot = pdb.getRoot();
 
-            auto iter = projects.emplace(pdb.getName(), std::move(pdb));
+            auto iter = sharedProjects.projects.emplace(pdb.getName(), std::move(pdb));
 
-            projectsByPath.emplace(projectRoot, &iter.first->second);
+            sharedProjects.projectsByPath.emplace(projectRoot, &iter.first->second);
          }
          const auto endLoadingTimestamp = std::chrono::steady_clock::now();
 
@@ -621,179 +1768,212 @@ int main(int argc, char* argv[])
       const char*       xdgRuntimeDir  = std::getenv("XDG_RUNTIME_DIR");
       const std::string socketLocation = fmt::format("ipc://{}/ftags_server", xdgRuntimeDir);
 
-      zmq::socket_t socket(context, ZMQ_REP);
+      /*
+       * The front end takes the requests of all the clients, and hands out the queries to the query
+       * threads as they become idle, and the updates to the ingest thread, so a slow query or update
+       * does not hold up the others. It answers the pings and the shut down request itself.
+       */
+      zmq::socket_t socket(context, ZMQ_ROUTER);
       socket.bind(socketLocation);
 
-      bool shuttingDown = false;
+      zmq::socket_t querySocket(context, ZMQ_ROUTER);
+      querySocket.bind(k_QueryEndpoint);
+
+      zmq::socket_t ingestSocket(context, ZMQ_PAIR);
+      ingestSocket.bind(k_IngestEndpoint);
+
+      zmq::socket_t fragmentSocket(context, ZMQ_ROUTER);
+      fragmentSocket.setsockopt(ZMQ_LINGER, 0);
+      fragmentSocket.bind(fmt::format("ipc://{}/ftags_fragments", xdgRuntimeDir));
+
+      std::array<zmq::pollitem_t, 3> pollItems = {{
+         {static_cast<void*>(socket), 0, ZMQ_POLLIN, 0},
+         {static_cast<void*>(querySocket), 0, ZMQ_POLLIN, 0},
+         {static_cast<void*>(ingestSocket), 0, ZMQ_POLLIN, 0},
+      }};
 
-      while (!shuttingDown)
+      if ((indexerCount != 0) && !std::filesystem::exists(indexerPath))
       {
-         zmq::message_t request;
-         ftags::Command command{};
+         spdlog::warn("Indexer not found at '{}'; indexers need to be started by hand", indexerPath);
+         indexerCount = 0;
+      }
 
-         //  Wait for next request from client
-         socket.recv(&request);
-         command.ParseFromArray(request.data(), static_cast<int>(request.size()));
-         spdlog::info("Received request from {}: {}", command.source(), command.Type_Name(command.type()));
+      ftags::IndexerPool indexerPool{indexerPath, indexerCount, indexerThreads, k_DefaultIndexerIdleExitSeconds};
 
-         ftags::ProjectDb* projectDb = nullptr;
+      std::atomic<bool> shuttingDown{false};
 
-         if (command.projectname().empty())
-         {
-            if (!command.directoryname().empty())
-            {
-               std::filesystem::path inputPath{command.directoryname()};
+      const unsigned queryThreadCount = std::max(queryThreads, 1U);
 
-               /*
-                * traverse directory up to find a project root
-                */
-               while ((nullptr == projectDb) && (inputPath != inputPath.root_directory()))
-               {
-                  auto iter = projectsByPath.find(inputPath.string());
-                  if (iter != projectsByPath.end())
-                  {
-                     projectDb = iter->second;
-                  }
-                  else
-                  {
-                     inputPath = inputPath.parent_path();
-                  }
-               }
-            }
-         }
-         else
+      std::vector<std::thread> threads;
+      threads.emplace_back(ingestUpdates,
+                           std::ref(context),
+                           std::ref(fragmentSocket),
+                           std::ref(sharedProjects),
+                           std::cref(shuttingDown));
+      for (unsigned ii = 0; ii < queryThreadCount; ii++)
+      {
+         threads.emplace_back(serveQueries, std::ref(context), std::ref(sharedProjects), std::cref(shuttingDown));
+      }
+
+      // the threads notice within a monitoring interval
+      const auto joinThreads = [&threads, &shuttingDown]() {
+         shuttingDown = true;
+         for (auto& thread : threads)
          {
-            auto iter = projects.find(command.projectname());
-            if (iter != projects.end())
-            {
-               projectDb = &iter->second;
-            }
+            thread.join();
          }
+      };
+
+      // the identities of the query threads with nothing to do, and the queries waiting for one, by class
+      std::deque<zmq::message_t>                                                idleQueryThreads;
+      std::array<std::deque<std::vector<zmq::message_t>>, k_RequestClassCount> waitingQueries;
+
+      // the class of the query each busy thread is answering, by thread identity
+      std::unordered_map<std::string, RequestClass> busyQueryThreads;
+      unsigned                                      backgroundQueryThreads = 0;
 
-         switch (command.type())
+      // the background queries are kept off the last thread, unless there is only one
+      const unsigned maxBackgroundQueryThreads = std::max(queryThreadCount, 2U) - 1;
+
+      const auto getIdentity = [](const zmq::message_t& identity) {
+         return std::string{static_cast<const char*>(identity.data()), identity.size()};
+      };
+
+      const auto queueQuery = [&waitingQueries, &sharedProjects](std::vector<zmq::message_t>& parts,
+                                                                 const ftags::Command&        command) {
+         const RequestClass requestClass = classifyRequest(command);
+         if (requestClass == RequestClass::Interactive)
          {
+            sharedProjects.pendingInteractiveQueries++;
+         }
 
-         case ftags::Command_Type::Command_Type_QUERY:
-            if (nullptr == projectDb)
-            {
-               reportUnknownProject(socket, command.projectname(), projects);
-            }
-            else
-            {
-               switch (command.querytype())
-               {
-               case ftags::Command_QueryType::Command_QueryType_IDENTIFY:
-                  dispatchQueryIdentify(
-                     socket, projectDb, command.filename(), command.linenumber(), command.columnnumber());
-                  break;
-               default:
-                  dispatchFind(
-                     socket, projectDb, command.querytype(), command.queryqualifier(), command.symbolname());
-                  break;
-               }
-            }
-            break;
+         waitingQueries[static_cast<std::size_t>(requestClass)].push_back(std::move(parts));
+      };
 
-         case ftags::Command_Type::Command_Type_DUMP_TRANSLATION_UNIT:
-            if (nullptr == projectDb)
-            {
-               reportUnknownProject(socket, command.projectname(), projects);
-            }
-            else
-            {
-               dispatchDumpTranslationUnit(socket, projectDb, command.filename());
-            }
-            break;
+      try
+      {
+         while (!shuttingDown)
+         {
+            indexerPool.monitor();
 
-         case ftags::Command_Type::Command_Type_UPDATE_TRANSLATION_UNIT:
-            if (nullptr == projectDb)
+            zmq::poll(pollItems.data(), pollItems.size(), k_MonitorIntervalMs);
+
+            if ((pollItems[2].revents & ZMQ_POLLIN) != 0)
             {
-               spdlog::info(
-                  fmt::format("Creating new project: {} in {}", command.projectname(), command.directoryname()));
-               auto iter = projects.emplace(command.projectname(),
-                                            ftags::ProjectDb(/* name = */ command.projectname(),
-                                                             /* rootDirectory = */ command.directoryname()));
-               projectDb = &iter.first->second;
-
-               projectsByPath.emplace(command.directoryname(), projectDb);
+               std::vector<zmq::message_t> parts = receiveMessage(ingestSocket);
+               sendMessage(socket, parts);
             }
-            dispatchUpdateTranslationUnit(socket, projectDb, command.filename());
 
-#ifndef NDEBUG
-            // self-check
+            if ((pollItems[1].revents & ZMQ_POLLIN) != 0)
             {
-               for (const auto& [name, project] : projects)
+               // the identity of the query thread, then either an empty message or a reply with its envelope
+               std::vector<zmq::message_t> parts = receiveMessage(querySocket);
+               if (parts.size() > 2)
                {
-                  assert(name == project.getName());
+                  sendMessage(socket, parts, /* firstPart = */ 1);
                }
 
-               for (const auto& [path, project] : projectsByPath)
+               const auto busyIter = busyQueryThreads.find(getIdentity(parts.front()));
+               if (busyIter != busyQueryThreads.end())
                {
-                  assert(path == project->getRoot());
+                  if (busyIter->second == RequestClass::Interactive)
+                  {
+                     sharedProjects.pendingInteractiveQueries--;
+                  }
+                  else
+                  {
+                     backgroundQueryThreads--;
+                  }
+
+                  busyQueryThreads.erase(busyIter);
                }
+
+               idleQueryThreads.push_back(std::move(parts.front()));
             }
-#endif
 
-            break;
+            if ((pollItems[0].revents & ZMQ_POLLIN) != 0)
+            {
+               //  Next request from client
+               std::vector<zmq::message_t> parts = receiveMessage(socket);
+               if (parts.size() < 3)
+               {
+                  spdlog::warn("Dropped a request without an envelope");
+                  continue;
+               }
 
-         case ftags::Command_Type::Command_Type_LIST_PROJECTS: {
-            ftags::Status status{};
-            status.set_timestamp(getTimeStamp());
-            status.set_type(ftags::Status_Type::Status_Type_QUERY_RESULTS);
+               ftags::Command command{};
+               command.ParseFromArray(parts[2].data(), static_cast<int>(parts[2].size()));
+               spdlog::info("Received request from {}: {}", command.source(), command.Type_Name(command.type()));
 
-            for (const auto& iter : projects)
-            {
-               *status.add_remarks() = fmt::format("{} in {}", iter.second.getName(), iter.second.getRoot());
-            }
+               switch (command.type())
+               {
+               case ftags::Command_Type::Command_Type_PING:
+                  socket.send(parts[0], ZMQ_SNDMORE);
+                  socket.send(parts[1], ZMQ_SNDMORE);
+                  dispatchPing(socket);
+                  break;
 
-            const std::size_t replySize = status.ByteSizeLong();
-            zmq::message_t    reply(replySize);
-            status.SerializeToArray(reply.data(), static_cast<int>(replySize));
+               case ftags::Command_Type::Command_Type_SHUT_DOWN:
+                  socket.send(parts[0], ZMQ_SNDMORE);
+                  socket.send(parts[1], ZMQ_SNDMORE);
+                  dispatchShutdown(socket);
+                  shuttingDown = true;
+                  break;
 
-            socket.send(reply);
-         }
-         break;
+               case ftags::Command_Type::Command_Type_UPDATE_TRANSLATION_UNIT:
+               case ftags::Command_Type::Command_Type_UPDATE_BUFFER:
+               case ftags::Command_Type::Command_Type_LOAD_DATABASE:
+                  sendMessage(ingestSocket, parts);
+                  break;
 
-         case ftags::Command_Type::Command_Type_PING:
-            dispatchPing(socket);
-            break;
+               case ftags::Command_Type::Command_Type_CHECK_FINGERPRINTS:
+               case ftags::Command_Type::Command_Type_FIND_DEPENDENT_TRANSLATION_UNITS:
+                  // the scanner asks first, then hands out the work
+                  indexerPool.start();
+                  queueQuery(parts, command);
+                  break;
 
-         case ftags::Command_Type::Command_Type_QUERY_STATISTICS:
-            if (nullptr == projectDb)
-            {
-               reportUnknownProject(socket, command.projectname(), projects);
+               default:
+                  queueQuery(parts, command);
+                  break;
+               }
             }
-            else
+
+            // the interactive queries go first, so they only wait for the threads already busy
+            while (!idleQueryThreads.empty())
             {
-               dispatchQueryStatistics(socket, projectDb, command.symbolname());
-            }
-            break;
+               RequestClass requestClass = RequestClass::Interactive;
+               if (waitingQueries[static_cast<std::size_t>(RequestClass::Interactive)].empty())
+               {
+                  if (waitingQueries[static_cast<std::size_t>(RequestClass::Background)].empty() ||
+                      (backgroundQueryThreads >= maxBackgroundQueryThreads))
+                  {
+                     break;
+                  }
 
-         case ftags::Command_Type::Command_Type_SAVE_DATABASE:
-            dispatchSaveDatabase(socket, projectDb, command.projectname(), command.directoryname());
-            break;
+                  requestClass = RequestClass::Background;
+                  backgroundQueryThreads++;
+               }
 
-         case ftags::Command_Type::Command_Type_LOAD_DATABASE: {
-            ftags::ProjectDb* newProjectDb =
-               dispatchLoadDatabase(socket, command.projectname(), command.directoryname(), projects);
-            projectsByPath.emplace(command.directoryname(), newProjectDb);
-         }
-         break;
+               auto& queries = waitingQueries[static_cast<std::size_t>(requestClass)];
 
-         case ftags::Command_Type::Command_Type_ANALYZE_DATA:
-            dispatchDataAnalysis(socket, projectDb, command.symbolname());
-            break;
+               busyQueryThreads[getIdentity(idleQueryThreads.front())] = requestClass;
 
-         case ftags::Command_Type::Command_Type_SHUT_DOWN:
-            dispatchShutdown(socket);
-            shuttingDown = true;
-            break;
+               querySocket.send(idleQueryThreads.front(), ZMQ_SNDMORE);
+               sendMessage(querySocket, queries.front());
 
-         default:
-            dispatchUnknownCommand(socket);
-            break;
+               idleQueryThreads.pop_front();
+               queries.pop_front();
+            }
          }
       }
+      catch (...)
+      {
+         joinThreads();
+         throw;
+      }
+
+      joinThreads();
    }
    catch (std::exception& ex)
    {
@@ -0,0 +1,469 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <compile_commands_reader.h>
+
+#include <filesystem>
+#include <stdexcept>
+#include <string_view>
+
+#include <cctype>
+#include <cstdint>
+
+namespace
+{
+
+constexpr int k_EndOfInput = std::char_traits<char>::eof();
+
+bool isSpace(int character)
+{
+   return (character == ' ') || (character == '\t') || (character == '\r') || (character == '\n');
+}
+
+void appendUtf8(std::string& output, uint32_t codePoint)
+{
+   if (codePoint < 0x80)
+   {
+      output.push_back(static_cast<char>(codePoint));
+   }
+   else if (codePoint < 0x800)
+   {
+      output.push_back(static_cast<char>(0xC0 | (codePoint >> 6U)));
+      output.push_back(static_cast<char>(0x80 | (codePoint & 0x3FU)));
+   }
+   else if (codePoint < 0x10000)
+   {
+      output.push_back(static_cast<char>(0xE0 | (codePoint >> 12U)));
+      output.push_back(static_cast<char>(0x80 | ((codePoint >> 6U) & 0x3FU)));
+      output.push_back(static_cast<char>(0x80 | (codePoint & 0x3FU)));
+   }
+   else
+   {
+      output.push_back(static_cast<char>(0xF0 | (codePoint >> 18U)));
+      output.push_back(static_cast<char>(0x80 | ((codePoint >> 12U) & 0x3FU)));
+      output.push_back(static_cast<char>(0x80 | ((codePoint >> 6U) & 0x3FU)));
+      output.push_back(static_cast<char>(0x80 | (codePoint & 0x3FU)));
+   }
+}
+
+[[noreturn]] void throwMalformed()
+{
+   throw std::runtime_error("Malformed compilation database");
+}
+
+} // anonymous namespace
+
+int ftags::util::CompileCommandsReader::peekNonSpace()
+{
+   std::streambuf* buffer = m_input.rdbuf();
+
+   int character = buffer->sgetc();
+   while (isSpace(character))
+   {
+      character = buffer->snextc();
+   }
+
+   return character;
+}
+
+void ftags::util::CompileCommandsReader::expect(char expected)
+{
+   if (peekNonSpace() != expected)
+   {
+      throwMalformed();
+   }
+
+   m_input.rdbuf()->sbumpc();
+}
+
+std::string ftags::util::CompileCommandsReader::readString()
+{
+   expect('"');
+
+   std::streambuf* buffer = m_input.rdbuf();
+
+   const auto readHexQuad = [buffer]() {
+      uint32_t value = 0;
+      for (int ii = 0; ii < 4; ii++)
+      {
+         const int digit = buffer->sbumpc();
+         if (!std::isxdigit(digit))
+         {
+            throwMalformed();
+         }
+
+         value = (value << 4U) |
+                 static_cast<uint32_t>(std::isdigit(digit) ? (digit - '0') : (std::tolower(digit) - 'a' + 10));
+      }
+
+      return value;
+   };
+
+   std::string value;
+
+   while (true)
+   {
+      const int character = buffer->sbumpc();
+
+      if (character == k_EndOfInput)
+      {
+         throwMalformed();
+      }
+
+      if (character == '"')
+      {
+         break;
+      }
+
+      if (character != '\\')
+      {
+         value.push_back(static_cast<char>(character));
+         continue;
+      }
+
+      const int escaped = buffer->sbumpc();
+      switch (escaped)
+      {
+      case '"':
+      case '\\':
+      case '/':
+         value.push_back(static_cast<char>(escaped));
+         break;
+      case 'b':
+         value.push_back('\b');
+         break;
+      case 'f':
+         value.push_back('\f');
+         break;
+      case 'n':
+         value.push_back('\n');
+         break;
+      case 'r':
+         value.push_back('\r');
+         break;
+      case 't':
+         value.push_back('\t');
+         break;
+      case 'u':
+      {
+         uint32_t codePoint = readHexQuad();
+
+         // characters outside the basic plane are escaped as a surrogate pair
+         if ((codePoint >= 0xD800) && (codePoint < 0xDC00))
+         {
+            if ((buffer->sbumpc() != '\\') || (buffer->sbumpc() != 'u'))
+            {
+               throwMalformed();
+            }
+
+            const uint32_t lowSurrogate = readHexQuad();
+            codePoint                   = 0x10000 + ((codePoint - 0xD800) << 10U) + (lowSurrogate - 0xDC00);
+         }
+
+         appendUtf8(value, codePoint);
+         break;
+      }
+      default:
+         throwMalformed();
+      }
+   }
+
+   return value;
+}
+
+void ftags::util::CompileCommandsReader::readStringArray(std::vector<std::string>& values)
+{
+   expect('[');
+
+   if (peekNonSpace() == ']')
+   {
+      m_input.rdbuf()->sbumpc();
+      return;
+   }
+
+   while (true)
+   {
+      values.push_back(readString());
+
+      const int separator = peekNonSpace();
+      m_input.rdbuf()->sbumpc();
+
+      if (separator == ']')
+      {
+         break;
+      }
+
+      if (separator != ',')
+      {
+         throwMalformed();
+      }
+   }
+}
+
+void ftags::util::CompileCommandsReader::skipValue()
+{
+   std::streambuf* buffer = m_input.rdbuf();
+
+   const int first = peekNonSpace();
+
+   if (first == '"')
+   {
+      readString();
+      return;
+   }
+
+   if ((first == '{') || (first == '['))
+   {
+      const char closing = (first == '{') ? '}' : ']';
+
+      buffer->sbumpc();
+      if (peekNonSpace() == closing)
+      {
+         buffer->sbumpc();
+         return;
+      }
+
+      while (true)
+      {
+         if (first == '{')
+         {
+            readString();
+            expect(':');
+         }
+
+         skipValue();
+
+         const int separator = peekNonSpace();
+         buffer->sbumpc();
+
+         if (separator == closing)
+         {
+            return;
+         }
+
+         if (separator != ',')
+         {
+            throwMalformed();
+         }
+      }
+   }
+
+   // numbers, true, false and null
+   std::size_t length = 0;
+   for (int character = buffer->sgetc();
+        (character != k_EndOfInput) && (character != ',') && (character != '}') && (character != ']') &&
+        (!isSpace(character));
+        character = buffer->snextc())
+   {
+      length++;
+   }
+
+   if (length == 0)
+   {
+      throwMalformed();
+   }
+}
+
+bool ftags::util::CompileCommandsReader::readNext(CompileCommand& compileCommand)
+{
+   if (m_finished)
+   {
+      return false;
+   }
+
+   if (!m_started)
+   {
+      expect('[');
+      m_started = true;
+   }
+   else if (peekNonSpace() != ']')
+   {
+      expect(',');
+   }
+
+   if (peekNonSpace() == ']')
+   {
+      m_input.rdbuf()->sbumpc();
+      m_finished = true;
+      return false;
+   }
+
+   compileCommand.directory.clear();
+   compileCommand.fileName.clear();
+   compileCommand.arguments.clear();
+
+   std::string commandLine;
+   bool        hasArguments = false;
+
+   expect('{');
+
+   if (peekNonSpace() == '}')
+   {
+      throwMalformed();
+   }
+
+   while (true)
+   {
+      const std::string key = readString();
+      expect(':');
+
+      if (key == "directory")
+      {
+         compileCommand.directory = readString();
+      }
+      else if (key == "file")
+      {
+         compileCommand.fileName = readString();
+      }
+      else if (key == "arguments")
+      {
+         readStringArray(compileCommand.arguments);
+         hasArguments = true;
+      }
+      else if (key == "command")
+      {
+         commandLine = readString();
+      }
+      else
+      {
+         skipValue();
+      }
+
+      const int separator = peekNonSpace();
+      m_input.rdbuf()->sbumpc();
+
+      if (separator == '}')
+      {
+         break;
+      }
+
+      if (separator != ',')
+      {
+         throwMalformed();
+      }
+   }
+
+   if (compileCommand.fileName.empty())
+   {
+      throw std::runtime_error("Compilation database entry without a file");
+   }
+
+   const std::filesystem::path filePath{compileCommand.fileName};
+   if (filePath.is_relative())
+   {
+      compileCommand.fileName = (std::filesystem::path{compileCommand.directory} / filePath).string();
+   }
+
+   if (!hasArguments)
+   {
+      compileCommand.arguments = splitCommandLine(commandLine);
+   }
+
+   filterArguments(compileCommand.arguments);
+
+   return true;
+}
+
+std::vector<std::string> ftags::util::CompileCommandsReader::splitCommandLine(const std::string& commandLine)
+{
+   std::vector<std::string> arguments;
+
+   std::string argument;
+   bool        inArgument = false;
+
+   for (std::size_t ii = 0; ii < commandLine.size(); ii++)
+   {
+      const char character = commandLine[ii];
+
+      if (isSpace(character))
+      {
+         if (inArgument)
+         {
+            arguments.push_back(std::move(argument));
+            argument.clear();
+            inArgument = false;
+         }
+
+         continue;
+      }
+
+      inArgument = true;
+
+      if ((character == '\\') && (ii + 1 < commandLine.size()))
+      {
+         argument.push_back(commandLine[++ii]);
+      }
+      else if (character == '\'')
+      {
+         // nothing is special inside single quotes
+         const std::size_t closing = commandLine.find('\'', ii + 1);
+         const std::size_t end     = (closing == std::string::npos) ? commandLine.size() : closing;
+
+         argument.append(commandLine, ii + 1, end - ii - 1);
+         ii = end;
+      }
+      else if (character == '"')
+      {
+         // only a few characters can be escaped inside double quotes
+         for (ii++; (ii < commandLine.size()) && (commandLine[ii] != '"'); ii++)
+         {
+            if ((commandLine[ii] == '\\') && (ii + 1 < commandLine.size()) &&
+                (std::string_view{"\"\\$`"}.find(commandLine[ii + 1]) != std::string_view::npos))
+            {
+               ii++;
+            }
+
+            argument.push_back(commandLine[ii]);
+         }
+      }
+      else
+      {
+         argument.push_back(character);
+      }
+   }
+
+   if (inArgument)
+   {
+      arguments.push_back(std::move(argument));
+   }
+
+   return arguments;
+}
+
+void ftags::util::CompileCommandsReader::filterArguments(std::vector<std::string>& arguments)
+{
+   std::size_t kept          = 0;
+   bool        skipFileNames = false;
+
+   for (std::string& argument : arguments)
+   {
+      if (skipFileNames)
+      {
+         skipFileNames = false;
+         continue;
+      }
+
+      if ((argument.size() > 1) && (argument[0] == '-') && ((argument[1] == 'c') || (argument[1] == 'o')))
+      {
+         skipFileNames = true;
+         continue;
+      }
+
+      arguments[kept++].swap(argument);
+   }
+
+   arguments.resize(kept);
+}
@@ -0,0 +1,75 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef COMPILE_COMMANDS_READER_H_INCLUDED
+#define COMPILE_COMMANDS_READER_H_INCLUDED
+
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace ftags::util
+{
+
+/*
+ * Reads the entries of a compile_commands.json file one at a time, so they can be used while the
+ * rest of the file is read, instead of loading the whole compilation database first.
+ *
+ * The arguments come either from the "arguments" array or from splitting the "command" string like
+ * a POSIX shell does. The options selecting the outputs, -c and -o, are dropped in the same pass
+ * together with the argument following them, like the indexers always expected.
+ */
+class CompileCommandsReader
+{
+public:
+   struct CompileCommand
+   {
+      std::string              directory;
+      std::string              fileName; // made absolute with the directory
+      std::vector<std::string> arguments;
+   };
+
+   explicit CompileCommandsReader(std::istream& input) : m_input{input}
+   {
+   }
+
+   /** Reads the next entry; returns false after the last one.
+    *
+    * @throws std::runtime_error if the input is not a valid compilation database
+    */
+   bool readNext(CompileCommand& compileCommand);
+
+   static std::vector<std::string> splitCommandLine(const std::string& commandLine);
+
+   static void filterArguments(std::vector<std::string>& arguments);
+
+private:
+   int  peekNonSpace();
+   void expect(char expected);
+
+   std::string readString();
+   void        readStringArray(std::vector<std::string>& values);
+   void        skipValue();
+
+   std::istream& m_input;
+
+   bool m_started  = false;
+   bool m_finished = false;
+};
+
+} // namespace ftags::util
+
+#endif // COMPILE_COMMANDS_READER_H_INCLUDED
@@ -0,0 +1,266 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <file_watcher.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr uint32_t k_WatchMask =
+   IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF | IN_ONLYDIR;
+
+bool isHidden(const std::filesystem::path& path)
+{
+   const std::string fileName = path.filename().string();
+   return (!fileName.empty()) && (fileName.front() == '.');
+}
+
+} // anonymous namespace
+
+ftags::util::FileWatcher::FileWatcher(const std::filesystem::path& rootDirectory,
+                                      std::chrono::milliseconds    quietPeriod,
+                                      std::chrono::milliseconds    maxDelay) :
+   m_quietPeriod{quietPeriod}, m_maxDelay{maxDelay}
+{
+   m_fileDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (m_fileDescriptor < 0)
+   {
+      throw std::runtime_error(fmt::format("Failed to start watching files: {}", strerror(errno)));
+   }
+
+   try
+   {
+      addWatches(rootDirectory, /* isNew = */ false);
+   }
+   catch (...)
+   {
+      close(m_fileDescriptor);
+      throw;
+   }
+}
+
+ftags::util::FileWatcher::~FileWatcher()
+{
+   close(m_fileDescriptor);
+}
+
+int ftags::util::FileWatcher::addWatches(const std::filesystem::path& directory, bool isNew)
+{
+   const int watchDescriptor = inotify_add_watch(m_fileDescriptor, directory.c_str(), k_WatchMask);
+   if (watchDescriptor < 0)
+   {
+      // the directory is gone already, or it cannot be read anyway
+      if ((errno == ENOENT) || (errno == ENOTDIR) || (errno == EACCES))
+      {
+         return -1;
+      }
+
+      throw std::runtime_error(fmt::format("Failed to watch {}: {}", directory.string(), strerror(errno)));
+   }
+
+   // a directory renamed within the tree keeps its watch descriptor, which now has the new name
+   const bool isRenamed = !m_directories.insert_or_assign(watchDescriptor, directory).second;
+
+   std::error_code errorCode;
+   for (std::filesystem::directory_iterator iter{directory, errorCode}, end; iter != end; iter.increment(errorCode))
+   {
+      const std::filesystem::path& path = iter->path();
+      if (isHidden(path))
+      {
+         continue;
+      }
+
+      // the symbolic links to directories are not followed
+      if (iter->is_directory(errorCode) && (!iter->is_symlink(errorCode)))
+      {
+         addWatches(path, isNew);
+      }
+      else if (isNew)
+      {
+         // created before the directory was watched
+         m_changedFileNames.insert(path.string());
+         noteChange();
+      }
+   }
+
+   return isRenamed ? watchDescriptor : -1;
+}
+
+void ftags::util::FileWatcher::removeWatches(const std::filesystem::path& directory)
+{
+   const std::string prefix = (directory / "").string();
+
+   for (auto iter = m_directories.begin(); iter != m_directories.end();)
+   {
+      if ((iter->second == directory) || (iter->second.string().compare(0, prefix.size(), prefix) == 0))
+      {
+         // the events still queued for the directory are dropped along with its IN_IGNORED
+         inotify_rm_watch(m_fileDescriptor, iter->first);
+         iter = m_directories.erase(iter);
+      }
+      else
+      {
+         ++iter;
+      }
+   }
+}
+
+void ftags::util::FileWatcher::noteChange()
+{
+   const auto now = std::chrono::steady_clock::now();
+   if (!m_hasChanges)
+   {
+      m_firstChange = now;
+      m_hasChanges  = true;
+   }
+
+   m_lastChange = now;
+}
+
+void ftags::util::FileWatcher::readEvents()
+{
+   alignas(inotify_event) char buffer[64 * 1024];
+
+   while (true)
+   {
+      const ssize_t bytesRead = read(m_fileDescriptor, buffer, sizeof(buffer));
+      if (bytesRead < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+
+         if (errno == EAGAIN)
+         {
+            break;
+         }
+
+         throw std::runtime_error(fmt::format("Failed to read file events: {}", strerror(errno)));
+      }
+
+      if (bytesRead == 0)
+      {
+         break;
+      }
+
+      for (ssize_t offset = 0; offset < bytesRead;)
+      {
+         const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+         offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+         if ((event->mask & IN_Q_OVERFLOW) != 0)
+         {
+            m_isOverflowed = true;
+            noteChange();
+            continue;
+         }
+
+         const auto directoryIter = m_directories.find(event->wd);
+         if (directoryIter == m_directories.end())
+         {
+            continue;
+         }
+
+         if ((event->mask & IN_IGNORED) != 0)
+         {
+            m_directories.erase(directoryIter);
+            continue;
+         }
+
+         if ((event->mask & IN_MOVE_SELF) != 0)
+         {
+            // reported after IN_MOVED_TO, which watched the directory again if it stayed within the tree
+            if (m_renamedWatches.erase(event->wd) == 0)
+            {
+               removeWatches(directoryIter->second);
+            }
+            continue;
+         }
+
+         if (event->len == 0)
+         {
+            continue;
+         }
+
+         const std::filesystem::path path = directoryIter->second / event->name;
+         if (isHidden(path))
+         {
+            continue;
+         }
+
+         if ((event->mask & IN_ISDIR) != 0)
+         {
+            if ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0)
+            {
+               // only the directory which was moved gets IN_MOVE_SELF, not the directories under it
+               const int renamedWatch = addWatches(path, /* isNew = */ true);
+               if (renamedWatch >= 0)
+               {
+                  m_renamedWatches.insert(renamedWatch);
+               }
+            }
+
+            continue;
+         }
+
+         m_changedFileNames.insert(path.string());
+         noteChange();
+      }
+   }
+}
+
+long ftags::util::FileWatcher::getMillisecondsUntilSettled() const
+{
+   if (!m_hasChanges)
+   {
+      return -1;
+   }
+
+   const auto settled = std::min(m_lastChange + m_quietPeriod, m_firstChange + m_maxDelay);
+   const auto now     = std::chrono::steady_clock::now();
+   if (settled <= now)
+   {
+      return 0;
+   }
+
+   // rounded up, so that the changes are settled once the time is up
+   return static_cast<long>(std::chrono::ceil<std::chrono::milliseconds>(settled - now).count());
+}
+
+ftags::util::FileWatcher::Changes ftags::util::FileWatcher::takeChanges()
+{
+   Changes changes;
+   changes.fileNames.assign(m_changedFileNames.cbegin(), m_changedFileNames.cend());
+   changes.isOverflowed = m_isOverflowed;
+
+   m_changedFileNames.clear();
+   m_isOverflowed = false;
+   m_hasChanges   = false;
+
+   return changes;
+}
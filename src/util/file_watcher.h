@@ -0,0 +1,117 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef FILE_WATCHER_H_INCLUDED
+#define FILE_WATCHER_H_INCLUDED
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ftags::util
+{
+
+/*
+ * Watches a directory tree with inotify and collects the names of the files changed in it. The
+ * hidden files and directories, such as .git, are not watched.
+ *
+ * The changes settle once no more arrive for a quiet period, or at the latest a while after the
+ * first one, so that a burst such as a branch checkout is handled at once instead of file by file.
+ */
+class FileWatcher
+{
+public:
+   struct Changes
+   {
+      std::vector<std::string> fileNames;
+
+      // some events were lost, so any file may have changed
+      bool isOverflowed = false;
+   };
+
+   /** Starts watching the directory and all its subdirectories.
+    *
+    * @throws std::runtime_error if the directories cannot be watched
+    */
+   FileWatcher(const std::filesystem::path& rootDirectory,
+               std::chrono::milliseconds    quietPeriod,
+               std::chrono::milliseconds    maxDelay);
+
+   ~FileWatcher();
+
+   FileWatcher(const FileWatcher& other) = delete;
+   FileWatcher& operator=(const FileWatcher& other) = delete;
+
+   // becomes readable when there are events; can be polled together with sockets
+   int getFileDescriptor() const noexcept
+   {
+      return m_fileDescriptor;
+   }
+
+   // reads the events which are already queued, without blocking
+   void readEvents();
+
+   // milliseconds until the changes collected so far settle, or -1 if there are none
+   long getMillisecondsUntilSettled() const;
+
+   bool hasSettledChanges() const
+   {
+      return getMillisecondsUntilSettled() == 0;
+   }
+
+   // returns the changes collected so far and starts over
+   Changes takeChanges();
+
+   std::size_t getWatchedDirectoryCount() const noexcept
+   {
+      return m_directories.size();
+   }
+
+private:
+   /* When the directory is new, the files already in it are reported as changed. Returns the watch
+    * descriptor of the directory if it was watched already, under the name it had before a rename.
+    */
+   int addWatches(const std::filesystem::path& directory, bool isNew);
+
+   // stops watching the directory, which left the tree, and the directories under it
+   void removeWatches(const std::filesystem::path& directory);
+
+   void noteChange();
+
+   int m_fileDescriptor = -1;
+
+   // by watch descriptor
+   std::unordered_map<int, std::filesystem::path> m_directories;
+
+   // the directories renamed within the tree, until their own IN_MOVE_SELF event is read
+   std::unordered_set<int> m_renamedWatches;
+
+   std::unordered_set<std::string> m_changedFileNames;
+   bool                            m_isOverflowed = false;
+   bool                            m_hasChanges   = false;
+
+   std::chrono::milliseconds             m_quietPeriod;
+   std::chrono::milliseconds             m_maxDelay;
+   std::chrono::steady_clock::time_point m_firstChange;
+   std::chrono::steady_clock::time_point m_lastChange;
+};
+
+} // namespace ftags::util
+
+#endif // FILE_WATCHER_H_INCLUDED
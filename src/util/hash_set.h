@@ -0,0 +1,170 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef FTAGS_HASH_SET_H_INCLUDED
+#define FTAGS_HASH_SET_H_INCLUDED
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ftags::util
+{
+
+/*
+ * Open addressing hash set with linear probing, for small values that are
+ * collected in short bursts. Clearing the set is constant time and keeps the
+ * allocated slots for the next use; no memory is allocated until the first insertion.
+ */
+template <typename T, typename Hash>
+class HashSet
+{
+public:
+   HashSet() = default;
+
+   explicit HashSet(std::size_t initialCapacity) : m_slots(roundUpCapacity(initialCapacity))
+   {
+   }
+
+   /*
+    * Returns true if the value was added, false if it was already present
+    */
+   bool insert(const T& value)
+   {
+      if ((m_size + 1) * 2 > m_slots.size())
+      {
+         grow();
+      }
+
+      Slot& slot = findSlot(value);
+      if (slot.generation == m_generation)
+      {
+         return false;
+      }
+
+      slot.generation = m_generation;
+      slot.value      = value;
+      m_size++;
+
+      return true;
+   }
+
+   bool contains(const T& value) const
+   {
+      if (m_slots.empty())
+      {
+         return false;
+      }
+
+      return const_cast<HashSet*>(this)->findSlot(value).generation == m_generation;
+   }
+
+   void clear() noexcept
+   {
+      m_size = 0;
+      m_generation++;
+
+      if (m_generation == 0)
+      {
+         // the generation counter wrapped around; old slots could appear as live
+         for (auto& slot : m_slots)
+         {
+            slot.generation = 0;
+         }
+
+         m_generation = 1;
+      }
+   }
+
+   std::size_t size() const noexcept
+   {
+      return m_size;
+   }
+
+   bool empty() const noexcept
+   {
+      return m_size == 0;
+   }
+
+   std::size_t capacity() const noexcept
+   {
+      return m_slots.size();
+   }
+
+private:
+   static constexpr std::size_t k_defaultCapacity = 64;
+
+   struct Slot
+   {
+      // a slot is occupied if its generation matches the generation of the set
+      uint32_t generation = 0;
+      T        value      = {};
+   };
+
+   std::vector<Slot> m_slots;
+   std::size_t       m_size       = 0;
+   uint32_t          m_generation = 1;
+
+   static std::size_t roundUpCapacity(std::size_t capacity)
+   {
+      std::size_t powerOfTwo = 2;
+      while (powerOfTwo < capacity)
+      {
+         powerOfTwo *= 2;
+      }
+      return powerOfTwo;
+   }
+
+   /*
+    * Returns either the slot holding the value or the free slot where it belongs
+    */
+   Slot& findSlot(const T& value)
+   {
+      const std::size_t mask  = m_slots.size() - 1;
+      std::size_t       index = Hash{}(value) & mask;
+
+      while ((m_slots[index].generation == m_generation) && !(m_slots[index].value == value))
+      {
+         index = (index + 1) & mask;
+      }
+
+      return m_slots[index];
+   }
+
+   void grow()
+   {
+      std::vector<Slot> oldSlots(m_slots.empty() ? k_defaultCapacity : m_slots.size() * 2);
+      oldSlots.swap(m_slots);
+
+      const uint32_t oldGeneration = m_generation;
+      m_generation                 = 1;
+
+      for (const auto& oldSlot : oldSlots)
+      {
+         if (oldSlot.generation == oldGeneration)
+         {
+            Slot& slot      = findSlot(oldSlot.value);
+            slot.generation = m_generation;
+            slot.value      = oldSlot.value;
+         }
+      }
+   }
+};
+
+} // namespace ftags::util
+
+#endif // FTAGS_HASH_SET_H_INCLUDED
@@ -161,9 +161,14 @@ public:
    {
    }
 
+   // the buffers are also received from the network, so a corrupt or truncated one must not be read past
    void deserialize(char* data, std::size_t byteSize) override
    {
-      assert(byteSize <= m_size);
+      if (byteSize > m_size)
+      {
+         throw std::runtime_error("Serialized data is truncated");
+      }
+
       m_size -= byteSize;
       std::memcpy(data, m_buffer, byteSize);
       m_buffer += byteSize;
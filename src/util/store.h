@@ -106,6 +106,10 @@ public:
     */
    Allocation construct();
 
+   /** Destruct the T instance constructed at key and release its unit.
+    */
+   void destroy(K key);
+
    /** Destruct all allocated T instances.
     */
    void destruct();
@@ -436,6 +440,15 @@ typename Store<T, K, SegmentSizeBits>::Allocation Store<T, K, SegmentSizeBits>::
    return alloc;
 }
 
+template <typename T, typename K, unsigned SegmentSizeBits>
+void Store<T, K, SegmentSizeBits>::destroy(K key)
+{
+   auto iterPair = get(key);
+   iterPair.first->~T();
+
+   deallocate(key, 1);
+}
+
 template <typename T, typename K, unsigned SegmentSizeBits>
 void Store<T, K, SegmentSizeBits>::destruct()
 {
@@ -21,19 +21,43 @@
 
 #include <ftags.pb.h>
 #include <services.h>
+#include <shared_queue.h>
 
 #include <clang-c/CXCompilationDatabase.h>
 #include <clang-c/Index.h>
 
+#include <clara.hpp>
+
 #include <zmq.hpp>
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <signal.h>
+#include <unistd.h>
+
+// how long to wait for the scanner to answer a request for work before asking again
+const int k_WorkRequestTimeoutMs = 1000;
+
+// how long to wait for the server to answer an upload before giving up on the batch
+const int k_FragmentReplyTimeoutMs = 2 * 60 * 1000;
+
+// when streaming, each thread may have this many translation units uploaded but not yet added
+const unsigned k_MaxStreamedTranslationUnitsInFlight = 4;
+
+// the copy of the server's key dictionary is dropped when it grows past this many strings
+const std::size_t k_MaxKeyDictionaryStrings = 4 * 1024 * 1024;
 
 #if 0
 namespace
@@ -83,6 +107,571 @@ CXChildVisitResult visitTranslationUnit(CXCursor cursor, CXCursor /* parent */,
 } // anonymous namespace
 #endif
 
+namespace
+{
+
+void parseTranslationUnit(ftags::ProjectDb&                      projectDb,
+                          ftags::ParsingSession&                 parsingSession,
+                          const ftags::TranslationUnitArguments& translationUnitArguments,
+                          bool                                   indexEverything)
+{
+   spdlog::info("Processing {}", translationUnitArguments.filename());
+
+   std::vector<const char*> arguments;
+   const int                argCount = translationUnitArguments.argument_size();
+   arguments.reserve(static_cast<size_t>(argCount));
+   for (int ii{0}; ii < argCount; ++ii)
+   {
+      arguments.push_back(translationUnitArguments.argument(ii).c_str());
+   }
+
+   try
+   {
+      projectDb.parseOneFile(parsingSession, translationUnitArguments.filename(), arguments, indexEverything);
+   }
+   catch (const std::runtime_error& re)
+   {
+      spdlog::error("Skipping {}: {}", translationUnitArguments.filename(), re.what());
+   }
+
+   projectDb.assertValid();
+}
+
+using ParsingSessions = std::vector<std::unique_ptr<ftags::ParsingSession>>;
+
+/*
+ * Each thread parses into its own fragment database, so the threads share nothing while libclang
+ * runs; the fragments are merged into the batch database once all translation units are parsed.
+ *
+ * With a memory budget, the threads stop taking translation units once the databases grew past it,
+ * so the ones parsed so far can be uploaded before the rest of the batch is parsed into an empty
+ * database. Returns the position of the first translation unit which was not parsed.
+ */
+int parseIndexRequest(const ftags::IndexRequest& indexRequest,
+                      ftags::ProjectDb&          projectDb,
+                      ParsingSessions&           sessions,
+                      int                        firstTranslationUnit,
+                      std::size_t                maxMemory)
+{
+   const auto translationUnitCount =
+      static_cast<unsigned>(indexRequest.translationunit_size() - firstTranslationUnit);
+   const auto threadCount = std::min(static_cast<unsigned>(sessions.size()), translationUnitCount);
+
+   // the shared header spans refer to the previous batch's database
+   for (auto& session : sessions)
+   {
+      session->restartIndexAction();
+      session->setDeclarationsOnly(indexRequest.declarationsonly(), /* incomplete = */ true);
+   }
+
+   if (threadCount <= 1)
+   {
+      for (int tt = firstTranslationUnit; tt < indexRequest.translationunit_size(); tt++)
+      {
+         parseTranslationUnit(
+            projectDb, *sessions.front(), indexRequest.translationunit(tt), indexRequest.indexeverything());
+
+         if ((maxMemory != 0) && (projectDb.computeSerializedSize() > maxMemory))
+         {
+            return tt + 1;
+         }
+      }
+
+      return indexRequest.translationunit_size();
+   }
+
+   std::vector<ftags::ProjectDb> fragments;
+   fragments.reserve(threadCount);
+
+   std::vector<std::thread> threads;
+   threads.reserve(threadCount);
+
+   std::atomic<int>         nextTranslationUnit{firstTranslationUnit};
+   std::atomic<std::size_t> memoryUsed{0};
+
+   for (unsigned ii = 0; ii < threadCount; ii++)
+   {
+      ftags::ProjectDb& fragment =
+         fragments.emplace_back(/* name = */ projectDb.getName(), /* rootDirectory = */ projectDb.getRoot());
+
+      ftags::ParsingSession& parsingSession = *sessions[ii];
+
+      threads.emplace_back(
+         [&indexRequest, &nextTranslationUnit, &memoryUsed, maxMemory, &fragment, &parsingSession]() {
+            std::size_t fragmentSize = 0;
+
+            while ((maxMemory == 0) || (memoryUsed.load() <= maxMemory))
+            {
+               const int tt = nextTranslationUnit++;
+               if (tt >= indexRequest.translationunit_size())
+               {
+                  break;
+               }
+
+               parseTranslationUnit(
+                  fragment, parsingSession, indexRequest.translationunit(tt), indexRequest.indexeverything());
+
+               if (maxMemory != 0)
+               {
+                  const std::size_t newFragmentSize = fragment.computeSerializedSize();
+                  memoryUsed += newFragmentSize - fragmentSize;
+                  fragmentSize = newFragmentSize;
+               }
+            }
+         });
+   }
+
+   for (auto& thread : threads)
+   {
+      thread.join();
+   }
+
+   for (const auto& fragment : fragments)
+   {
+      projectDb.mergeFrom(fragment);
+   }
+
+   projectDb.assertValid();
+
+   return std::min(nextTranslationUnit.load(), indexRequest.translationunit_size());
+}
+
+/*
+ * Collects the acknowledgements of the uploaded fragments which already arrived, and waits for more
+ * until no more than maxInFlight fragments are outstanding.
+ */
+void collectAcknowledgements(zmq::socket_t& fragmentSocket, unsigned& fragmentsInFlight, unsigned maxInFlight)
+{
+   while (fragmentsInFlight > 0)
+   {
+      const bool mustWait = fragmentsInFlight > maxInFlight;
+
+      zmq::message_t reply;
+      if (!fragmentSocket.recv(&reply, mustWait ? 0 : ZMQ_DONTWAIT))
+      {
+         if (mustWait)
+         {
+            throw std::runtime_error("The server did not acknowledge the uploaded fragments");
+         }
+
+         break;
+      }
+
+      fragmentsInFlight--;
+
+      ftags::Status status;
+      status.ParseFromArray(reply.data(), static_cast<int>(reply.size()));
+      if (status.type() != ftags::Status_Type::Status_Type_TRANSLATION_UNIT_UPDATED)
+      {
+         spdlog::error("Server failed to merge a fragment: {}", ftags::Status::Type_Name(status.type()));
+      }
+   }
+}
+
+void fillIndexingStatistics(const ftags::ParsingStatistics& parsingStatistics,
+                            ftags::IndexingStatistics*      indexingStatistics)
+{
+   using Phase = ftags::ParsingStatistics::Phase;
+
+   indexingStatistics->set_parsenanoseconds(parsingStatistics.getPhaseNanoseconds(Phase::Parse));
+   indexingStatistics->set_visitnanoseconds(parsingStatistics.getPhaseNanoseconds(Phase::Visit));
+   indexingStatistics->set_symboltablenanoseconds(parsingStatistics.getPhaseNanoseconds(Phase::SymbolTable));
+   indexingStatistics->set_recordspansnanoseconds(parsingStatistics.getPhaseNanoseconds(Phase::RecordSpans));
+
+   indexingStatistics->set_translationunits(parsingStatistics.translationUnits);
+   indexingStatistics->set_cursorsvisited(parsingStatistics.cursorsVisited);
+   indexingStatistics->set_cursorskept(parsingStatistics.cursorsKept);
+   indexingStatistics->set_recordsemitted(parsingStatistics.recordsEmitted);
+   indexingStatistics->set_newspans(parsingStatistics.newSpans);
+   indexingStatistics->set_deduplicatedspans(parsingStatistics.deduplicatedSpans);
+   indexingStatistics->set_bytesadded(parsingStatistics.bytesAdded);
+}
+
+zmq::socket_t connectFragmentSocket(zmq::context_t& context, const std::string& fragmentLocation)
+{
+   zmq::socket_t fragmentSocket(context, ZMQ_DEALER);
+   fragmentSocket.setsockopt(ZMQ_RCVTIMEO, k_FragmentReplyTimeoutMs);
+   fragmentSocket.setsockopt(ZMQ_LINGER, 0);
+   fragmentSocket.connect(fragmentLocation);
+
+   return fragmentSocket;
+}
+
+void sendFragment(zmq::socket_t& fragmentSocket, const ftags::Command& command, zmq::message_t& payload)
+{
+   const std::size_t headerSize = command.ByteSizeLong();
+   zmq::message_t    header(headerSize);
+   command.SerializeToArray(header.data(), static_cast<int>(headerSize));
+
+   fragmentSocket.send(header, ZMQ_SNDMORE);
+   fragmentSocket.send(payload);
+}
+
+/*
+ * Asks the server for the keys of the strings the deltas of the batch would send and which are not in
+ * the indexer's copy of the server's key dictionary, then binds the encoder to the dictionary so the
+ * deltas carry the server's keys instead of strings.
+ */
+void resolveKeys(const ftags::ProjectDb&          projectDb,
+                 const ftags::IndexRequest&       indexRequest,
+                 const ftags::Command&            offerCommand,
+                 zmq::socket_t&                   fragmentSocket,
+                 ftags::ProjectDb::KeyDictionary& keyDictionary,
+                 ftags::ProjectDb::StreamEncoder& encoder)
+{
+   std::vector<std::string> fileNames;
+   fileNames.reserve(static_cast<std::size_t>(indexRequest.translationunit_size()));
+   for (const auto& translationUnitArguments : indexRequest.translationunit())
+   {
+      fileNames.push_back(translationUnitArguments.filename());
+   }
+
+   std::vector<std::string> symbolNames;
+   std::vector<std::string> fileNamesToResolve;
+   projectDb.findUnresolvedStrings(fileNames, encoder, keyDictionary, symbolNames, fileNamesToResolve);
+
+   if ((!symbolNames.empty()) || (!fileNamesToResolve.empty()))
+   {
+      ftags::Command command{};
+      command.set_source(offerCommand.source());
+      command.set_type(ftags::Command::Type::Command_Type_RESOLVE_KEYS);
+      command.set_projectname(offerCommand.projectname());
+      command.set_directoryname(offerCommand.directoryname());
+
+      for (const std::string& symbolName : symbolNames)
+      {
+         command.add_resolvesymbolname(symbolName);
+      }
+
+      for (const std::string& fileName : fileNamesToResolve)
+      {
+         command.add_resolvefilename(fileName);
+      }
+
+      zmq::message_t payload;
+      sendFragment(fragmentSocket, command, payload);
+
+      // nothing else is in flight after the offer was answered
+      zmq::message_t reply;
+      if (!fragmentSocket.recv(&reply))
+      {
+         throw std::runtime_error("The server did not resolve the keys");
+      }
+
+      ftags::Status status{};
+      status.ParseFromArray(reply.data(), static_cast<int>(reply.size()));
+
+      if ((status.type() != ftags::Status_Type::Status_Type_KEYS_RESOLVED) ||
+          (status.keydictionaryversion() != keyDictionary.version) ||
+          (static_cast<std::size_t>(status.symbolkey_size()) != symbolNames.size()) ||
+          (static_cast<std::size_t>(status.filenamekey_size()) != fileNamesToResolve.size()))
+      {
+         // the batch is still uploaded, with its strings
+         spdlog::error("Server failed to resolve keys: {}", ftags::Status::Type_Name(status.type()));
+         return;
+      }
+
+      for (std::size_t ii = 0; ii < symbolNames.size(); ii++)
+      {
+         keyDictionary.symbolKeys[std::move(symbolNames[ii])] = status.symbolkey(static_cast<int>(ii));
+      }
+
+      for (std::size_t ii = 0; ii < fileNamesToResolve.size(); ii++)
+      {
+         keyDictionary.fileNameKeys[std::move(fileNamesToResolve[ii])] = status.filenamekey(static_cast<int>(ii));
+      }
+
+      spdlog::info("Resolved {} symbols and {} file names", symbolNames.size(), fileNamesToResolve.size());
+   }
+
+   projectDb.bindReceiverKeys(keyDictionary, encoder);
+}
+
+/*
+ * Uploads a batch as a stream of translation units. The content hashes of its record spans are offered
+ * first, and the server answers with the ones it does not have; the others, such as the spans of the
+ * headers indexed by earlier batches, are sent as references, without their records and strings.
+ * The server answers the offer once it added the translation units uploaded before, so the indexer
+ * parses the next batch while the server adds this one, but it does not run further ahead.
+ */
+void uploadBatch(const ftags::ProjectDb&          projectDb,
+                 const ftags::IndexRequest&       indexRequest,
+                 const std::string&               streamName,
+                 zmq::socket_t&                   fragmentSocket,
+                 unsigned&                        fragmentsInFlight,
+                 ftags::ProjectDb::KeyDictionary& keyDictionary)
+{
+   ftags::Command command{};
+   command.set_source("indexer");
+   command.set_type(ftags::Command::Type::Command_Type_OFFER_RECORD_SPANS);
+   command.set_projectname(projectDb.getName());
+   command.set_directoryname(projectDb.getRoot());
+   command.set_streamname(streamName);
+   command.set_streamsequence(0);
+
+   const std::vector<uint64_t> offeredRecordSpans = projectDb.getRecordSpanContentHashes();
+
+   {
+      const std::size_t payloadSize =
+         ftags::util::Serializer<std::vector<uint64_t>>::computeSerializedSize(offeredRecordSpans);
+      zmq::message_t              payload(payloadSize);
+      ftags::util::BufferInsertor insertor(static_cast<std::byte*>(payload.data()), payloadSize);
+      ftags::util::Serializer<std::vector<uint64_t>>::serialize(offeredRecordSpans, insertor.getInsertor());
+
+      sendFragment(fragmentSocket, command, payload);
+   }
+
+   ftags::Status status{};
+
+   // the acknowledgements of the earlier uploads arrive first
+   while (true)
+   {
+      zmq::message_t reply;
+      if (!fragmentSocket.recv(&reply))
+      {
+         throw std::runtime_error("The server did not answer the offer of record spans");
+      }
+      status.ParseFromArray(reply.data(), static_cast<int>(reply.size()));
+
+      if (status.type() == ftags::Status_Type::Status_Type_RECORD_SPANS_MISSING)
+      {
+         break;
+      }
+
+      fragmentsInFlight--;
+      if (status.type() != ftags::Status_Type::Status_Type_TRANSLATION_UNIT_UPDATED)
+      {
+         spdlog::error("Server failed to merge a fragment: {}", ftags::Status::Type_Name(status.type()));
+      }
+   }
+
+   ftags::ProjectDb::StreamEncoder encoder;
+   encoder.knownRecordSpans.insert(offeredRecordSpans.cbegin(), offeredRecordSpans.cend());
+   for (const uint64_t contentHash : status.recordspanhash())
+   {
+      encoder.knownRecordSpans.erase(contentHash);
+   }
+
+   spdlog::info("Sending {} of {} record spans", status.recordspanhash_size(), offeredRecordSpans.size());
+
+   // the keys of another project, or of the tables of a server which restarted, are of no use
+   if ((keyDictionary.version != status.keydictionaryversion()) ||
+       (keyDictionary.symbolKeys.size() + keyDictionary.fileNameKeys.size() > k_MaxKeyDictionaryStrings))
+   {
+      keyDictionary         = ftags::ProjectDb::KeyDictionary{};
+      keyDictionary.version = status.keydictionaryversion();
+   }
+
+   if (keyDictionary.version != 0)
+   {
+      resolveKeys(projectDb, indexRequest, command, fragmentSocket, keyDictionary, encoder);
+   }
+
+   command.set_type(ftags::Command::Type::Command_Type_UPDATE_TRANSLATION_UNIT_DELTA);
+
+   // the statistics of the batch are reported with its first translation unit
+   fillIndexingStatistics(projectDb.getParsingStatistics(), command.mutable_indexingstatistics());
+
+   for (int tt = 0; tt < indexRequest.translationunit_size(); tt++)
+   {
+      const std::string&     fileName = indexRequest.translationunit(tt).filename();
+      std::vector<std::byte> delta    = projectDb.serializeTranslationUnitDelta(fileName, encoder);
+      if (delta.empty())
+      {
+         continue;
+      }
+
+      command.set_filename(fileName);
+      command.set_streamsequence(command.streamsequence() + 1);
+
+      zmq::message_t payload(delta.data(), delta.size());
+
+      collectAcknowledgements(fragmentSocket, fragmentsInFlight, fragmentsInFlight);
+
+      sendFragment(fragmentSocket, command, payload);
+      fragmentsInFlight++;
+
+      command.clear_indexingstatistics();
+   }
+}
+
+/*
+ * A translation unit parsed by one of the threads, ready to be uploaded; a thread which is done
+ * with the batch posts an empty delta.
+ */
+struct StreamedTranslationUnit
+{
+   unsigned                 stream   = 0;
+   uint64_t                 sequence = 0;
+   std::string              fileName;
+   std::vector<std::byte>   delta;
+   ftags::ParsingStatistics parsingStatistics;
+};
+
+/*
+ * Streaming mode: every translation unit is uploaded as soon as it is parsed, with only the strings
+ * its thread did not upload before in this batch, instead of merging the whole batch first. The
+ * threads still parse into their own fragments, but the fragments only keep the string tables; with
+ * the index action front end they also keep the translation units, whose header spans are shared
+ * with the next ones, until the end of the batch or until the fragment outgrows its share of the
+ * memory budget.
+ */
+void streamIndexRequest(const ftags::IndexRequest& indexRequest,
+                        ParsingSessions&           sessions,
+                        const std::string&         streamPrefix,
+                        zmq::socket_t&             fragmentSocket,
+                        unsigned&                  fragmentsInFlight,
+                        std::size_t                maxMemory)
+{
+   const auto translationUnitCount = static_cast<unsigned>(indexRequest.translationunit_size());
+   const auto threadCount          = std::min(static_cast<unsigned>(sessions.size()), translationUnitCount);
+
+   for (auto& session : sessions)
+   {
+      session->restartIndexAction();
+      session->setDeclarationsOnly(indexRequest.declarationsonly(), /* incomplete = */ true);
+   }
+
+   std::vector<ftags::ProjectDb> fragments;
+   fragments.reserve(threadCount);
+
+   std::vector<std::thread> threads;
+   threads.reserve(threadCount);
+
+   std::atomic<int> nextTranslationUnit{0};
+
+   ftags::shared_queue<StreamedTranslationUnit> parsedTranslationUnits;
+
+   for (unsigned ii = 0; ii < threadCount; ii++)
+   {
+      ftags::ProjectDb& fragment = fragments.emplace_back(/* name = */ indexRequest.projectname(),
+                                                          /* rootDirectory = */ indexRequest.directoryname());
+
+      ftags::ParsingSession& parsingSession = *sessions[ii];
+
+      const std::size_t maxFragmentMemory = maxMemory / threadCount;
+
+      threads.emplace_back(
+         [ii, &indexRequest, &nextTranslationUnit, &fragment, &parsingSession, &parsedTranslationUnits,
+          maxFragmentMemory]() {
+            const bool keepTranslationUnits =
+               parsingSession.getFrontEnd() == ftags::ParsingSession::FrontEnd::IndexAction;
+
+            std::vector<std::string> keptTranslationUnits;
+
+            ftags::ProjectDb::StreamEncoder encoder;
+            uint64_t                        sequence = 0;
+
+            for (int tt = nextTranslationUnit++; tt < indexRequest.translationunit_size(); tt = nextTranslationUnit++)
+            {
+               const ftags::TranslationUnitArguments& translationUnitArguments = indexRequest.translationunit(tt);
+
+               const ftags::ParsingStatistics previousStatistics = fragment.getParsingStatistics();
+
+               parseTranslationUnit(
+                  fragment, parsingSession, translationUnitArguments, indexRequest.indexeverything());
+
+               StreamedTranslationUnit parsed;
+               parsed.stream            = ii;
+               parsed.fileName          = translationUnitArguments.filename();
+               parsed.delta             = fragment.serializeTranslationUnitDelta(parsed.fileName, encoder);
+               parsed.parsingStatistics = fragment.getParsingStatistics();
+               parsed.parsingStatistics -= previousStatistics;
+
+               if (parsed.delta.empty())
+               {
+                  // failed to parse
+                  continue;
+               }
+
+               parsed.sequence = sequence++;
+
+               if (!keepTranslationUnits)
+               {
+                  fragment.removeTranslationUnit(parsed.fileName);
+               }
+               else
+               {
+                  keptTranslationUnits.push_back(parsed.fileName);
+
+                  // they were uploaded already; the next translation units index their headers again
+                  if ((maxFragmentMemory != 0) && (fragment.computeSerializedSize() > maxFragmentMemory))
+                  {
+                     for (const std::string& fileName : keptTranslationUnits)
+                     {
+                        fragment.removeTranslationUnit(fileName);
+                     }
+
+                     keptTranslationUnits.clear();
+                     parsingSession.restartIndexAction();
+                  }
+               }
+
+               parsedTranslationUnits.push(std::move(parsed));
+            }
+
+            parsedTranslationUnits.push(StreamedTranslationUnit{});
+         });
+   }
+
+   ftags::Command command{};
+   command.set_source("indexer");
+   command.set_type(ftags::Command::Type::Command_Type_UPDATE_TRANSLATION_UNIT_DELTA);
+   command.set_projectname(indexRequest.projectname());
+   command.set_directoryname(indexRequest.directoryname());
+
+   // once an upload fails, the threads stop after their current translation unit, and are waited for
+   std::exception_ptr uploadError;
+
+   for (unsigned threadsRunning = threadCount; threadsRunning > 0;)
+   {
+      StreamedTranslationUnit parsed = parsedTranslationUnits.pop();
+      if (parsed.delta.empty())
+      {
+         threadsRunning--;
+         continue;
+      }
+
+      if (uploadError != nullptr)
+      {
+         continue;
+      }
+
+      command.set_filename(parsed.fileName);
+      command.set_streamname(fmt::format("{}/{}", streamPrefix, parsed.stream));
+      command.set_streamsequence(parsed.sequence);
+      fillIndexingStatistics(parsed.parsingStatistics, command.mutable_indexingstatistics());
+
+      zmq::message_t payload(parsed.delta.data(), parsed.delta.size());
+
+      try
+      {
+         collectAcknowledgements(
+            fragmentSocket, fragmentsInFlight, threadCount * k_MaxStreamedTranslationUnitsInFlight - 1);
+
+         sendFragment(fragmentSocket, command, payload);
+         fragmentsInFlight++;
+      }
+      catch (const std::exception& /* ex */)
+      {
+         uploadError         = std::current_exception();
+         nextTranslationUnit = indexRequest.translationunit_size();
+      }
+   }
+
+   for (auto& thread : threads)
+   {
+      thread.join();
+   }
+
+   if (uploadError != nullptr)
+   {
+      std::rethrow_exception(uploadError);
+   }
+}
+
+} // anonymous namespace
+
 static volatile int s_interrupted = 0;
 
 static void signalHandler(int /* signal_value */)
@@ -102,8 +691,41 @@ static void setupSignals(void)
    sigaction(SIGTERM, &action, NULL);
 }
 
-int main()
+int main(int argc, char* argv[])
 {
+   bool        showHelp         = false;
+   bool        indexHeadersOnce = false;
+   unsigned    threadCount      = std::max(1U, std::thread::hardware_concurrency());
+   std::string workerId;
+   unsigned    idleExitSeconds = 0;
+   bool        streamResults   = false;
+   std::size_t maxMemoryMB     = 0;
+
+   auto cli = clara::Help(showHelp) |
+              clara::Opt(threadCount, "threads")["-j"]["--threads"]("How many translation units to parse in parallel") |
+              clara::Opt(indexHeadersOnce)["--index-headers-once"](
+                 "Use libclang's indexing API and index every header only once per batch and thread") |
+              clara::Opt(workerId, "id")["--worker-id"](
+                 "Identify to the scanner as this worker, so that a restarted indexer gets the lost work back") |
+              clara::Opt(idleExitSeconds, "seconds")["--idle-exit"]("Exit after having no work for this long") |
+              clara::Opt(streamResults)["--stream"](
+                 "Upload every translation unit as soon as it is parsed, instead of the whole batch at the end") |
+              clara::Opt(maxMemoryMB, "megabytes")["--max-memory"](
+                 "Upload the part of a batch parsed so far once the indexed data grows past this size");
+
+   auto result = cli.parse(clara::Args(argc, argv));
+   if (!result)
+   {
+      std::cerr << "Failed to parse command line options: " << result.errorMessage() << std::endl;
+      exit(-1);
+   }
+
+   if (showHelp)
+   {
+      std::cout << cli << std::endl;
+      exit(0);
+   }
+
    GOOGLE_PROTOBUF_VERIFY_VERSION;
 
    setupSignals();
@@ -112,93 +734,169 @@ int main()
 
    ftags::ZmqCentralLogger centralLogger{context, std::string{"indexer"}};
 
-   spdlog::info("Indexer started");
-
-   zmq::socket_t receiver(context, ZMQ_PULL);
+   spdlog::info("Indexer started with {} threads", threadCount);
+
+   const std::size_t maxMemoryBytes = maxMemoryMB * 1024 * 1024;
+
+   /*
+    * Work is requested from the scanner one batch at a time. Requests are only queued on a live
+    * connection, so an indexer started before the scanner, or one whose request was lost when the
+    * previous scanner exited, keeps asking until a scanner answers. The repeated requests carry the
+    * same sequence number, so the scanner answers only one of them.
+    */
+   zmq::socket_t receiver(context, ZMQ_DEALER);
+   receiver.setsockopt(ZMQ_IMMEDIATE, 1);
+   receiver.setsockopt(ZMQ_SNDTIMEO, k_WorkRequestTimeoutMs);
+   receiver.setsockopt(ZMQ_RCVTIMEO, k_WorkRequestTimeoutMs);
+   receiver.setsockopt(ZMQ_LINGER, 0);
+   if (!workerId.empty())
+   {
+      receiver.setsockopt(ZMQ_IDENTITY, workerId.data(), workerId.size());
+   }
 
    const char*       xdgRuntimeDir    = std::getenv("XDG_RUNTIME_DIR");
    const std::string connectionString = fmt::format("ipc://{}/ftags_worker", xdgRuntimeDir);
    receiver.connect(connectionString);
 
-   const std::string serverLocation = fmt::format("ipc://{}/ftags_server", xdgRuntimeDir);
-   zmq::socket_t     serverSocket(context, ZMQ_REQ);
-   serverSocket.connect(serverLocation);
+   std::random_device randomDevice;
+
+   ftags::WorkRequest workRequest{};
+   workRequest.set_threadcount(threadCount);
+   workRequest.set_instance((uint64_t{randomDevice()} << 32U) | randomDevice());
+   workRequest.set_sequence(0);
+
+   const std::string fragmentLocation = fmt::format("ipc://{}/ftags_fragments", xdgRuntimeDir);
+   zmq::socket_t     fragmentSocket = connectFragmentSocket(context, fragmentLocation);
+
+   unsigned fragmentsInFlight = 0;
+
+   // the name of the stream the batches are uploaded on; when streaming, each thread has its own
+   const std::string streamPrefix = workerId.empty() ? fmt::format("indexer-{}", getpid()) : workerId;
+
+   // the keys of the strings this indexer uploaded, kept across batches
+   ftags::ProjectDb::KeyDictionary keyDictionary;
 
    spdlog::info("Connection established");
 
+   /*
+    * The libclang index is created once per thread and reused for all the batches it parses.
+    */
+   const ftags::ParsingSession::FrontEnd frontEnd =
+      indexHeadersOnce ? ftags::ParsingSession::FrontEnd::IndexAction : ftags::ParsingSession::FrontEnd::CursorVisitor;
+
+   ParsingSessions sessions;
+   for (unsigned ii = 0; ii < std::max(1U, threadCount); ii++)
+   {
+      sessions.push_back(std::make_unique<ftags::ParsingSession>(ftags::ParsingSession::Profile::Batch, frontEnd));
+   }
+
    bool shutdownRequested{false};
+   bool isWaiting{false};
+
+   auto lastWorkTimestamp = std::chrono::steady_clock::now();
 
    while (!shutdownRequested)
    {
       try
       {
+         if (!isWaiting)
+         {
+            spdlog::info("Waiting");
+            isWaiting = true;
+         }
+
+         const std::size_t workRequestSize = workRequest.ByteSizeLong();
+         zmq::message_t    request(workRequestSize);
+         workRequest.SerializeToArray(request.data(), static_cast<int>(workRequestSize));
+
          zmq::message_t message;
-         spdlog::info("Waiting");
-         receiver.recv(&message);
+         if (!receiver.send(request) || !receiver.recv(&message))
+         {
+            collectAcknowledgements(fragmentSocket, fragmentsInFlight, fragmentsInFlight);
+
+            if (s_interrupted)
+            {
+               spdlog::debug("interrupt received; stopping worker");
+               break;
+            }
+
+            if ((idleExitSeconds != 0) &&
+                (std::chrono::steady_clock::now() - lastWorkTimestamp > std::chrono::seconds(idleExitSeconds)))
+            {
+               spdlog::info("No work for {} seconds", idleExitSeconds);
+               break;
+            }
+
+            continue;
+         }
+
+         isWaiting = false;
+         workRequest.set_sequence(workRequest.sequence() + 1);
 
          ftags::IndexRequest indexRequest{};
          indexRequest.ParseFromArray(message.data(), static_cast<int>(message.size()));
          shutdownRequested = indexRequest.shutdownafter();
 
-         spdlog::info("Received index request with {} translation units", indexRequest.translationunit_size());
+         spdlog::info("Received index request with {} translation units{}",
+                      indexRequest.translationunit_size(),
+                      indexRequest.declarationsonly() ? " (declarations only)" : "");
+
+         if (streamResults)
+         {
+            streamIndexRequest(
+               indexRequest, sessions, streamPrefix, fragmentSocket, fragmentsInFlight, maxMemoryBytes);
 
-         ftags::ProjectDb projectDb{/* name = */ indexRequest.projectname(),
-                                    /* rootDirectory = */ indexRequest.directoryname()};
+            lastWorkTimestamp = std::chrono::steady_clock::now();
+            continue;
+         }
 
-         for (int tt = 0; tt < indexRequest.translationunit_size(); tt++)
+         // past the memory budget, the translation units parsed so far are uploaded before the others
+         for (int firstTranslationUnit = 0; firstTranslationUnit < indexRequest.translationunit_size();)
          {
-            ftags::TranslationUnitArguments translationUnitArguments = indexRequest.translationunit(tt);
+            ftags::ProjectDb projectDb{/* name = */ indexRequest.projectname(),
+                                       /* rootDirectory = */ indexRequest.directoryname()};
 
-            spdlog::info("Processing {}", translationUnitArguments.filename());
+            const int nextTranslationUnit =
+               parseIndexRequest(indexRequest, projectDb, sessions, firstTranslationUnit, maxMemoryBytes);
 
-            std::vector<const char*> arguments;
-            const int                argCount = translationUnitArguments.argument_size();
-            arguments.reserve(static_cast<size_t>(argCount));
-            for (int ii{0}; ii < argCount; ++ii)
+            if (nextTranslationUnit < indexRequest.translationunit_size())
             {
-               arguments.push_back(translationUnitArguments.argument(ii).c_str());
+               spdlog::info("Memory budget exceeded; uploading {} of the remaining {} translation units",
+                            nextTranslationUnit - firstTranslationUnit,
+                            indexRequest.translationunit_size() - firstTranslationUnit);
             }
 
-            projectDb.parseOneFile(translationUnitArguments.filename(), arguments, indexRequest.indexeverything());
+            const ftags::ParsingStatistics& parsingStatistics = projectDb.getParsingStatistics();
 
-            projectDb.assertValid();
-         }
+            spdlog::info("Batch parsed in {:n} ms and visited in {:n} ms; kept {:n} of {:n} cursors",
+                         parsingStatistics.getPhaseNanoseconds(ftags::ParsingStatistics::Phase::Parse) / 1000000,
+                         parsingStatistics.getPhaseNanoseconds(ftags::ParsingStatistics::Phase::Visit) / 1000000,
+                         parsingStatistics.cursorsKept,
+                         parsingStatistics.cursorsVisited);
 
-         ftags::Command command{};
-         command.set_source("indexer");
-         command.set_type(ftags::Command::Type::Command_Type_UPDATE_TRANSLATION_UNIT);
-         command.set_projectname(projectDb.getName());
-         command.set_directoryname(projectDb.getRoot());
+            uploadBatch(projectDb, indexRequest, streamPrefix, fragmentSocket, fragmentsInFlight, keyDictionary);
 
-         for (int tt = 0; tt < indexRequest.translationunit_size(); tt++)
-         {
-            command.add_translationunit(indexRequest.translationunit(tt).filename());
+            firstTranslationUnit = nextTranslationUnit;
          }
 
-         const std::size_t headerSize = command.ByteSizeLong();
-         zmq::message_t    header(headerSize);
-         command.SerializeToArray(header.data(), static_cast<int>(headerSize));
-         serverSocket.send(header, ZMQ_SNDMORE);
-
-         const std::size_t           payloadSize = projectDb.computeSerializedSize();
-         zmq::message_t              projectMessage(payloadSize);
-         ftags::util::BufferInsertor insertor(static_cast<std::byte*>(projectMessage.data()), payloadSize);
-         projectDb.serialize(insertor.getInsertor());
-
-         serverSocket.send(projectMessage);
-
-         /*
-          * wait for the server to acknowledge
-          */
-         zmq::message_t reply;
-         serverSocket.recv(&reply);
-         ftags::Status status;
-         status.ParseFromArray(reply.data(), static_cast<int>(reply.size()));
+         lastWorkTimestamp = std::chrono::steady_clock::now();
       }
       catch (zmq::error_t& ze)
       {
          spdlog::error("0mq exception: {}", ze.what());
       }
+      catch (const std::runtime_error& re)
+      {
+         /*
+          * The server restarted or dropped a reply. The replies still due would be taken for those of the
+          * next uploads, so the connection is started afresh, with a new stream and without the keys.
+          */
+         spdlog::error("Failed to upload the batch: {}", re.what());
+
+         fragmentSocket    = connectFragmentSocket(context, fragmentLocation);
+         fragmentsInFlight = 0;
+         keyDictionary     = ftags::ProjectDb::KeyDictionary{};
+      }
       if (s_interrupted)
       {
          spdlog::debug("interrupt received; stopping worker");
@@ -206,6 +904,20 @@ int main()
       }
    }
 
+   // the server may still be merging the last fragments
+   try
+   {
+      collectAcknowledgements(fragmentSocket, fragmentsInFlight, 0);
+   }
+   catch (zmq::error_t& ze)
+   {
+      spdlog::error("0mq exception: {}", ze.what());
+   }
+   catch (const std::runtime_error& re)
+   {
+      spdlog::error("{}; the last {} fragments may be lost", re.what(), fragmentsInFlight);
+   }
+
    spdlog::info("Indexer shutting down");
 
    return 0;
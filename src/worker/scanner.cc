@@ -19,8 +19,8 @@
 #include <ftags.pb.h>
 #include <services.h>
 
-#include <clang-c/CXCompilationDatabase.h>
-#include <clang-c/Index.h>
+#include <compile_commands_reader.h>
+#include <file_watcher.h>
 
 #include <clara.hpp>
 
@@ -28,29 +28,641 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <chrono>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
 #include <string>
-#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 const int k_DefaultGroupSize = 5;
 
+// checking fingerprints reads every source and header in the project
+const int k_FingerprintTimeoutMs = 60 * 1000;
+
+// without any parse times from the server, assume about 20 ms per kB of source
+const uint64_t k_DefaultNanosecondsPerCostUnit = 20 * 1000;
+
+// an included header usually weighs much more than a line in the source file itself
+const uint64_t k_IncludeCostUnits = 4 * 1024;
+
+// after all the work is handed out, how long to wait for news from the indexers still working
+const int k_OutstandingWorkTimeoutMs = 10 * 60 * 1000;
+
+// a translation unit lost with this many batches is handed out alone, and dropped if it is lost again
+const unsigned k_IsolateAfterLosses = 2;
+
+// how many of the already indexed translation units are read to relate their cost estimate to their parse time
+const std::size_t k_CalibrationSampleSize = 64;
+
+// the compilation database is read and scheduled this many entries at a time
+const std::size_t k_ScanChunkSize = 1024;
+
+// while watching the project, the changes are handled once none arrived for this long
+const int k_WatchQuietPeriodMs = 1000;
+
+// but at most this long after the first one, even if more keep arriving
+const int k_WatchMaxDelayMs = 15 * 1000;
+
+namespace
+{
+
+// what the server remembers about a translation unit from when it was last indexed; zero if not known
+struct IndexingHistory
+{
+   uint64_t parseNanoseconds = 0;
+   uint64_t includeSignature = 0;
+};
+
+/*
+ * Asks the server which translation units are unchanged since they were last indexed and removes
+ * them from the list, unless keepUnchanged is set. Returns the indexing history of each of the
+ * remaining translation units. If the server does not know the project or does not answer, nothing
+ * is removed and no history is known.
+ */
+std::vector<IndexingHistory> checkIndexedTranslationUnits(zmq::context_t&    context,
+                                                          const std::string& projectName,
+                                                          const std::string& dirName,
+                                                          bool               keepUnchanged,
+                                                          std::vector<ftags::TranslationUnitArguments>& translationUnits)
+{
+   std::vector<IndexingHistory> history(/* __n = */ translationUnits.size());
+
+   const char*       xdgRuntimeDir  = std::getenv("XDG_RUNTIME_DIR");
+   const std::string serverLocation = fmt::format("ipc://{}/ftags_server", xdgRuntimeDir);
+
+   zmq::socket_t serverSocket(context, ZMQ_REQ);
+   serverSocket.setsockopt(ZMQ_RCVTIMEO, k_FingerprintTimeoutMs);
+   serverSocket.setsockopt(ZMQ_LINGER, 0);
+   serverSocket.connect(serverLocation);
+
+   ftags::Command command{};
+   command.set_source("scanner");
+   command.set_type(ftags::Command::Type::Command_Type_CHECK_FINGERPRINTS);
+   command.set_projectname(projectName);
+   command.set_directoryname(dirName);
+
+   for (const auto& translationUnit : translationUnits)
+   {
+      *command.add_translationunitarguments() = translationUnit;
+   }
+
+   const std::size_t requestSize = command.ByteSizeLong();
+   zmq::message_t    request(requestSize);
+   command.SerializeToArray(request.data(), static_cast<int>(requestSize));
+   serverSocket.send(request);
+
+   zmq::message_t reply;
+   if (!serverSocket.recv(&reply))
+   {
+      spdlog::warn("Server did not answer; indexing all {} translation units", translationUnits.size());
+      return history;
+   }
+
+   ftags::Status status;
+   status.ParseFromArray(reply.data(), static_cast<int>(reply.size()));
+
+   if (status.type() != ftags::Status_Type::Status_Type_TRANSLATION_UNITS_CURRENT)
+   {
+      spdlog::info("Project {} is not indexed yet; indexing all translation units", projectName);
+      return history;
+   }
+
+   if ((static_cast<std::size_t>(status.parsenanoseconds_size()) == translationUnits.size()) &&
+       (static_cast<std::size_t>(status.includesignature_size()) == translationUnits.size()))
+   {
+      for (std::size_t ii = 0; ii < translationUnits.size(); ii++)
+      {
+         history[ii].parseNanoseconds = status.parsenanoseconds(static_cast<int>(ii));
+         history[ii].includeSignature = status.includesignature(static_cast<int>(ii));
+      }
+   }
+
+   if (keepUnchanged)
+   {
+      return history;
+   }
+
+   const std::unordered_set<std::string> unchanged(status.translationunit().begin(), status.translationunit().end());
+
+   std::size_t remaining = 0;
+   for (std::size_t ii = 0; ii < translationUnits.size(); ii++)
+   {
+      if (unchanged.count(translationUnits[ii].filename()) == 0)
+      {
+         translationUnits[remaining].Swap(&translationUnits[ii]);
+         history[remaining] = history[ii];
+         remaining++;
+      }
+   }
+
+   translationUnits.resize(remaining);
+   history.resize(remaining);
+
+   spdlog::info("Skipping {} unchanged translation units", unchanged.size());
+
+   return history;
+}
+
+/*
+ * Asks the server which of the indexed translation units read any of the files when they were
+ * indexed. If the server does not know the project or does not answer, none are known.
+ */
+std::unordered_set<std::string> findDependentTranslationUnits(zmq::context_t&                 context,
+                                                              const std::string&              projectName,
+                                                              const std::string&              dirName,
+                                                              const std::vector<std::string>& fileNames)
+{
+   std::unordered_set<std::string> dependents;
+
+   const char*       xdgRuntimeDir  = std::getenv("XDG_RUNTIME_DIR");
+   const std::string serverLocation = fmt::format("ipc://{}/ftags_server", xdgRuntimeDir);
+
+   zmq::socket_t serverSocket(context, ZMQ_REQ);
+   serverSocket.setsockopt(ZMQ_RCVTIMEO, k_FingerprintTimeoutMs);
+   serverSocket.setsockopt(ZMQ_LINGER, 0);
+   serverSocket.connect(serverLocation);
+
+   ftags::Command command{};
+   command.set_source("scanner");
+   command.set_type(ftags::Command::Type::Command_Type_FIND_DEPENDENT_TRANSLATION_UNITS);
+   command.set_projectname(projectName);
+   command.set_directoryname(dirName);
+
+   for (const auto& fileName : fileNames)
+   {
+      command.add_translationunit(fileName);
+   }
+
+   const std::size_t requestSize = command.ByteSizeLong();
+   zmq::message_t    request(requestSize);
+   command.SerializeToArray(request.data(), static_cast<int>(requestSize));
+   serverSocket.send(request);
+
+   zmq::message_t reply;
+   if (!serverSocket.recv(&reply))
+   {
+      spdlog::warn("Server did not answer; the translation units including the changed files are not known");
+      return dependents;
+   }
+
+   ftags::Status status;
+   status.ParseFromArray(reply.data(), static_cast<int>(reply.size()));
+
+   if (status.type() == ftags::Status_Type::Status_Type_DEPENDENT_TRANSLATION_UNITS)
+   {
+      dependents.insert(status.translationunit().begin(), status.translationunit().end());
+   }
+
+   return dependents;
+}
+
+/*
+ * Estimates the cost of parsing a source file from its size and from how many headers it includes
+ * directly; returns zero if the file cannot be read.
+ */
+uint64_t estimateCostUnits(const std::string& fileName)
+{
+   std::ifstream input{fileName};
+   if (!input)
+   {
+      return 0;
+   }
+
+   uint64_t    costUnits = 0;
+   std::string line;
+   while (std::getline(input, line))
+   {
+      costUnits += line.size() + 1;
+
+      const auto first = line.find_first_not_of(" \t");
+      if ((first != std::string::npos) && (line[first] == '#') &&
+          (line.find("include", first + 1) != std::string::npos))
+      {
+         costUnits += k_IncludeCostUnits;
+      }
+   }
+
+   return std::max<uint64_t>(costUnits, 1);
+}
+
+/*
+ * Translation units which were indexed before are expected to take as long as they did then; the
+ * cost of the others is estimated from their sources, scaled by how the estimates of a sample of the
+ * known ones relate to their parse times.
+ */
+std::vector<uint64_t> estimateParseNanoseconds(const std::vector<ftags::TranslationUnitArguments>& translationUnits,
+                                               const std::vector<IndexingHistory>&                 history)
+{
+   std::vector<uint64_t> parseNanoseconds(/* __n = */ translationUnits.size());
+   std::transform(history.cbegin(), history.cend(), parseNanoseconds.begin(), [](const IndexingHistory& entry) {
+      return entry.parseNanoseconds;
+   });
+
+   uint64_t sampleNanoseconds = 0;
+   uint64_t sampleCostUnits   = 0;
+   for (std::size_t ii = 0, sampled = 0; (ii < translationUnits.size()) && (sampled < k_CalibrationSampleSize); ii++)
+   {
+      if (parseNanoseconds[ii] != 0)
+      {
+         const uint64_t costUnits = estimateCostUnits(translationUnits[ii].filename());
+         if (costUnits != 0)
+         {
+            sampleNanoseconds += parseNanoseconds[ii];
+            sampleCostUnits += costUnits;
+            sampled++;
+         }
+      }
+   }
+
+   const double nanosecondsPerCostUnit =
+      (sampleCostUnits != 0) ? static_cast<double>(sampleNanoseconds) / static_cast<double>(sampleCostUnits)
+                             : static_cast<double>(k_DefaultNanosecondsPerCostUnit);
+
+   std::vector<std::size_t> unreadable;
+   uint64_t                 totalNanoseconds = 0;
+
+   for (std::size_t ii = 0; ii < translationUnits.size(); ii++)
+   {
+      if (parseNanoseconds[ii] == 0)
+      {
+         const uint64_t costUnits = estimateCostUnits(translationUnits[ii].filename());
+         if (costUnits == 0)
+         {
+            unreadable.push_back(ii);
+            continue;
+         }
+
+         parseNanoseconds[ii] =
+            std::max<uint64_t>(static_cast<uint64_t>(static_cast<double>(costUnits) * nanosecondsPerCostUnit), 1);
+      }
+
+      totalNanoseconds += parseNanoseconds[ii];
+   }
+
+   // the sources which cannot be read here are assumed to be average
+   const std::size_t estimated = translationUnits.size() - unreadable.size();
+   const uint64_t    average   = (estimated != 0) ? std::max<uint64_t>(totalNanoseconds / estimated, 1) : 1;
+   for (const std::size_t ii : unreadable)
+   {
+      parseNanoseconds[ii] = average;
+   }
+
+   return parseNanoseconds;
+}
+
+/*
+ * Translation units with the same locality key probably include many of the same headers: either
+ * they shared project headers when they were last indexed, or they live in the same directory.
+ */
+std::vector<uint64_t> computeLocalityKeys(const std::vector<ftags::TranslationUnitArguments>& translationUnits,
+                                          const std::vector<IndexingHistory>&                 history)
+{
+   std::vector<uint64_t> localityKeys(/* __n = */ translationUnits.size());
+
+   for (std::size_t ii = 0; ii < translationUnits.size(); ii++)
+   {
+      if (history[ii].includeSignature != 0)
+      {
+         localityKeys[ii] = history[ii].includeSignature;
+      }
+      else
+      {
+         const std::filesystem::path sourcePath{translationUnits[ii].filename()};
+         localityKeys[ii] = std::hash<std::string>{}(sourcePath.parent_path().string());
+      }
+   }
+
+   return localityKeys;
+}
+
+/*
+ * Hands out the translation units to the indexers as they ask for work, the longest first. The
+ * batches start with one translation unit per indexer thread and grow with the cheaper translation
+ * units towards the end, but never beyond a share of the remaining work, so that the indexers run
+ * out of work at about the same time instead of waiting for one slow batch.
+ *
+ * Each batch is filled with translation units which share a locality key with its longest one, so
+ * that their headers are parsed and their record spans deduplicated within the batch, and only
+ * then with the longest remaining ones.
+ */
+class WorkQueue
+{
+public:
+   struct Item
+   {
+      const ftags::TranslationUnitArguments* translationUnit;
+      uint64_t                               parseNanoseconds;
+      std::size_t                            group;
+      bool                                   declarationsOnly;
+      bool                                   isTaken;
+      unsigned                               lossCount;
+   };
+
+   // items of the same pass are scheduled longest first; the passes are scheduled in order
+   void addPass(const std::vector<ftags::TranslationUnitArguments>& translationUnits,
+                const std::vector<uint64_t>&                        parseNanoseconds,
+                const std::vector<uint64_t>&                        localityKeys,
+                bool                                                declarationsOnly)
+   {
+      const std::size_t passBegin = m_items.size();
+
+      std::vector<std::size_t> order(/* __n = */ translationUnits.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::stable_sort(order.begin(), order.end(), [&parseNanoseconds](std::size_t left, std::size_t right) {
+         return parseNanoseconds[left] > parseNanoseconds[right];
+      });
+
+      std::unordered_map<uint64_t, std::size_t> groupIndex;
+
+      for (const std::size_t ii : order)
+      {
+         const auto [iter, isNew] = groupIndex.try_emplace(localityKeys[ii], m_groups.size());
+         if (isNew)
+         {
+            m_groups.emplace_back();
+         }
+
+         m_groups[iter->second].items.push_back(m_items.size());
+         m_items.push_back({&translationUnits[ii], parseNanoseconds[ii], iter->second, declarationsOnly, false, 0});
+         m_remainingNanoseconds += parseNanoseconds[ii];
+      }
+
+      m_remainingCount += m_items.size() - passBegin;
+   }
+
+   bool isEmpty() const noexcept
+   {
+      return m_remainingCount == 0;
+   }
+
+   std::size_t getRemainingCount() const noexcept
+   {
+      return m_remainingCount;
+   }
+
+   uint64_t getRemainingNanoseconds() const noexcept
+   {
+      return m_remainingNanoseconds;
+   }
+
+   std::size_t getGroupCount() const noexcept
+   {
+      return m_groups.size();
+   }
+
+   /*
+    * Returns the items to hand out to a worker with threadCount threads, when workerCount workers
+    * share the remaining work.
+    */
+   std::vector<std::size_t>
+   selectBatch(unsigned threadCount, std::size_t workerCount, std::size_t maxBatchSize) const
+   {
+      const uint64_t targetNanoseconds = m_remainingNanoseconds / (2 * std::max<std::size_t>(workerCount, 1));
+
+      const Item& first = m_items[m_next];
+
+      std::vector<std::size_t> batch{m_next};
+      uint64_t                 batchNanoseconds = first.parseNanoseconds;
+
+      // a translation unit which may crash the indexer does not take others down with it
+      if (first.lossCount >= k_IsolateAfterLosses)
+      {
+         return batch;
+      }
+
+      // returns false once no more items can be added in the order they are offered
+      const auto add = [&](std::size_t candidate) {
+         const Item& item = m_items[candidate];
+         if (item.isTaken || (item.lossCount >= k_IsolateAfterLosses) ||
+             (std::find(batch.cbegin(), batch.cend(), candidate) != batch.cend()))
+         {
+            return true;
+         }
+
+         if ((item.declarationsOnly != first.declarationsOnly) || (batch.size() >= maxBatchSize))
+         {
+            return false;
+         }
+
+         if ((batch.size() >= threadCount) && (batchNanoseconds + item.parseNanoseconds > targetNanoseconds))
+         {
+            return false;
+         }
+
+         batch.push_back(candidate);
+         batchNanoseconds += item.parseNanoseconds;
+         return true;
+      };
+
+      const Group& group = m_groups[first.group];
+      for (std::size_t ii = group.next; ii < group.items.size(); ii++)
+      {
+         if (!add(group.items[ii]))
+         {
+            break;
+         }
+      }
+
+      // keep all the threads busy, even if there are not enough translation units in the group
+      for (std::size_t ii = m_next + 1; (ii < m_items.size()) && (batch.size() < threadCount); ii++)
+      {
+         if (!add(ii))
+         {
+            break;
+         }
+      }
+
+      return batch;
+   }
+
+   const Item& getItem(std::size_t index) const noexcept
+   {
+      return m_items[index];
+   }
+
+   /*
+    * Puts back the items of a batch which was lost, unless they were already handed out alone and
+    * lost again; returns the items which are dropped.
+    */
+   std::vector<std::size_t> requeue(const std::vector<std::size_t>& batch)
+   {
+      std::vector<std::size_t> dropped;
+
+      for (const std::size_t index : batch)
+      {
+         Item& item = m_items[index];
+         if (item.lossCount >= k_IsolateAfterLosses)
+         {
+            dropped.push_back(index);
+            continue;
+         }
+
+         item.lossCount++;
+         item.isTaken = false;
+         m_remainingNanoseconds += item.parseNanoseconds;
+         m_remainingCount++;
+
+         Group&     group    = m_groups[item.group];
+         const auto position = static_cast<std::size_t>(
+            std::find(group.items.cbegin(), group.items.cend(), index) - group.items.cbegin());
+         group.next = std::min(group.next, position);
+
+         m_next = std::min(m_next, index);
+      }
+
+      return dropped;
+   }
+
+   void pop(const std::vector<std::size_t>& batch) noexcept
+   {
+      for (const std::size_t index : batch)
+      {
+         Item& item   = m_items[index];
+         item.isTaken = true;
+         m_remainingNanoseconds -= item.parseNanoseconds;
+         m_remainingCount--;
+
+         Group& group = m_groups[item.group];
+         while ((group.next < group.items.size()) && m_items[group.items[group.next]].isTaken)
+         {
+            group.next++;
+         }
+      }
+
+      while ((m_next < m_items.size()) && m_items[m_next].isTaken)
+      {
+         m_next++;
+      }
+   }
+
+private:
+   struct Group
+   {
+      std::vector<std::size_t> items;
+      std::size_t              next = 0;
+   };
+
+   std::vector<Item>  m_items;
+   std::vector<Group> m_groups;
+
+   std::size_t m_next                 = 0;
+   std::size_t m_remainingCount       = 0;
+   uint64_t    m_remainingNanoseconds = 0;
+};
+
+/*
+ * A part of the compilation database, scheduled as soon as it is read; the work queue refers to its
+ * translation units, so the chunks are kept until the scanner is done.
+ */
+struct ScannedChunk
+{
+   std::vector<ftags::TranslationUnitArguments> translationUnits;
+   std::vector<uint64_t>                        parseNanoseconds;
+   std::vector<uint64_t>                        localityKeys;
+};
+
+// returns false if there are no more entries in the compilation database
+bool readChunk(ftags::util::CompileCommandsReader&           reader,
+               std::vector<ftags::TranslationUnitArguments>& translationUnits)
+{
+   ftags::util::CompileCommandsReader::CompileCommand compileCommand;
+
+   while (translationUnits.size() < k_ScanChunkSize)
+   {
+      if (!reader.readNext(compileCommand))
+      {
+         return false;
+      }
+
+      ftags::TranslationUnitArguments& translationUnit = translationUnits.emplace_back();
+      translationUnit.set_filename(std::move(compileCommand.fileName));
+      for (std::string& argument : compileCommand.arguments)
+      {
+         translationUnit.add_argument(std::move(argument));
+      }
+   }
+
+   return true;
+}
+
+/*
+ * Reads the entries of the compilation database for the translation units affected by changed
+ * files: first those whose source changed, then those which include a changed file. When every
+ * translation unit may be affected, they are all read as changed.
+ */
+void readAffectedTranslationUnits(const std::filesystem::path&                  compilationDatabaseFile,
+                                  const std::unordered_set<std::string>&        changedFileNames,
+                                  const std::unordered_set<std::string>&        dependents,
+                                  bool                                          isEverythingChanged,
+                                  std::vector<ftags::TranslationUnitArguments>& changedSources,
+                                  std::vector<ftags::TranslationUnitArguments>& includingChanges)
+{
+   std::ifstream compilationDatabaseInput{compilationDatabaseFile};
+
+   ftags::util::CompileCommandsReader                 reader{compilationDatabaseInput};
+   ftags::util::CompileCommandsReader::CompileCommand compileCommand;
+
+   while (reader.readNext(compileCommand))
+   {
+      // the changed file names are built from the canonical path of the watched directory
+      const std::string normalFileName = std::filesystem::path{compileCommand.fileName}.lexically_normal().string();
+
+      std::vector<ftags::TranslationUnitArguments>* affected = nullptr;
+      if (isEverythingChanged || (changedFileNames.count(normalFileName) != 0))
+      {
+         affected = &changedSources;
+      }
+      else if (dependents.count(compileCommand.fileName) != 0)
+      {
+         affected = &includingChanges;
+      }
+      else
+      {
+         continue;
+      }
+
+      ftags::TranslationUnitArguments& translationUnit = affected->emplace_back();
+      translationUnit.set_filename(std::move(compileCommand.fileName));
+      for (std::string& argument : compileCommand.arguments)
+      {
+         translationUnit.add_argument(std::move(argument));
+      }
+   }
+}
+
+} // anonymous namespace
+
 int main(int argc, char* argv[])
 {
    try
    {
-      bool        showHelp        = false;
-      bool        indexEverything = false;
+      bool        showHelp          = false;
+      bool        indexEverything   = false;
+      bool        declarationsFirst = false;
+      bool        indexAll          = false;
       std::string projectName;
       std::string dirName;
+      std::string watchDirName;
       int         groupSize = k_DefaultGroupSize;
 
       auto cli =
          clara::Help(showHelp) |
-         clara::Opt(groupSize, "group")["--group"]("How many translation units to parse at once") |
+         clara::Opt(groupSize, "group")["--group"](
+            "How many translation units to hand out at most at once, unless the indexer has more threads") |
          clara::Opt(projectName, "project")["-p"]["--project"]("Project name") |
          clara::Opt(indexEverything, "everything")["-e"]["--everything"]("Index all reachable sources and headers") |
+         clara::Opt(declarationsFirst)["--declarations-first"](
+            "Index declarations and definitions of all sources first, then schedule the complete pass") |
+         clara::Opt(indexAll)["--all"]("Index all translation units, including those unchanged since last indexed") |
+         clara::Opt(watchDirName, "dir")["--watch"](
+            "Keep running and index the translation units affected by the changes in this directory tree") |
          clara::Arg(dirName, "dir")("Path to directory containing compile_commands.json");
 
       GOOGLE_PROTOBUF_VERIFY_VERSION;
@@ -96,120 +708,403 @@ int main(int argc, char* argv[])
          return 0;
       }
 
-      zmq::socket_t socket(context, ZMQ_PUSH);
+      const std::filesystem::path compilationDatabaseFile = std::filesystem::path{dirName} / "compile_commands.json";
+
+      /*
+       * The project is watched before the compilation database is read, so that no change made
+       * during the first scan is missed; the events are read once the whole database is read.
+       */
+      std::unique_ptr<ftags::util::FileWatcher> watcher;
+      if (!watchDirName.empty())
+      {
+         const std::filesystem::path watchPath = std::filesystem::canonical(watchDirName);
+
+         watcher = std::make_unique<ftags::util::FileWatcher>(watchPath,
+                                                              std::chrono::milliseconds{k_WatchQuietPeriodMs},
+                                                              std::chrono::milliseconds{k_WatchMaxDelayMs});
+
+         spdlog::info("Watching {} directories under {}", watcher->getWatchedDirectoryCount(), watchPath.string());
+      }
+
+      std::ifstream compilationDatabaseInput{compilationDatabaseFile};
+
+      ftags::util::CompileCommandsReader reader{compilationDatabaseInput};
+
+      /*
+       * The compilation database is read a chunk at a time, and every chunk is checked with the server
+       * and scheduled right away, so the first translation units are handed out while the rest of the
+       * database is still read. The translation units are scheduled longest first within a chunk.
+       */
+      std::deque<ScannedChunk> chunks;
+      WorkQueue                workQueue;
+      bool                     isReading = true;
+
+      const auto scanChunk = [&]() {
+         ScannedChunk chunk;
+         isReading = readChunk(reader, chunk.translationUnits);
+
+         if (chunk.translationUnits.empty())
+         {
+            return;
+         }
+
+         const std::vector<IndexingHistory> history = checkIndexedTranslationUnits(
+            context, projectName, dirName, /* keepUnchanged = */ indexAll, chunk.translationUnits);
+
+         chunk.parseNanoseconds = estimateParseNanoseconds(chunk.translationUnits, history);
+         chunk.localityKeys     = computeLocalityKeys(chunk.translationUnits, history);
+
+         const ScannedChunk& scheduled = chunks.emplace_back(std::move(chunk));
+
+         /*
+          * With --declarations-first every translation unit is scheduled twice: a fast declarations-only
+          * pass, then the complete pass which replaces the partial results, once the declarations of all
+          * the translation units are scheduled.
+          */
+         workQueue.addPass(scheduled.translationUnits,
+                           scheduled.parseNanoseconds,
+                           scheduled.localityKeys,
+                           /* declarationsOnly = */ declarationsFirst);
+      };
+
+      // once the whole database is read
+      const auto finishScan = [&]() {
+         if (declarationsFirst)
+         {
+            for (const ScannedChunk& completeChunk : chunks)
+            {
+               workQueue.addPass(completeChunk.translationUnits,
+                                 completeChunk.parseNanoseconds,
+                                 completeChunk.localityKeys,
+                                 /* declarationsOnly = */ false);
+            }
+         }
+
+         spdlog::info("Read the compilation database; {} translation units left in {} groups, estimated at {} s",
+                      workQueue.getRemainingCount(),
+                      workQueue.getGroupCount(),
+                      workQueue.getRemainingNanoseconds() / 1000000000);
+      };
+
+      /*
+       * The indexers ask for work whenever they are done with their previous batch, so there is no
+       * need to wait for them to connect; an indexer whose request is not answered asks again later.
+       * The requests which arrive before any work is read are answered as soon as there is some.
+       */
+      zmq::socket_t socket(context, ZMQ_ROUTER);
+      socket.setsockopt(ZMQ_ROUTER_MANDATORY, 1);
 
       const char*       xdgRuntimeDir    = std::getenv("XDG_RUNTIME_DIR");
       const std::string connectionString = fmt::format("ipc://{}/ftags_worker", xdgRuntimeDir);
 
       socket.bind(connectionString);
 
+      ftags::IndexRequest indexRequest{};
+      indexRequest.set_projectname(projectName);
+      indexRequest.set_directoryname(dirName);
+      indexRequest.set_indexeverything(indexEverything);
+
+      std::unordered_set<std::string> workers;
+
+      /*
+       * The batches handed out to the indexers which have a worker id, by worker id. The id of an
+       * indexer started again after a crash is the same, but its instance is not, so its request for
+       * work means that the batch was lost. The other indexers are identified by the connection only.
+       */
+      struct OutstandingBatch
+      {
+         std::vector<std::size_t>              items;
+         std::chrono::steady_clock::time_point handedOut;
+      };
+
+      std::unordered_map<std::string, OutstandingBatch> outstandingWork;
+
       /*
-       * Allow all clients time to bind.
-       *
-       * See https://github.com/zeromq/pyzmq/issues/96
+       * The latest request answered for each indexer. An indexer asks again with the same request
+       * until it is answered, and the copies which were queued meanwhile are dropped, so that it
+       * does not get more than one batch at a time.
        */
-      using namespace std::chrono_literals;
-      std::this_thread::sleep_for(1s);
+      std::unordered_map<std::string, ftags::WorkRequest> answeredRequests;
 
-      CXCompilationDatabase_Error ccderror      = CXCompilationDatabase_NoError;
-      CXCompilationDatabase compilationDatabase = clang_CompilationDatabase_fromDirectory(dirName.c_str(), &ccderror);
+      // the latest request of each indexer which asked while there was no work
+      std::unordered_map<std::string, ftags::WorkRequest> waitingWorkers;
 
-      if (CXCompilationDatabase_NoError == ccderror)
-      {
-         CXIndex index = clang_createIndex(/* excludeDeclarationsFromPCH = */ 0,
-                                           /* displayDiagnostics         = */ 0);
+      const auto maxGroupSize = static_cast<std::size_t>(std::max(groupSize, 1));
+
+      // hands out a batch to the worker; returns false if it went away
+      const auto handOutBatch = [&](const std::string& workerId, const ftags::WorkRequest& workRequest) {
+         const unsigned threadCount = std::max(workRequest.threadcount(), 1U);
 
-         CXCompileCommands compileCommands = clang_CompilationDatabase_getAllCompileCommands(compilationDatabase);
+         const std::vector<std::size_t> batch =
+            workQueue.selectBatch(threadCount, workers.size(), std::max<std::size_t>(maxGroupSize, threadCount));
 
-         const unsigned compilationCount = clang_CompileCommands_getSize(compileCommands);
+         indexRequest.clear_translationunit();
+         indexRequest.set_declarationsonly(workQueue.getItem(batch.front()).declarationsOnly);
+         for (const std::size_t index : batch)
+         {
+            *indexRequest.add_translationunit() = *workQueue.getItem(index).translationUnit;
+         }
 
-         ftags::IndexRequest indexRequest{};
-         indexRequest.set_projectname(projectName);
-         indexRequest.set_directoryname(dirName);
-         indexRequest.set_indexeverything(indexEverything);
+         const std::size_t requestSize = indexRequest.ByteSizeLong();
+         zmq::message_t    request(requestSize);
+         indexRequest.SerializeToArray(request.data(), static_cast<int>(requestSize));
 
-         for (unsigned ii = 0; ii < compilationCount; ii++)
+         try
+         {
+            zmq::message_t identity(workerId.data(), workerId.size());
+            socket.send(identity, ZMQ_SNDMORE);
+            socket.send(request);
+         }
+         catch (zmq::error_t& ze)
          {
-            CXCompileCommand compileCommand = clang_CompileCommands_getCommand(compileCommands, ii);
+            // the indexer went away after asking; the batch goes to the next one
+            spdlog::warn("Failed to hand out {} translation units: {}", batch.size(), ze.what());
+            return false;
+         }
 
-            CXString dirNameString  = clang_CompileCommand_getDirectory(compileCommand);
-            CXString fileNameString = clang_CompileCommand_getFilename(compileCommand);
+         workQueue.pop(batch);
+         answeredRequests[workerId] = workRequest;
 
-            const unsigned        argCount = clang_CompileCommand_getNumArgs(compileCommand);
-            std::vector<CXString> argumentsAsCXString;
-            argumentsAsCXString.reserve(argCount);
+         // automatically assigned connection identities start with a zero byte
+         if (workerId.front() != '\0')
+         {
+            outstandingWork.emplace(workerId, OutstandingBatch{batch, std::chrono::steady_clock::now()});
+         }
 
-            ftags::TranslationUnitArguments* translationUnit = indexRequest.add_translationunit();
+         spdlog::info("Handed out {} translation units, starting with {}; {} remaining",
+                      batch.size(),
+                      indexRequest.translationunit(0).filename(),
+                      workQueue.getRemainingCount());
 
-            translationUnit->set_filename(clang_getCString(fileNameString));
+         if ((!isReading) && workQueue.isEmpty() && !outstandingWork.empty())
+         {
+            spdlog::info("Waiting for {} indexers to finish", outstandingWork.size());
+         }
 
-            bool skipFileNames = false;
+         return true;
+      };
 
-            for (unsigned jj = 0; jj < argCount; jj++)
+      const auto handOutToWaitingWorkers = [&]() {
+         for (auto iter = waitingWorkers.begin(); (iter != waitingWorkers.end()) && !workQueue.isEmpty();)
+         {
+            handOutBatch(iter->first, iter->second);
+            iter = waitingWorkers.erase(iter);
+         }
+      };
+
+      /*
+       * While watching, the translation units affected by each burst of changes are scheduled once the
+       * changes settle, after the work already queued. Those whose source changed are handed out
+       * before those which include a changed file, and checking the fingerprints drops those which
+       * do not need indexing, such as the sources which were only touched.
+       */
+      const auto scanChanges = [&]() {
+         const ftags::util::FileWatcher::Changes changes = watcher->takeChanges();
+
+         // an indexer which does not come back would otherwise keep the earlier work forever
+         const auto now = std::chrono::steady_clock::now();
+         for (auto iter = outstandingWork.begin(); iter != outstandingWork.end();)
+         {
+            if (now - iter->second.handedOut > std::chrono::milliseconds{k_OutstandingWorkTimeoutMs})
             {
-               if (skipFileNames)
-               {
-                  skipFileNames = false;
-                  continue;
-               }
+               spdlog::warn("No news from indexer {}; its {} translation units may be lost",
+                            iter->first,
+                            iter->second.items.size());
+               iter = outstandingWork.erase(iter);
+            }
+            else
+            {
+               ++iter;
+            }
+         }
 
-               CXString cxString = clang_CompileCommand_getArg(compileCommand, jj);
-               argumentsAsCXString.push_back(cxString);
-               const char* argumentText = clang_getCString(cxString);
+         // nothing refers to the earlier translation units once they are all handed out and indexed
+         if (workQueue.isEmpty() && outstandingWork.empty())
+         {
+            workQueue = WorkQueue{};
+            chunks.clear();
+         }
 
-               if ((argumentText[0] == '-') && ((argumentText[1] == 'c') || (argumentText[1] == 'o')))
-               {
-                  skipFileNames = true;
-               }
-               else
+         const std::unordered_set<std::string> changedFileNames(changes.fileNames.cbegin(), changes.fileNames.cend());
+
+         // when events were lost, or the compilation database changed, any translation unit may be affected
+         const bool isEverythingChanged =
+            changes.isOverflowed || (changedFileNames.count(compilationDatabaseFile.string()) != 0);
+
+         const std::unordered_set<std::string> dependents =
+            isEverythingChanged ? std::unordered_set<std::string>{}
+                                : findDependentTranslationUnits(context, projectName, dirName, changes.fileNames);
+
+         ScannedChunk changedSources;
+         ScannedChunk includingChanges;
+         readAffectedTranslationUnits(compilationDatabaseFile,
+                                      changedFileNames,
+                                      dependents,
+                                      isEverythingChanged,
+                                      changedSources.translationUnits,
+                                      includingChanges.translationUnits);
+
+         spdlog::info("{} files changed; {} translation units changed and {} more include changed files",
+                      changes.fileNames.size(),
+                      changedSources.translationUnits.size(),
+                      includingChanges.translationUnits.size());
+
+         for (ScannedChunk* chunk : {&changedSources, &includingChanges})
+         {
+            if (chunk->translationUnits.empty())
+            {
+               continue;
+            }
+
+            const std::vector<IndexingHistory> history = checkIndexedTranslationUnits(
+               context, projectName, dirName, /* keepUnchanged = */ false, chunk->translationUnits);
+
+            if (chunk->translationUnits.empty())
+            {
+               continue;
+            }
+
+            chunk->parseNanoseconds = estimateParseNanoseconds(chunk->translationUnits, history);
+            chunk->localityKeys     = computeLocalityKeys(chunk->translationUnits, history);
+
+            const ScannedChunk& scheduled = chunks.emplace_back(std::move(*chunk));
+            workQueue.addPass(scheduled.translationUnits,
+                              scheduled.parseNanoseconds,
+                              scheduled.localityKeys,
+                              /* declarationsOnly = */ false);
+         }
+      };
+
+      bool hasRequests = false;
+
+      while ((watcher != nullptr) || isReading || !workQueue.isEmpty() || !outstandingWork.empty())
+      {
+         // while reading, the requests which already arrived are answered before the next chunk is read
+         if (isReading && !hasRequests)
+         {
+            scanChunk();
+
+            if (!isReading)
+            {
+               finishScan();
+
+               // while watching, the indexers may have nothing to do for a long time
+               if (watcher == nullptr)
                {
-                  translationUnit->add_argument(argumentText);
+                  socket.setsockopt(ZMQ_RCVTIMEO, k_OutstandingWorkTimeoutMs);
                }
+            }
 
-               clang_disposeString(cxString);
+            handOutToWaitingWorkers();
+         }
+
+         // after the first scan, the requests of the indexers are waited for together with the changes
+         if ((watcher != nullptr) && (!isReading))
+         {
+            zmq::pollitem_t items[] = {
+               {static_cast<void*>(socket), 0, ZMQ_POLLIN, 0},
+               {nullptr, watcher->getFileDescriptor(), ZMQ_POLLIN, 0},
+            };
+
+            zmq::poll(items, 2, watcher->getMillisecondsUntilSettled());
+
+            if ((items[1].revents & ZMQ_POLLIN) != 0)
+            {
+               watcher->readEvents();
             }
 
-            if (indexRequest.translationunit_size() == groupSize)
+            if (watcher->hasSettledChanges())
             {
-               const std::size_t requestSize = indexRequest.ByteSizeLong();
-               zmq::message_t    request(requestSize);
-               indexRequest.SerializeToArray(request.data(), static_cast<int>(requestSize));
-               socket.send(request);
+               scanChanges();
+               handOutToWaitingWorkers();
+            }
 
-               spdlog::info("Enqueued {} of {}: {}", ii, compilationCount, clang_getCString(fileNameString));
+            if ((items[0].revents & ZMQ_POLLIN) == 0)
+            {
+               continue;
+            }
+         }
 
-               indexRequest.clear_translationunit();
+         zmq::message_t identity;
+         zmq::message_t message;
+
+         hasRequests = socket.recv(&identity, (isReading || (watcher != nullptr)) ? ZMQ_DONTWAIT : 0);
+         if (!hasRequests)
+         {
+            if ((!isReading) && workQueue.isEmpty() && (watcher == nullptr))
+            {
+               spdlog::warn("No news from the indexers; {} batches may be lost", outstandingWork.size());
+               break;
             }
 
-            clang_disposeString(fileNameString);
-            clang_disposeString(dirNameString);
+            continue;
          }
+         socket.recv(&message);
+
+         ftags::WorkRequest workRequest;
+         workRequest.ParseFromArray(message.data(), static_cast<int>(message.size()));
+
+         const std::string workerId{static_cast<const char*>(identity.data()), identity.size()};
+         workers.insert(workerId);
 
-         if (indexRequest.translationunit_size() != 0)
+         const auto answeredIter = answeredRequests.find(workerId);
+         if (answeredIter != answeredRequests.end())
          {
-            std::string serializedRequest;
-            indexRequest.SerializeToString(&serializedRequest);
+            const bool isRestarted = answeredIter->second.instance() != workRequest.instance();
+            if ((!isRestarted) && (answeredIter->second.sequence() == workRequest.sequence()))
+            {
+               // sent again while the scanner was busy; the indexer is working on the batch
+               continue;
+            }
 
-            zmq::message_t request(serializedRequest.size());
-            memcpy(request.data(), serializedRequest.data(), serializedRequest.size());
-            socket.send(request);
+            // otherwise the indexer is done with the batch, or lost it
+            const auto outstandingIter = outstandingWork.find(workerId);
+            if (outstandingIter != outstandingWork.end())
+            {
+               if (isRestarted)
+               {
+                  spdlog::warn("Indexer {} restarted; handing out its {} translation units again",
+                               workerId,
+                               outstandingIter->second.items.size());
 
-            spdlog::info("Enqueued last batch of {} translation units", indexRequest.translationunit_size());
+                  for (const std::size_t index : workQueue.requeue(outstandingIter->second.items))
+                  {
+                     spdlog::error("Dropping {}; the indexers were lost on it {} times",
+                                   workQueue.getItem(index).translationUnit->filename(),
+                                   k_IsolateAfterLosses + 1);
+                  }
+               }
+
+               outstandingWork.erase(outstandingIter);
+            }
 
-            indexRequest.clear_translationunit();
+            answeredRequests.erase(answeredIter);
          }
 
-         spdlog::info("Done with enqueueing");
+         if (workQueue.isEmpty())
+         {
+            // the indexer asks again later, possibly of the next scanner
+            if (isReading || (watcher != nullptr))
+            {
+               waitingWorkers[workerId] = workRequest;
+            }
 
-         clang_CompileCommands_dispose(compileCommands);
-         clang_disposeIndex(index);
+            continue;
+         }
+
+         waitingWorkers.erase(workerId);
+         handOutBatch(workerId, workRequest);
       }
 
-      clang_CompilationDatabase_dispose(compilationDatabase);
+      socket.close();
 
-      spdlog::info("Shutting down");
+      spdlog::info("Done with enqueueing");
 
-      socket.close();
+      spdlog::info("Shutting down");
+   }
+   catch (const std::runtime_error& re)
+   {
+      std::cerr << "Failed to scan the project: " << re.what() << std::endl;
    }
    catch (...)
    {
@@ -19,3 +19,8 @@ int main(int argc, char* argv[])
 
    return DOUBLY_SO(arg);
 }
+
+int scale(int value)
+{
+   return test::other_function(static_cast<test::argument_type>(value));
+}
@@ -184,3 +184,287 @@ TEST_F(ProjectSerializationTest, FindVariablesInDeserializedProjectDb)
       ASSERT_EQ(allArg.size(), 9);
    }
 }
+
+TEST_F(ProjectSerializationTest, FingerprintsSurviveSerialization)
+{
+   const auto rootPath = std::filesystem::current_path();
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   const auto testPath = (rootPath / "test" / "db" / "data" / "multi-module" / "test.cc").string();
+
+   ftags::ProjectDb::FileHashCache fileHashCache;
+   ASSERT_TRUE(tagsDb->isTranslationUnitCurrent(testPath, arguments, fileHashCache));
+
+   // the parse time is kept alongside the fingerprint to schedule the next indexing
+   const uint64_t parseNanoseconds = tagsDb->getTranslationUnitParseNanoseconds(testPath);
+   ASSERT_NE(parseNanoseconds, 0);
+
+   std::vector<std::byte> buffer(/* size = */ tagsDb->computeSerializedSize());
+
+   BufferInsertor insertor{buffer};
+
+   tagsDb->serialize(insertor.getInsertor());
+
+   BufferExtractor  extractor{buffer};
+   ftags::ProjectDb restoredTagsDb = ftags::ProjectDb::deserialize(extractor.getExtractor());
+
+   ASSERT_TRUE(restoredTagsDb.isTranslationUnitCurrent(testPath, arguments, fileHashCache));
+   ASSERT_EQ(restoredTagsDb.getTranslationUnitParseNanoseconds(testPath), parseNanoseconds);
+
+   // merging remaps the file name keys of the dependencies
+   ftags::ProjectDb mergedDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   mergedDb.mergeFrom(restoredTagsDb);
+
+   ASSERT_TRUE(mergedDb.isTranslationUnitCurrent(testPath, arguments, fileHashCache));
+   ASSERT_EQ(mergedDb.getTranslationUnitParseNanoseconds(testPath), parseNanoseconds);
+}
+
+TEST_F(ProjectSerializationTest, TranslationUnitsSharingHeadersHaveTheSameIncludeSignature)
+{
+   const auto rootPath = std::filesystem::current_path();
+
+   const auto libPath  = (rootPath / "test" / "db" / "data" / "multi-module" / "lib.cc").string();
+   const auto testPath = (rootPath / "test" / "db" / "data" / "multi-module" / "test.cc").string();
+
+   // lib.h is the only project header included by either; <cstdlib> is not in the project
+   const uint64_t librarySignature = tagsDb->getTranslationUnitIncludeSignature(libPath);
+   ASSERT_NE(librarySignature, 0);
+   ASSERT_EQ(tagsDb->getTranslationUnitIncludeSignature(testPath), librarySignature);
+
+   ASSERT_EQ(tagsDb->getTranslationUnitIncludeSignature((rootPath / "missing.cc").string()), 0);
+}
+
+TEST_F(ProjectSerializationTest, StreamedTranslationUnitsCarryOnlyNewStrings)
+{
+   const auto rootPath = std::filesystem::current_path();
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   const auto libPath  = (rootPath / "test" / "db" / "data" / "multi-module" / "lib.cc").string();
+   const auto testPath = (rootPath / "test" / "db" / "data" / "multi-module" / "test.cc").string();
+
+   ftags::ProjectDb::StreamEncoder encoder;
+
+   std::vector<std::byte> libDelta = tagsDb->serializeTranslationUnitDelta(libPath, encoder);
+   ASSERT_FALSE(libDelta.empty());
+
+   std::vector<std::byte> testDelta = tagsDb->serializeTranslationUnitDelta(testPath, encoder);
+   ASSERT_FALSE(testDelta.empty());
+
+   // the strings shared with lib.cc, such as the name of lib.h, were sent with the first delta
+   {
+      ftags::ProjectDb::StreamEncoder freshEncoder;
+      ASSERT_LT(testDelta.size(), tagsDb->serializeTranslationUnitDelta(testPath, freshEncoder).size());
+   }
+
+   ASSERT_TRUE(tagsDb->serializeTranslationUnitDelta((rootPath / "missing.cc").string(), encoder).empty());
+
+   ftags::ProjectDb                streamedDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   ftags::ProjectDb::StreamDecoder decoder;
+
+   {
+      BufferExtractor extractor{libDelta};
+      streamedDb.addTranslationUnitDelta(extractor.getExtractor(), decoder);
+   }
+
+   {
+      BufferExtractor extractor{testDelta};
+      streamedDb.addTranslationUnitDelta(extractor.getExtractor(), decoder);
+   }
+
+   ASSERT_EQ(streamedDb.getTranslationUnitCount(), 2);
+   ASSERT_EQ(streamedDb.getRecordCount(), tagsDb->getRecordCount());
+
+   ftags::ProjectDb::FileHashCache fileHashCache;
+   ASSERT_TRUE(streamedDb.isTranslationUnitCurrent(testPath, arguments, fileHashCache));
+
+   ASSERT_EQ(streamedDb.findDefinition("count").size(), 1);
+   ASSERT_EQ(streamedDb.findReference("count").size(), 1);
+   ASSERT_EQ(streamedDb.findReference("arg").size(), 6);
+   ASSERT_EQ(streamedDb.findSymbol("arg").size(), 9);
+
+   // a translation unit sent again replaces the previous version
+   {
+      std::vector<std::byte> resentDelta = tagsDb->serializeTranslationUnitDelta(testPath, encoder);
+
+      BufferExtractor extractor{resentDelta};
+      streamedDb.addTranslationUnitDelta(extractor.getExtractor(), decoder);
+   }
+
+   ASSERT_EQ(streamedDb.getTranslationUnitCount(), 2);
+   ASSERT_EQ(streamedDb.getRecordCount(), tagsDb->getRecordCount());
+
+   // a delta which refers to strings sent on another stream is rejected
+   {
+      ftags::ProjectDb::StreamDecoder otherDecoder;
+
+      BufferExtractor extractor{testDelta};
+      ASSERT_THROW(streamedDb.addTranslationUnitDelta(extractor.getExtractor(), otherDecoder), std::runtime_error);
+   }
+
+   // so is a delta whose last record span is cut short
+   {
+      ftags::ProjectDb::StreamEncoder freshEncoder;
+      ftags::ProjectDb::StreamDecoder freshDecoder;
+
+      std::vector<std::byte> truncatedDelta = tagsDb->serializeTranslationUnitDelta(libPath, freshEncoder);
+      truncatedDelta.resize(truncatedDelta.size() - 1);
+
+      BufferExtractor extractor{truncatedDelta};
+      ASSERT_THROW(streamedDb.addTranslationUnitDelta(extractor.getExtractor(), freshDecoder), std::runtime_error);
+   }
+
+   ASSERT_EQ(streamedDb.getTranslationUnitCount(), 2);
+}
+
+TEST_F(ProjectSerializationTest, OfferedRecordSpansAreSentAsReferences)
+{
+   const auto rootPath = std::filesystem::current_path();
+
+   const auto libPath  = (rootPath / "test" / "db" / "data" / "multi-module" / "lib.cc").string();
+   const auto testPath = (rootPath / "test" / "db" / "data" / "multi-module" / "test.cc").string();
+
+   const std::vector<uint64_t> offeredRecordSpans = tagsDb->getRecordSpanContentHashes();
+   ASSERT_FALSE(offeredRecordSpans.empty());
+
+   ftags::ProjectDb streamedDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+
+   ftags::ProjectDb::StreamDecoder firstDecoder;
+   ASSERT_EQ(streamedDb.findMissingRecordSpans(offeredRecordSpans, firstDecoder).size(), offeredRecordSpans.size());
+
+   {
+      ftags::ProjectDb::StreamEncoder encoder;
+
+      for (const auto& fileName : {libPath, testPath})
+      {
+         std::vector<std::byte> delta = tagsDb->serializeTranslationUnitDelta(fileName, encoder);
+
+         BufferExtractor extractor{delta};
+         streamedDb.addTranslationUnitDelta(extractor.getExtractor(), firstDecoder);
+      }
+   }
+
+   // a second stream is offered the same spans, which are all present now
+   ftags::ProjectDb::StreamDecoder secondDecoder;
+   ASSERT_TRUE(streamedDb.findMissingRecordSpans(offeredRecordSpans, secondDecoder).empty());
+
+   ftags::ProjectDb::StreamEncoder encoder;
+   encoder.knownRecordSpans.insert(offeredRecordSpans.cbegin(), offeredRecordSpans.cend());
+
+   std::vector<std::byte> delta = tagsDb->serializeTranslationUnitDelta(testPath, encoder);
+
+   {
+      ftags::ProjectDb::StreamEncoder freshEncoder;
+      ASSERT_LT(delta.size(), tagsDb->serializeTranslationUnitDelta(testPath, freshEncoder).size());
+   }
+
+   {
+      BufferExtractor extractor{delta};
+      streamedDb.addTranslationUnitDelta(extractor.getExtractor(), secondDecoder);
+   }
+
+   ASSERT_EQ(streamedDb.getTranslationUnitCount(), 2);
+   ASSERT_EQ(streamedDb.getRecordCount(), tagsDb->getRecordCount());
+   ASSERT_EQ(streamedDb.findSymbol("arg").size(), 9);
+
+   // the translation units keep their spans once the streams are gone
+   streamedDb.releaseStream(firstDecoder);
+   streamedDb.releaseStream(secondDecoder);
+
+   ASSERT_EQ(streamedDb.getRecordCount(), tagsDb->getRecordCount());
+   ASSERT_EQ(streamedDb.findSymbol("arg").size(), 9);
+
+   // a reference to a span the receiver does not have is rejected
+   {
+      ftags::ProjectDb                emptyDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+      ftags::ProjectDb::StreamDecoder decoder;
+
+      BufferExtractor extractor{delta};
+      ASSERT_THROW(emptyDb.addTranslationUnitDelta(extractor.getExtractor(), decoder), std::runtime_error);
+   }
+}
+
+TEST_F(ProjectSerializationTest, DeltasWithReceiverKeysCarryNoStrings)
+{
+   const auto rootPath = std::filesystem::current_path();
+
+   const auto libPath  = (rootPath / "test" / "db" / "data" / "multi-module" / "lib.cc").string();
+   const auto testPath = (rootPath / "test" / "db" / "data" / "multi-module" / "test.cc").string();
+
+   const std::vector<std::string> fileNames = {libPath, testPath};
+
+   ftags::ProjectDb                streamedDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   ftags::ProjectDb::StreamDecoder decoder;
+   decoder.keyDictionaryVersion = streamedDb.getKeyDictionaryVersion();
+
+   ftags::ProjectDb::KeyDictionary dictionary;
+   dictionary.version = streamedDb.getKeyDictionaryVersion();
+
+   // the sender resolves the strings it misses, then sends the records with the receiver's keys
+   const auto resolveStrings = [&]() {
+      ftags::ProjectDb::StreamEncoder encoder;
+
+      std::vector<std::string> symbolNames;
+      std::vector<std::string> fileNamesToResolve;
+      tagsDb->findUnresolvedStrings(fileNames, encoder, dictionary, symbolNames, fileNamesToResolve);
+
+      const auto symbolKeys   = streamedDb.resolveSymbolKeys(symbolNames);
+      const auto fileNameKeys = streamedDb.resolveFileNameKeys(fileNamesToResolve);
+
+      for (std::size_t ii = 0; ii < symbolNames.size(); ii++)
+      {
+         dictionary.symbolKeys[symbolNames[ii]] = symbolKeys[ii];
+      }
+
+      for (std::size_t ii = 0; ii < fileNamesToResolve.size(); ii++)
+      {
+         dictionary.fileNameKeys[fileNamesToResolve[ii]] = fileNameKeys[ii];
+      }
+
+      return symbolNames.size() + fileNamesToResolve.size();
+   };
+
+   ASSERT_GT(resolveStrings(), 0);
+
+   // a refresh only asks for the strings the dictionary misses
+   ASSERT_EQ(resolveStrings(), 0);
+
+   ftags::ProjectDb::StreamEncoder encoder;
+   tagsDb->bindReceiverKeys(dictionary, encoder);
+
+   std::vector<std::vector<std::byte>> deltas;
+   for (const auto& fileName : fileNames)
+   {
+      deltas.push_back(tagsDb->serializeTranslationUnitDelta(fileName, encoder));
+
+      ftags::ProjectDb::StreamEncoder freshEncoder;
+      ASSERT_LT(deltas.back().size(), tagsDb->serializeTranslationUnitDelta(fileName, freshEncoder).size());
+
+      BufferExtractor extractor{deltas.back()};
+      streamedDb.addTranslationUnitDelta(extractor.getExtractor(), decoder);
+   }
+
+   ASSERT_EQ(streamedDb.getTranslationUnitCount(), 2);
+   ASSERT_EQ(streamedDb.getRecordCount(), tagsDb->getRecordCount());
+   ASSERT_EQ(streamedDb.findDefinition("count").size(), 1);
+   ASSERT_EQ(streamedDb.findSymbol("arg").size(), 9);
+
+   // the keys of another receiver's tables are rejected
+   {
+      ftags::ProjectDb                otherDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+      ftags::ProjectDb::StreamDecoder otherDecoder;
+      otherDecoder.keyDictionaryVersion = otherDb.getKeyDictionaryVersion();
+
+      BufferExtractor extractor{deltas.front()};
+      ASSERT_THROW(otherDb.addTranslationUnitDelta(extractor.getExtractor(), otherDecoder), std::runtime_error);
+   }
+
+   streamedDb.releaseStream(decoder);
+}
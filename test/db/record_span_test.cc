@@ -126,6 +126,42 @@ TEST(RecordSpanManagerTest, HandleDuplicates)
    ASSERT_EQ(key0, key1);
 }
 
+TEST(RecordSpanManagerTest, ReleaseSharedSpan)
+{
+   ftags::RecordSpanManager manager;
+
+   std::vector<ftags::Record> input;
+
+   ftags::Record one = {};
+   ftags::Record two = {};
+
+   one.symbolNameKey = 1;
+   two.symbolNameKey = 2;
+
+   input.push_back(one);
+   input.push_back(two);
+
+   const ftags::RecordSpan::Store::Key key0 = manager.addSpan(input);
+   const ftags::RecordSpan::Store::Key key1 = manager.addSpan(input);
+   ASSERT_EQ(key0, key1);
+   ASSERT_EQ(2, manager.getRecordCount());
+
+   manager.releaseSpan(key0);
+   ASSERT_EQ(2, manager.getRecordCount());
+   ASSERT_EQ(1, manager.getSpan(key1).getUsage());
+
+   manager.releaseSpan(key1);
+   ASSERT_EQ(0, manager.getRecordCount());
+   ASSERT_EQ(0, manager.getSymbolCount());
+
+   /*
+    * the released span is no longer found as a duplicate
+    */
+   const ftags::RecordSpan::Store::Key key2 = manager.addSpan(input);
+   ASSERT_EQ(1, manager.getSpan(key2).getUsage());
+   ASSERT_EQ(2, manager.getRecordCount());
+}
+
 TEST(RecordSpanManagerTest, HandleDuplicatesAfterSerialization)
 {
    ftags::RecordSpanManager manager;
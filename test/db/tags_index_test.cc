@@ -19,7 +19,9 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
 #include <sstream>
 #include <vector>
 
@@ -99,6 +101,16 @@ TEST_F(TagsIndexTestHello, HelloWorldCallsPrintfFunction)
    ASSERT_STREQ(cursor0.symbolName, "printf");
 }
 
+TEST_F(TagsIndexTestHello, HelloWorldSkipsSystemHeaders)
+{
+   ASSERT_EQ(0, tagsDb->findDeclaration("printf").size());
+
+   for (const ftags::Record* record : tagsDb->getFunctions())
+   {
+      ASSERT_EQ(helloPath.string(), tagsDb->inflateRecord(record).location.fileName);
+   }
+}
+
 class TagsIndexTestHelloWorld : public ::testing::Test
 {
 protected:
@@ -206,6 +218,34 @@ TEST_F(TagsIndexTestFunctions, DistinguishDeclarationFromDefinition)
    ASSERT_EQ(ftags::SymbolType::FunctionCallExpression, betaReferences[0]->getType());
 }
 
+TEST_F(TagsIndexTestFunctions, FindByTypeAndQualifier)
+{
+   using SymbolQualifier = ftags::ProjectDb::SymbolQualifier;
+
+   const std::vector<ftags::SymbolType> functionTypes = {ftags::SymbolType::FunctionDeclaration,
+                                                         ftags::SymbolType::FunctionCallExpression};
+
+   const auto betaDefinition = tagsDb->findSymbol("beta", {functionTypes, SymbolQualifier::Definition});
+   ASSERT_EQ(betaDefinition.size(), 1);
+   ASSERT_EQ(betaDefinition, tagsDb->findDefinition("beta"));
+
+   const auto betaDeclaration = tagsDb->findSymbol("beta", {functionTypes, SymbolQualifier::Declaration});
+   ASSERT_EQ(betaDeclaration.size(), 1);
+   ASSERT_EQ(betaDeclaration, tagsDb->findDeclaration("beta"));
+
+   const auto betaReferences = tagsDb->findSymbol("beta", {functionTypes, SymbolQualifier::Reference});
+   ASSERT_EQ(betaReferences.size(), 1);
+   ASSERT_EQ(ftags::SymbolType::FunctionCallExpression, betaReferences[0]->getType());
+
+   ASSERT_EQ(tagsDb->findSymbol("beta", {functionTypes, SymbolQualifier::Any}).size(), 3);
+   ASSERT_EQ(tagsDb->findSymbol("beta", {{}, SymbolQualifier::Any}), tagsDb->findSymbol("beta"));
+
+   // the parameters are not functions
+   const std::vector<ftags::SymbolType> parameterTypes = {ftags::SymbolType::ParameterDeclaration};
+   ASSERT_TRUE(tagsDb->findSymbol("param", {functionTypes, SymbolQualifier::Any}).empty());
+   ASSERT_FALSE(tagsDb->findSymbol("param", {parameterTypes, SymbolQualifier::Any}).empty());
+}
+
 TEST(TagsIndexTest, ManageTwoTranslationUnits)
 {
    ftags::ProjectDb tagsDb{/* name = */ "test", /* rootDirectory = */ "/tmp"};
@@ -362,6 +402,52 @@ TEST_F(TagsIndexTestMulti, FindVariables)
    ASSERT_EQ(allArg.size(), 9);
 }
 
+TEST_F(TagsIndexTestMulti, FindInPages)
+{
+   ftags::ProjectDb::SymbolQuery symbolQuery{};
+   symbolQuery.limit = 4;
+
+   std::vector<const ftags::Record*> allArg;
+   std::vector<bool>                 hasMoreResults;
+
+   for (symbolQuery.offset = 0; symbolQuery.offset < 12; symbolQuery.offset += symbolQuery.limit)
+   {
+      bool                                    hasMore = false;
+      const std::vector<const ftags::Record*> page    = tagsDb->findSymbol("arg", symbolQuery, hasMore);
+      ASSERT_LE(page.size(), symbolQuery.limit);
+
+      allArg.insert(allArg.end(), page.cbegin(), page.cend());
+      hasMoreResults.push_back(hasMore);
+   }
+
+   ASSERT_EQ(hasMoreResults, (std::vector<bool>{true, true, false}));
+
+   ftags::Record::filterDuplicates(allArg);
+   ASSERT_EQ(allArg, tagsDb->findSymbol("arg"));
+}
+
+TEST_F(TagsIndexTestMulti, CallsAreCanonicalized)
+{
+   // test::function(arg) yields one call record at the name, qualified by the namespace
+   const std::vector<const ftags::Record*> functionReference = tagsDb->findReference("function");
+   ASSERT_EQ(functionReference.size(), 1);
+   ASSERT_EQ(ftags::SymbolType::FunctionCallExpression, functionReference[0]->getType());
+   ASSERT_EQ(1, functionReference[0]->attributes.isQualified);
+
+   const ftags::Cursor cursor = tagsDb->inflateRecord(functionReference[0]);
+   ASSERT_EQ(17, cursor.location.line);
+   ASSERT_EQ(19, cursor.location.column);
+
+   const std::vector<const ftags::Record*> otherFunctionReference = tagsDb->findReference("other_function");
+   ASSERT_EQ(otherFunctionReference.size(), 1);
+   ASSERT_EQ(ftags::SymbolType::FunctionCallExpression, otherFunctionReference[0]->getType());
+   ASSERT_EQ(1, otherFunctionReference[0]->attributes.isQualified);
+
+   // the qualifier of the out-of-line definition in lib.cc remains, and the one of the type in the arguments
+   // of test::other_function, which does not qualify the call
+   ASSERT_EQ(2, tagsDb->findSymbol("test", ftags::SymbolType::NamespaceReference).size());
+}
+
 TEST_F(TagsIndexTestMulti, MergeProjectDatabases)
 {
    ftags::ProjectDb mergedDb{/* name = */ "test", /* rootDirectory = */ "/tmp"};
@@ -385,6 +471,21 @@ TEST_F(TagsIndexTestMulti, MergeProjectDatabases)
    ASSERT_EQ(allArg.size(), 9);
 }
 
+TEST_F(TagsIndexTestMulti, MergeInSlices)
+{
+   ftags::ProjectDb mergedDb{/* name = */ "test", /* rootDirectory = */ "/tmp"};
+
+   std::vector<std::size_t> translationUnitCounts;
+   mergedDb.mergeFrom(*tagsDb, [&mergedDb, &translationUnitCounts]() {
+      // the database can be queried between the slices
+      mergedDb.assertValid();
+      translationUnitCounts.push_back(mergedDb.getTranslationUnitCount());
+   });
+
+   ASSERT_EQ(translationUnitCounts, (std::vector<std::size_t>{1, 2}));
+   ASSERT_EQ(mergedDb.findSymbol("count").size(), 2);
+}
+
 TEST_F(TagsIndexTestMulti, IdentifySymbols)
 {
    ASSERT_EQ(tagsDb->identifySymbol(libPath.string(), 3, 4).size(), 0);
@@ -408,3 +509,369 @@ TEST_F(TagsIndexTestMulti, FindMacroDefinition)
    const std::vector<const ftags::Record*> doubleMacroAgain = tagsDb->findSymbol("DOUBLY_SO");
    ASSERT_EQ(doubleMacroAgain.size(), 2);
 }
+
+TEST(TagsIndexTest, BatchSessionParsesSeveralTranslationUnits)
+{
+   const auto rootPath = std::filesystem::current_path();
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   const auto libPath  = rootPath / "test" / "db" / "data" / "multi-module" / "lib.cc";
+   const auto testPath = rootPath / "test" / "db" / "data" / "multi-module" / "test.cc";
+
+   ftags::ProjectDb interactiveDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   const auto&      interactiveLib = interactiveDb.parseOneFile(libPath, arguments);
+
+   ftags::ParsingSession parsingSession{ftags::ParsingSession::Profile::Batch};
+
+   ftags::ProjectDb batchDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   const auto&      batchLib = batchDb.parseOneFile(parsingSession, libPath, arguments);
+   batchDb.parseOneFile(parsingSession, testPath, arguments);
+
+   ASSERT_TRUE(batchDb.isFileIndexed(libPath));
+   ASSERT_TRUE(batchDb.isFileIndexed(testPath));
+
+   /*
+    * Without a preamble, the preprocessing record also covers the leading #include directive.
+    */
+   const std::vector<const ftags::Record*> interactiveRecords =
+      interactiveDb.getTranslationUnitRecords(interactiveLib, true);
+   const std::vector<const ftags::Record*> batchRecords = batchDb.getTranslationUnitRecords(batchLib, true);
+   ASSERT_LE(interactiveRecords.size(), batchRecords.size());
+   ASSERT_TRUE(std::any_of(batchRecords.cbegin(), batchRecords.cend(), [](const ftags::Record* record) {
+      return record->getType() == ftags::SymbolType::InclusionDirective;
+   }));
+
+   ASSERT_EQ(1, batchDb.findDefinition("main").size());
+   ASSERT_EQ(1, batchDb.findDefinition("function").size());
+}
+
+TEST(TagsIndexTest, IndexActionSharesHeaderSpans)
+{
+   const auto rootPath = std::filesystem::current_path();
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   const auto libPath  = rootPath / "test" / "db" / "data" / "multi-module" / "lib.cc";
+   const auto testPath = rootPath / "test" / "db" / "data" / "multi-module" / "test.cc";
+
+   ftags::ParsingSession parsingSession{ftags::ParsingSession::Profile::Batch,
+                                        ftags::ParsingSession::FrontEnd::IndexAction};
+
+   ftags::ProjectDb tagsDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   const auto&      libUnit  = tagsDb.parseOneFile(parsingSession, libPath, arguments);
+   const auto&      testUnit = tagsDb.parseOneFile(parsingSession, testPath, arguments);
+
+   ASSERT_TRUE(tagsDb.isFileIndexed(libPath));
+   ASSERT_TRUE(tagsDb.isFileIndexed(testPath));
+
+   ASSERT_EQ(1, tagsDb.findDefinition("main").size());
+   ASSERT_EQ(1, tagsDb.findDefinition("function").size());
+   ASSERT_EQ(1, tagsDb.findReference("function").size());
+
+   /*
+    * lib.h was indexed with lib.cc, and test.cc refers to the same spans
+    */
+   const auto headerKey = rootPath / "test" / "db" / "data" / "multi-module" / "lib.h";
+
+   std::size_t libHeaderRecords  = 0;
+   std::size_t testHeaderRecords = 0;
+   for (const ftags::Record* record : tagsDb.getTranslationUnitRecords(libUnit, false))
+   {
+      libHeaderRecords += (tagsDb.inflateRecord(record).location.fileName == headerKey.string()) ? 1U : 0U;
+   }
+   for (const ftags::Record* record : tagsDb.getTranslationUnitRecords(testUnit, false))
+   {
+      testHeaderRecords += (tagsDb.inflateRecord(record).location.fileName == headerKey.string()) ? 1U : 0U;
+   }
+
+   ASSERT_NE(0, libHeaderRecords);
+   ASSERT_EQ(libHeaderRecords, testHeaderRecords);
+}
+
+TEST(TagsIndexTest, DeclarationsOnlyPassIsUpgraded)
+{
+   const auto rootPath = std::filesystem::current_path();
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   const auto testPath = rootPath / "test" / "db" / "data" / "multi-module" / "test.cc";
+
+   ftags::ParsingSession parsingSession{ftags::ParsingSession::Profile::Batch};
+
+   parsingSession.setDeclarationsOnly(true, /* incomplete = */ true);
+   ftags::ProjectDb declarationsDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   const auto&      partialUnit = declarationsDb.parseOneFile(parsingSession, testPath, arguments);
+   ASSERT_TRUE(partialUnit.isPartial());
+
+   // function bodies are skipped, so definitions are only known as declarations until the complete pass
+   ASSERT_EQ(0, declarationsDb.findDefinition("main").size());
+   ASSERT_EQ(1, declarationsDb.findDeclaration("main").size());
+   ASSERT_EQ(1, declarationsDb.findDeclaration("function").size());
+   ASSERT_EQ(0, declarationsDb.findReference("function").size());
+
+   parsingSession.setDeclarationsOnly(false);
+   ftags::ProjectDb completeDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   const auto&      completeUnit = completeDb.parseOneFile(parsingSession, testPath, arguments);
+   ASSERT_FALSE(completeUnit.isPartial());
+
+   ftags::ProjectDb mergedDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+
+   mergedDb.mergeFrom(declarationsDb);
+   ASSERT_EQ(1, mergedDb.getTranslationUnitCount());
+   ASSERT_EQ(0, mergedDb.findReference("function").size());
+
+   mergedDb.mergeFrom(completeDb);
+   ASSERT_EQ(1, mergedDb.getTranslationUnitCount());
+   ASSERT_EQ(1, mergedDb.findReference("function").size());
+   ASSERT_EQ(1, mergedDb.findDefinition("main").size());
+   ASSERT_EQ(completeDb.getRecordCount(), mergedDb.getRecordCount());
+
+   // a late declarations-only result does not replace the complete translation unit
+   mergedDb.mergeFrom(declarationsDb);
+   ASSERT_EQ(1, mergedDb.getTranslationUnitCount());
+   ASSERT_EQ(1, mergedDb.findReference("function").size());
+}
+
+TEST(TagsIndexTest, ReparseUnsavedBuffer)
+{
+   const auto rootPath = std::filesystem::current_path();
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   const auto testPath = (rootPath / "test" / "db" / "data" / "multi-module" / "test.cc").string();
+
+   ftags::ParsingSession parsingSession{ftags::ParsingSession::Profile::Interactive};
+
+   ftags::ProjectDb tagsDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   tagsDb.parseOneFile(parsingSession, testPath, arguments);
+   ASSERT_EQ(1, tagsDb.findReference("function").size());
+
+   const std::string firstEdit = "#include \"lib.h\"\n"
+                                 "int firstHelper(int arg) { return test::function(arg) + 1; }\n"
+                                 "int main() { return firstHelper(2); }\n";
+
+   tagsDb.reparseOneFile(parsingSession, testPath, arguments, firstEdit);
+   ASSERT_EQ(1, tagsDb.getTranslationUnitCount());
+   ASSERT_EQ(1, tagsDb.findDefinition("firstHelper").size());
+   ASSERT_EQ(1, tagsDb.findReference("function").size());
+
+   // the second update reparses the translation unit retained by the session
+   const std::string secondEdit = "#include \"lib.h\"\n"
+                                  "int secondHelper(int arg) { return arg * 2; }\n"
+                                  "int main() { return secondHelper(2); }\n";
+
+   tagsDb.reparseOneFile(parsingSession, testPath, arguments, secondEdit);
+   ASSERT_EQ(1, tagsDb.getTranslationUnitCount());
+   ASSERT_EQ(0, tagsDb.findDefinition("firstHelper").size());
+   ASSERT_EQ(1, tagsDb.findDefinition("secondHelper").size());
+   ASSERT_EQ(0, tagsDb.findReference("function").size());
+   ASSERT_EQ(1, tagsDb.findDefinition("main").size());
+}
+
+TEST(TagsIndexTest, FingerprintDetectsChangedSources)
+{
+   const auto rootPath = std::filesystem::current_path();
+   const auto dataPath = rootPath / "test" / "db" / "data" / "multi-module";
+
+   const auto workPath = std::filesystem::temp_directory_path() / "ftags_fingerprint_test";
+   std::filesystem::remove_all(workPath);
+   std::filesystem::create_directories(workPath);
+   for (const char* fileName : {"test.cc", "lib.h"})
+   {
+      std::filesystem::copy_file(dataPath / fileName, workPath / fileName);
+   }
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   const auto testPath = (workPath / "test.cc").string();
+
+   ftags::ProjectDb tagsDb{/* name = */ "multi", /* rootDirectory = */ workPath.string()};
+   tagsDb.parseOneFile(testPath, arguments);
+
+   {
+      ftags::ProjectDb::FileHashCache fileHashCache;
+      ASSERT_TRUE(tagsDb.isTranslationUnitCurrent(testPath, arguments, fileHashCache));
+      ASSERT_NE(0, fileHashCache.count((workPath / "lib.h").string()));
+
+      const std::vector<const char*> otherArguments = {
+         "-Wall",
+         "-Wextra",
+         "-DNDEBUG",
+      };
+      ASSERT_FALSE(tagsDb.isTranslationUnitCurrent(testPath, otherArguments, fileHashCache));
+   }
+
+   // a change in an included header invalidates the translation unit
+   {
+      std::ofstream header(workPath / "lib.h", std::ios::app);
+      header << "\nint anotherFunction(int arg);\n";
+   }
+
+   {
+      ftags::ProjectDb::FileHashCache fileHashCache;
+      ASSERT_FALSE(tagsDb.isTranslationUnitCurrent(testPath, arguments, fileHashCache));
+   }
+
+   tagsDb.parseOneFile(testPath, arguments);
+
+   {
+      ftags::ProjectDb::FileHashCache fileHashCache;
+      ASSERT_TRUE(tagsDb.isTranslationUnitCurrent(testPath, arguments, fileHashCache));
+   }
+
+   std::filesystem::remove_all(workPath);
+}
+
+TEST(TagsIndexTest, FindTranslationUnitsDependingOnFiles)
+{
+   const auto rootPath = std::filesystem::current_path();
+   const auto dataPath = rootPath / "test" / "db" / "data" / "multi-module";
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   const auto testPath = (dataPath / "test.cc").string();
+   const auto libPath  = (dataPath / "lib.cc").string();
+
+   ftags::ProjectDb tagsDb{/* name = */ "multi", /* rootDirectory = */ dataPath.string()};
+   tagsDb.parseOneFile(testPath, arguments);
+   tagsDb.parseOneFile(libPath, arguments);
+
+   // both sources include the header
+   std::vector<std::string> dependents = tagsDb.findDependentTranslationUnits({(dataPath / "lib.h").string()});
+   std::sort(dependents.begin(), dependents.end());
+   ASSERT_EQ(2, dependents.size());
+   ASSERT_EQ(libPath, dependents[0]);
+   ASSERT_EQ(testPath, dependents[1]);
+
+   dependents = tagsDb.findDependentTranslationUnits({testPath});
+   ASSERT_EQ(1, dependents.size());
+   ASSERT_EQ(testPath, dependents[0]);
+
+   dependents = tagsDb.findDependentTranslationUnits({(dataPath / "missing.h").string()});
+   ASSERT_TRUE(dependents.empty());
+}
+
+TEST(TagsIndexTest, IncludeSignatureCountsOnlyTheHeadersUnderTheRoot)
+{
+   const auto rootPath = std::filesystem::current_path();
+   const auto dataPath = rootPath / "test" / "db" / "data" / "multi-module";
+   const auto linkPath = std::filesystem::temp_directory_path() / "ftags_root_link_test";
+
+   std::filesystem::remove_all(linkPath);
+   std::filesystem::create_directory_symlink(dataPath, linkPath);
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   const auto testPath = (dataPath / "test.cc").string();
+
+   // the root is named through a link, but the headers by their canonical names
+   {
+      ftags::ProjectDb tagsDb{/* name = */ "multi", /* rootDirectory = */ linkPath.string()};
+      tagsDb.parseOneFile(testPath, arguments, /* includeEverything = */ true);
+      ASSERT_NE(tagsDb.getTranslationUnitIncludeSignature(testPath), 0);
+   }
+
+   // a sibling directory whose name starts with the name of the root is not under the root
+   {
+      const auto siblingPath = dataPath.parent_path() / "multi-mod";
+
+      ftags::ProjectDb tagsDb{/* name = */ "multi", /* rootDirectory = */ siblingPath.string()};
+      tagsDb.parseOneFile(testPath, arguments, /* includeEverything = */ true);
+      ASSERT_EQ(tagsDb.getTranslationUnitIncludeSignature(testPath), 0);
+   }
+
+   std::filesystem::remove(linkPath);
+}
+
+TEST(TagsIndexTest, DependenciesAreFoundByTheirCanonicalNames)
+{
+   const auto rootPath = std::filesystem::current_path();
+   const auto dataPath = rootPath / "test" / "db" / "data" / "multi-module";
+   const auto linkPath = std::filesystem::temp_directory_path() / "ftags_dependency_link_test";
+
+   std::filesystem::remove_all(linkPath);
+   std::filesystem::create_directory_symlink(dataPath, linkPath);
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   // the parser names the header after the link it was found through
+   const auto testPath = (linkPath / "test.cc").string();
+
+   ftags::ProjectDb tagsDb{/* name = */ "multi", /* rootDirectory = */ dataPath.string()};
+   tagsDb.parseOneFile(testPath, arguments);
+
+   const std::vector<std::string> dependents = tagsDb.findDependentTranslationUnits({(dataPath / "lib.h").string()});
+   ASSERT_EQ(1, dependents.size());
+   ASSERT_EQ(testPath, dependents[0]);
+
+   std::filesystem::remove(linkPath);
+}
+
+TEST(TagsIndexTest, ParsingStatisticsAreCollected)
+{
+   const auto rootPath = std::filesystem::current_path();
+
+   const std::vector<const char*> arguments = {
+      "-Wall",
+      "-Wextra",
+   };
+
+   const auto testPath = rootPath / "test" / "db" / "data" / "multi-module" / "test.cc";
+
+   ftags::ProjectDb tagsDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   const auto&      translationUnit = tagsDb.parseOneFile(testPath, arguments);
+
+   const std::size_t recordCount = tagsDb.getTranslationUnitRecords(translationUnit, true).size() +
+                                   tagsDb.getTranslationUnitRecords(translationUnit, false).size();
+
+   using Phase = ftags::ParsingStatistics::Phase;
+
+   const ftags::ParsingStatistics firstPass = tagsDb.getParsingStatistics();
+   ASSERT_EQ(1, firstPass.translationUnits);
+   ASSERT_LT(0, firstPass.getPhaseNanoseconds(Phase::Parse));
+   ASSERT_LE(firstPass.getPhaseNanoseconds(Phase::SymbolTable), firstPass.getPhaseNanoseconds(Phase::Visit));
+   ASSERT_LT(0, firstPass.cursorsKept);
+   ASSERT_LE(firstPass.cursorsKept, firstPass.cursorsVisited);
+   ASSERT_EQ(recordCount, firstPass.recordsEmitted);
+   ASSERT_LT(0, firstPass.newSpans);
+   ASSERT_LT(0, firstPass.bytesAdded);
+
+   // parsing the same file again produces the same spans, and no new symbols
+   tagsDb.parseOneFile(testPath, arguments);
+
+   const ftags::ParsingStatistics secondPass = tagsDb.getParsingStatistics();
+   ASSERT_EQ(2, secondPass.translationUnits);
+   ASSERT_EQ(firstPass.newSpans, secondPass.newSpans);
+   ASSERT_EQ(firstPass.newSpans + 2 * firstPass.deduplicatedSpans, secondPass.deduplicatedSpans);
+   ASSERT_EQ(firstPass.bytesAdded, secondPass.bytesAdded);
+
+   // fragments add their statistics to the database they are merged into
+   ftags::ProjectDb mergedDb{/* name = */ "multi", /* rootDirectory = */ rootPath.string()};
+   mergedDb.mergeFrom(tagsDb);
+   ASSERT_EQ(2, mergedDb.getParsingStatistics().translationUnits);
+}
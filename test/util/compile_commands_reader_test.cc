@@ -0,0 +1,102 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <compile_commands_reader.h>
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <stdexcept>
+
+using ftags::util::CompileCommandsReader;
+
+TEST(CompileCommandsReaderTest, EmptyDatabaseHasNoEntries)
+{
+   std::istringstream input{" [ ] "};
+
+   CompileCommandsReader                 reader{input};
+   CompileCommandsReader::CompileCommand compileCommand;
+
+   ASSERT_FALSE(reader.readNext(compileCommand));
+   ASSERT_FALSE(reader.readNext(compileCommand));
+}
+
+TEST(CompileCommandsReaderTest, EntriesAreReadOneAtATime)
+{
+   std::istringstream input{R"([
+   {
+      "directory": "/home/test/build",
+      "command": "/usr/bin/c++ -DNAME=\"a b\" -I../include -o lib.o -c ../src/lib.cc",
+      "file": "../src/lib.cc"
+   },
+   {
+      "directory": "/home/test/build",
+      "arguments": ["/usr/bin/c++", "-Wall", "-c", "/home/test/src/main.cc", "-o", "main.o", "-std=c++17"],
+      "file": "/home/test/src/main.cc",
+      "output": "main.o",
+      "extra": {"numbers": [1, 2.5e3, -4], "flags": [true, false, null]}
+   }
+   )"};
+
+   CompileCommandsReader                 reader{input};
+   CompileCommandsReader::CompileCommand compileCommand;
+
+   ASSERT_TRUE(reader.readNext(compileCommand));
+   ASSERT_EQ(compileCommand.directory, "/home/test/build");
+   ASSERT_EQ(compileCommand.fileName, "/home/test/build/../src/lib.cc");
+   ASSERT_EQ(compileCommand.arguments,
+             (std::vector<std::string>{"/usr/bin/c++", "-DNAME=a b", "-I../include"}));
+
+   ASSERT_TRUE(reader.readNext(compileCommand));
+   ASSERT_EQ(compileCommand.fileName, "/home/test/src/main.cc");
+   ASSERT_EQ(compileCommand.arguments, (std::vector<std::string>{"/usr/bin/c++", "-Wall", "-std=c++17"}));
+
+   // the closing bracket is missing
+   ASSERT_THROW(reader.readNext(compileCommand), std::runtime_error);
+}
+
+TEST(CompileCommandsReaderTest, StringsAreUnescaped)
+{
+   std::istringstream input{R"([{"file": "/src/café\/😀.cc", "arguments": ["a\tb", "c\\d"]}])"};
+
+   CompileCommandsReader                 reader{input};
+   CompileCommandsReader::CompileCommand compileCommand;
+
+   ASSERT_TRUE(reader.readNext(compileCommand));
+   ASSERT_EQ(compileCommand.fileName, "/src/caf\xc3\xa9/\xf0\x9f\x98\x80.cc");
+   ASSERT_EQ(compileCommand.arguments, (std::vector<std::string>{"a\tb", "c\\d"}));
+
+   ASSERT_FALSE(reader.readNext(compileCommand));
+}
+
+TEST(CompileCommandsReaderTest, CommandLinesAreSplitLikeTheShell)
+{
+   ASSERT_EQ(CompileCommandsReader::splitCommandLine(R"(  cc  'a b'  "c \"d\" \e"  f\ g "" )"),
+             (std::vector<std::string>{"cc", "a b", R"(c "d" \e)", "f g", ""}));
+}
+
+TEST(CompileCommandsReaderTest, MalformedEntriesAreRejected)
+{
+   for (const char* text : {R"({})", R"([{"file": "a.cc" "command": "cc"}])", R"([{"command": "cc"}])"})
+   {
+      std::istringstream input{text};
+
+      CompileCommandsReader                 reader{input};
+      CompileCommandsReader::CompileCommand compileCommand;
+
+      ASSERT_THROW(reader.readNext(compileCommand), std::runtime_error);
+   }
+}
@@ -0,0 +1,189 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <file_watcher.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+using ftags::util::FileWatcher;
+
+namespace
+{
+
+class FileWatcherTest : public ::testing::Test
+{
+protected:
+   void SetUp() override
+   {
+      m_rootPath    = std::filesystem::temp_directory_path() / "ftags_file_watcher_test";
+      m_outsidePath = std::filesystem::temp_directory_path() / "ftags_file_watcher_outside";
+      std::filesystem::remove_all(m_rootPath);
+      std::filesystem::remove_all(m_outsidePath);
+      std::filesystem::create_directories(m_rootPath / "src");
+      std::filesystem::create_directories(m_rootPath / ".git");
+   }
+
+   void TearDown() override
+   {
+      std::filesystem::remove_all(m_rootPath);
+      std::filesystem::remove_all(m_outsidePath);
+   }
+
+   static void writeFile(const std::filesystem::path& path)
+   {
+      std::ofstream output{path};
+      output << "int main() { return 0; }\n";
+   }
+
+   static std::vector<std::string> takeSortedChanges(FileWatcher& watcher)
+   {
+      std::vector<std::string> fileNames = watcher.takeChanges().fileNames;
+      std::sort(fileNames.begin(), fileNames.end());
+      return fileNames;
+   }
+
+   std::filesystem::path m_rootPath;
+
+   // a directory outside the watched tree, to move directories to
+   std::filesystem::path m_outsidePath;
+};
+
+} // anonymous namespace
+
+TEST_F(FileWatcherTest, ChangedFilesAreCollected)
+{
+   FileWatcher watcher{m_rootPath, std::chrono::milliseconds{0}, std::chrono::milliseconds{0}};
+   ASSERT_EQ(2, watcher.getWatchedDirectoryCount());
+   ASSERT_EQ(-1, watcher.getMillisecondsUntilSettled());
+
+   writeFile(m_rootPath / "src" / "main.cc");
+   writeFile(m_rootPath / "src" / "main.cc");
+   writeFile(m_rootPath / "src" / ".main.cc.swp");
+   writeFile(m_rootPath / ".git" / "index");
+
+   watcher.readEvents();
+   ASSERT_TRUE(watcher.hasSettledChanges());
+
+   const std::vector<std::string> fileNames = takeSortedChanges(watcher);
+   ASSERT_EQ(fileNames, (std::vector<std::string>{(m_rootPath / "src" / "main.cc").string()}));
+
+   ASSERT_EQ(-1, watcher.getMillisecondsUntilSettled());
+}
+
+TEST_F(FileWatcherTest, NewDirectoriesAreWatched)
+{
+   FileWatcher watcher{m_rootPath, std::chrono::milliseconds{0}, std::chrono::milliseconds{0}};
+
+   // the file may be written before the new directory is watched, and it is reported either way
+   std::filesystem::create_directories(m_rootPath / "lib");
+   writeFile(m_rootPath / "lib" / "lib.h");
+   watcher.readEvents();
+
+   writeFile(m_rootPath / "lib" / "lib.cc");
+   watcher.readEvents();
+
+   ASSERT_EQ(3, watcher.getWatchedDirectoryCount());
+
+   const std::vector<std::string> fileNames = takeSortedChanges(watcher);
+   ASSERT_EQ(fileNames,
+             (std::vector<std::string>{(m_rootPath / "lib" / "lib.cc").string(),
+                                       (m_rootPath / "lib" / "lib.h").string()}));
+}
+
+TEST_F(FileWatcherTest, RenamedDirectoriesAreWatched)
+{
+   FileWatcher watcher{m_rootPath, std::chrono::milliseconds{0}, std::chrono::milliseconds{0}};
+
+   std::filesystem::rename(m_rootPath / "src", m_rootPath / "source");
+   watcher.readEvents();
+   watcher.takeChanges();
+
+   writeFile(m_rootPath / "source" / "main.cc");
+   watcher.readEvents();
+
+   ASSERT_EQ(2, watcher.getWatchedDirectoryCount());
+
+   const std::vector<std::string> fileNames = takeSortedChanges(watcher);
+   ASSERT_EQ(fileNames, (std::vector<std::string>{(m_rootPath / "source" / "main.cc").string()}));
+}
+
+TEST_F(FileWatcherTest, DirectoriesMovedOutAreNotWatched)
+{
+   std::filesystem::create_directories(m_rootPath / "src" / "lib");
+
+   FileWatcher watcher{m_rootPath, std::chrono::milliseconds{0}, std::chrono::milliseconds{0}};
+   ASSERT_EQ(3, watcher.getWatchedDirectoryCount());
+
+   std::filesystem::rename(m_rootPath / "src", m_outsidePath);
+   watcher.readEvents();
+
+   ASSERT_EQ(1, watcher.getWatchedDirectoryCount());
+
+   writeFile(m_outsidePath / "lib" / "lib.cc");
+   watcher.readEvents();
+
+   ASSERT_TRUE(takeSortedChanges(watcher).empty());
+}
+
+TEST_F(FileWatcherTest, DirectoriesUnderRenamedDirectoriesCanBeMovedOut)
+{
+   std::filesystem::create_directories(m_rootPath / "src" / "lib");
+
+   FileWatcher watcher{m_rootPath, std::chrono::milliseconds{0}, std::chrono::milliseconds{0}};
+
+   std::filesystem::rename(m_rootPath / "src", m_rootPath / "source");
+   watcher.readEvents();
+   ASSERT_EQ(3, watcher.getWatchedDirectoryCount());
+
+   std::filesystem::rename(m_rootPath / "source" / "lib", m_outsidePath);
+   watcher.readEvents();
+   watcher.takeChanges();
+
+   ASSERT_EQ(2, watcher.getWatchedDirectoryCount());
+
+   writeFile(m_outsidePath / "lib.cc");
+   writeFile(m_rootPath / "source" / "main.cc");
+   watcher.readEvents();
+
+   const std::vector<std::string> fileNames = takeSortedChanges(watcher);
+   ASSERT_EQ(fileNames, (std::vector<std::string>{(m_rootPath / "source" / "main.cc").string()}));
+}
+
+TEST_F(FileWatcherTest, ChangesSettleAfterQuietPeriod)
+{
+   FileWatcher watcher{m_rootPath, std::chrono::milliseconds{60 * 1000}, std::chrono::milliseconds{120 * 1000}};
+
+   writeFile(m_rootPath / "src" / "main.cc");
+   watcher.readEvents();
+
+   ASSERT_FALSE(watcher.hasSettledChanges());
+
+   const long remaining = watcher.getMillisecondsUntilSettled();
+   ASSERT_GT(remaining, 59 * 1000);
+   ASSERT_LE(remaining, 60 * 1000);
+
+   FileWatcher impatientWatcher{m_rootPath, std::chrono::milliseconds{60 * 1000}, std::chrono::milliseconds{0}};
+
+   writeFile(m_rootPath / "src" / "main.cc");
+   impatientWatcher.readEvents();
+
+   // the maximum delay is up already
+   ASSERT_TRUE(impatientWatcher.hasSettledChanges());
+}
@@ -0,0 +1,113 @@
+/*
+   Copyright 2019 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <hash_set.h>
+
+#include <gtest/gtest.h>
+
+#include <functional>
+
+namespace
+{
+
+// all values collide, to exercise the probing
+struct ConstantHash
+{
+   std::size_t operator()(int /* value */) const noexcept
+   {
+      return 7;
+   }
+};
+
+} // namespace
+
+TEST(HashSetTest, InsertedValuesAreFound)
+{
+   ftags::util::HashSet<int, std::hash<int>> hashSet;
+
+   ASSERT_TRUE(hashSet.empty());
+   ASSERT_FALSE(hashSet.contains(1));
+
+   ASSERT_TRUE(hashSet.insert(1));
+   ASSERT_TRUE(hashSet.insert(2));
+   ASSERT_FALSE(hashSet.insert(1));
+
+   ASSERT_EQ(2, hashSet.size());
+   ASSERT_TRUE(hashSet.contains(1));
+   ASSERT_TRUE(hashSet.contains(2));
+   ASSERT_FALSE(hashSet.contains(3));
+}
+
+TEST(HashSetTest, GrowKeepsValues)
+{
+   ftags::util::HashSet<int, std::hash<int>> hashSet{4};
+
+   for (int ii = 0; ii < 1000; ii++)
+   {
+      ASSERT_TRUE(hashSet.insert(ii * 31));
+   }
+
+   ASSERT_EQ(1000, hashSet.size());
+   ASSERT_LE(2000, hashSet.capacity());
+
+   for (int ii = 0; ii < 1000; ii++)
+   {
+      ASSERT_TRUE(hashSet.contains(ii * 31));
+      ASSERT_FALSE(hashSet.insert(ii * 31));
+   }
+}
+
+TEST(HashSetTest, CollidingValuesAreDistinct)
+{
+   ftags::util::HashSet<int, ConstantHash> hashSet;
+
+   for (int ii = 0; ii < 100; ii++)
+   {
+      ASSERT_TRUE(hashSet.insert(ii));
+   }
+
+   for (int ii = 0; ii < 100; ii++)
+   {
+      ASSERT_TRUE(hashSet.contains(ii));
+   }
+   ASSERT_FALSE(hashSet.contains(100));
+}
+
+TEST(HashSetTest, ClearKeepsCapacity)
+{
+   ftags::util::HashSet<int, std::hash<int>> hashSet;
+
+   for (int ii = 0; ii < 100; ii++)
+   {
+      hashSet.insert(ii);
+   }
+
+   const std::size_t capacity = hashSet.capacity();
+
+   hashSet.clear();
+
+   ASSERT_TRUE(hashSet.empty());
+   ASSERT_EQ(capacity, hashSet.capacity());
+
+   for (int ii = 0; ii < 100; ii++)
+   {
+      ASSERT_FALSE(hashSet.contains(ii));
+   }
+
+   ASSERT_TRUE(hashSet.insert(42));
+   ASSERT_TRUE(hashSet.contains(42));
+   ASSERT_FALSE(hashSet.contains(41));
+}
@@ -20,6 +20,8 @@
 #include <gtest/gtest.h>
 
 #include <algorithm>
+#include <string>
+#include <vector>
 
 /*
  * Intrusive, black-box tests for Store.
@@ -668,3 +670,24 @@ TEST(StoreAllocatorIteratorTest, IterateAllocatedObjects)
 
    ASSERT_EQ(actualAllocations, expectedAllocations);
 }
+
+TEST(StoreAllocatorIteratorTest, DestroyedObjectsAreNotIterated)
+{
+   ftags::util::Store<std::string, uint32_t, k_SmallStoreSegmentSize> store;
+
+   const auto blockOne = store.construct();
+   const auto blockTwo = store.construct();
+
+   *blockOne.iterator = "one";
+   *blockTwo.iterator = "a string long enough to be allocated on the heap";
+
+   store.destroy(blockTwo.key);
+
+   std::vector<std::string> values;
+   store.forEach([&values](uint32_t /* key */, std::string* value) { values.push_back(*value); });
+
+   ASSERT_EQ(1, values.size());
+   ASSERT_EQ("one", values[0]);
+
+   store.destruct();
+}